@@ -0,0 +1,105 @@
+//
+// Minimal benchmark harness for host builds
+//
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include "Bench.h"
+
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t nmemb, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void __libc_free(void *ptr);
+}
+
+static bench_alloc_stats_t allocStats = {0, 0};
+static bool allocCounting = false;
+
+static inline void countAlloc(size_t size) {
+    if (allocCounting) {
+        allocStats.allocs++;
+        allocStats.bytes += size;
+    }
+}
+
+extern "C" {
+void *malloc(size_t size) {
+    countAlloc(size);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size) {
+    countAlloc(nmemb * size);
+    return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+    countAlloc(size);
+    return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr) {
+    __libc_free(ptr);
+}
+}
+
+bench_alloc_stats_t benchAllocStats() {
+    return allocStats;
+}
+
+void benchSetAllocCounting(bool enabled) {
+    allocCounting = enabled;
+}
+
+void Bench::run(const char *name, const std::function<void()> &op) {
+    if (_filter != nullptr && strstr(name, _filter) == nullptr) {
+        return;
+    }
+
+    // Warm up caches and any lazily initialised state
+    for (int i = 0; i < 100; i++) {
+        op();
+    }
+
+    uint64_t batch = 1;
+    while (true) {
+        bench_alloc_stats_t before = benchAllocStats();
+        benchSetAllocCounting(true);
+        auto start = std::chrono::steady_clock::now();
+        for (uint64_t i = 0; i < batch; i++) {
+            op();
+        }
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        benchSetAllocCounting(false);
+        bench_alloc_stats_t after = benchAllocStats();
+
+        uint64_t elapsedNs = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+        if (elapsedNs >= (uint64_t) _minTimeMs * 1000000 || batch >= (1ULL << 32)) {
+            bench_result_t result = {
+                    name,
+                    batch,
+                    (double) elapsedNs / (double) batch,
+                    (double) (after.allocs - before.allocs) / (double) batch,
+                    (double) (after.bytes - before.bytes) / (double) batch,
+            };
+            print(&result);
+            return;
+        }
+        batch *= 2;
+    }
+}
+
+void Bench::fail(const char *name, const char *reason) {
+    _failures++;
+    printf("{\"name\":\"%s\",\"error\":\"%s\"}\n", name, reason);
+}
+
+void Bench::print(const bench_result_t *result) {
+    printf("{\"name\":\"%s\",\"iterations\":%llu,\"ns_per_op\":%.2f,\"allocs_per_op\":%.3f,"
+           "\"bytes_allocated_per_op\":%.1f}\n",
+           result->name, (unsigned long long) result->iterations, result->nsPerOp, result->allocsPerOp,
+           result->bytesPerOp);
+    fflush(stdout);
+}
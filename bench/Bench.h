@@ -0,0 +1,61 @@
+//
+// Minimal benchmark harness for host builds. Each benchmark is run in growing batches until it has taken at least the
+// minimum measuring time, and the result is printed as one JSON object per line:
+//
+//   {"name":"...","iterations":N,"ns_per_op":X,"allocs_per_op":Y,"bytes_allocated_per_op":Z}
+//
+// Allocations are counted by wrapping malloc() and friends, which also covers operator new.
+//
+
+#ifndef AIR_SENSORS_SENDER_BENCH_H
+#define AIR_SENSORS_SENDER_BENCH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+typedef struct bench_alloc_stats {
+    uint64_t allocs;
+    uint64_t bytes;
+} bench_alloc_stats_t;
+
+typedef struct bench_result {
+    const char *name;
+    uint64_t iterations;
+    double nsPerOp;
+    double allocsPerOp;
+    double bytesPerOp;
+} bench_result_t;
+
+// Counters since program start. Only allocations made while counting is enabled are recorded.
+bench_alloc_stats_t benchAllocStats();
+
+void benchSetAllocCounting(bool enabled);
+
+template<typename T>
+inline void benchDoNotOptimize(T const &value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+class Bench {
+protected:
+    const char *_filter;
+    uint32_t _minTimeMs;
+    int _failures = 0;
+
+    void print(const bench_result_t *result);
+
+public:
+    Bench(const char *filter, uint32_t minTimeMs) : _filter{filter}, _minTimeMs{minTimeMs} {};
+
+    // `op` is called once per iteration
+    void run(const char *name, const std::function<void()> &op);
+
+    // Records a benchmark as failed, e.g. when a sanity check on its output does not hold
+    void fail(const char *name, const char *reason);
+
+    int failures() const { return _failures; }
+};
+
+
+#endif //AIR_SENSORS_SENDER_BENCH_H
@@ -0,0 +1,52 @@
+//
+// Stream that endlessly replays a fixed byte sequence and discards everything written to it
+//
+
+#ifndef AIR_SENSORS_SENDER_REPLAYSTREAM_H
+#define AIR_SENSORS_SENDER_REPLAYSTREAM_H
+
+#include <Arduino.h>
+#include <vector>
+
+class ReplayStream : public Stream {
+protected:
+    std::vector<uint8_t> _data;
+    size_t _pos = 0;
+    // Bytes reported as available per refill, like a UART RX buffer
+    int _window;
+    int _remaining = 0;
+
+public:
+    explicit ReplayStream(std::vector<uint8_t> data, int window = 64) : _data{std::move(data)}, _window{window} {};
+
+    // Makes the next window of bytes available, as if they had just arrived on the wire
+    void refill() { _remaining = _window; }
+
+    int available() override { return _remaining; }
+
+    int read() override {
+        if (_remaining <= 0 || _data.empty()) {
+            return -1;
+        }
+        _remaining--;
+        uint8_t byte = _data[_pos];
+        _pos = (_pos + 1) % _data.size();
+        return byte;
+    }
+
+    int peek() override {
+        if (_remaining <= 0 || _data.empty()) {
+            return -1;
+        }
+        return _data[_pos];
+    }
+
+    size_t write(uint8_t) override { return 1; }
+
+    size_t write(const uint8_t *, size_t size) override { return size; }
+
+    using Print::write;
+};
+
+
+#endif //AIR_SENSORS_SENDER_REPLAYSTREAM_H
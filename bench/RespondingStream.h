@@ -0,0 +1,69 @@
+//
+// Stream that answers every SDS011 command written to it right away, like a unit in query mode: a data frame for a
+// query, the setting echoed back for anything else. Allocation-free, so that it can take part in allocation checks.
+//
+
+#ifndef AIR_SENSORS_SENDER_RESPONDINGSTREAM_H
+#define AIR_SENSORS_SENDER_RESPONDINGSTREAM_H
+
+#include <Arduino.h>
+#include <SDS011.h>
+
+class RespondingStream : public Stream {
+protected:
+    uint16_t _deviceId;
+    sds011_response_u _reply = {{0}};
+    size_t _pos = sizeof(_reply.raw.bytes);
+    uint32_t _queries = 0;
+
+    void answer(const sds011_command_u *cmd) {
+        _reply = {{0}};
+        _reply.common.head = SDS011_HEAD;
+        _reply.common.deviceId = _deviceId;
+        if (cmd->setting.command == SDS011_CMD_QUERY) {
+            // PM moving back and forth, so that the interval keeps changing
+            _reply.query.commandId = SDS011_RESP_ID_DATA;
+            _reply.query.pm25 = 100 + (_queries % 4) * 40;
+            _reply.query.pm10 = 200 + (_queries % 4) * 60;
+            _queries++;
+        } else {
+            _reply.setting.commandId = SDS011_RESP_ID_REPLY;
+            _reply.setting.command = cmd->setting.command;
+            _reply.setting.operation = cmd->setting.operation;
+            _reply.setting.setting = cmd->setting.setting;
+        }
+        uint8_t accum = 0;
+        for (size_t i = 2; i < 8; i++) {
+            accum += _reply.raw.bytes[i];
+        }
+        _reply.common.checksum = accum;
+        _reply.common.tail = SDS011_TAIL;
+        _pos = 0;
+    }
+
+public:
+    explicit RespondingStream(uint16_t deviceId) : _deviceId{deviceId} {};
+
+    uint32_t queries() const { return _queries; }
+
+    int available() override { return (int) (sizeof(_reply.raw.bytes) - _pos); }
+
+    int read() override { return _pos < sizeof(_reply.raw.bytes) ? _reply.raw.bytes[_pos++] : -1; }
+
+    int peek() override { return _pos < sizeof(_reply.raw.bytes) ? _reply.raw.bytes[_pos] : -1; }
+
+    size_t write(uint8_t) override { return 1; }
+
+    // The driver writes each command in one go
+    size_t write(const uint8_t *buffer, size_t size) override {
+        if (size == sizeof(sds011_command_raw_t)) {
+            answer(reinterpret_cast<const sds011_command_u *>(buffer));
+        }
+        return size;
+    }
+
+    using Print::write;
+};
+
+
+#endif //AIR_SENSORS_SENDER_RESPONDINGSTREAM_H
@@ -0,0 +1,929 @@
+//
+// Benchmarks for the per-sample hot paths of the SDS011 driver and the logger.
+//
+// Usage: program [--filter SUBSTRING] [--min-time-ms N]
+//
+
+#include <Arduino.h>
+#include <HomieLogger.h>
+#include <SDS011.h>
+#include <NumberFormat.h>
+#include <SampleEncoder.h>
+#include <Scheduler.h>
+#include <LatencyStats.h>
+#include <ParticulateSensor.h>
+#include <Deadband.h>
+#include <StateStore.h>
+#include <WindowStats.h>
+#include <HomieRegistry.h>
+#include <AdaptivePolling.h>
+#include <BsecRatePolicy.h>
+#include <SamplePipeline.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include "Bench.h"
+#include "MemorySampleSpill.h"
+#include "ReplayStream.h"
+#include "RespondingStream.h"
+
+// Exposes the protected internals under test
+class SDS011Bench : public SDS011 {
+public:
+    explicit SDS011Bench(Stream *serial) : SDS011(serial) {};
+
+    using SDS011::genChecksum;
+    using SDS011::checkChecksumResp;
+    using SDS011::fillBoilerplate;
+    using SDS011::pollFrame;
+    using SDS011::readPmData;
+    using SDS011::traceFrame;
+};
+
+// Sets every counter to its maximum
+class LatencyStatsBench : public LatencyStats {
+public:
+    void saturate() {
+        _count = _minUs = _maxUs = UINT32_MAX;
+        for (uint32_t &bucket : _buckets) {
+            bucket = UINT32_MAX;
+        }
+    }
+};
+
+// Discards output, so that the logger cost is measured without the cost of a terminal
+class NullStream : public Stream {
+public:
+    int available() override { return 0; }
+
+    int read() override { return -1; }
+
+    int peek() override { return -1; }
+
+    size_t write(uint8_t) override { return 1; }
+
+    size_t write(const uint8_t *, size_t size) override { return size; }
+
+    using Print::write;
+};
+
+static std::vector<uint8_t> makeDataFrames(size_t count, size_t noiseEvery) {
+    std::vector<uint8_t> bytes;
+    uint32_t rng = 1;
+    for (size_t i = 0; i < count; i++) {
+        if (noiseEvery > 0 && i % noiseEvery == 0) {
+            // Garbage including stray heads and a truncated frame
+            for (uint8_t byte : {0x12, 0xAA, 0x34, 0xAA, 0xC0, 0x01}) {
+                bytes.push_back(byte);
+            }
+            for (int j = 0; j < 7; j++) {
+                rng ^= rng << 13;
+                rng ^= rng >> 17;
+                rng ^= rng << 5;
+                bytes.push_back((uint8_t) rng);
+            }
+        }
+        sds011_response_u frame = {{0}};
+        frame.query.head = SDS011_HEAD;
+        frame.query.commandId = SDS011_RESP_ID_DATA;
+        frame.query.pm25 = 100 + i % 50;
+        frame.query.pm10 = 200 + i % 70;
+        frame.query.deviceId = 0xA1B2;
+        uint16_t accum = 0;
+        for (size_t j = 2; j < 8; j++) {
+            accum += frame.raw.bytes[j];
+        }
+        frame.query.checksum = accum & 0xFF;
+        frame.query.tail = SDS011_TAIL;
+        bytes.insert(bytes.end(), frame.raw.bytes, frame.raw.bytes + sizeof(frame.raw.bytes));
+    }
+    return bytes;
+}
+
+static void benchSDS011(Bench *bench) {
+    uint8_t payload[19] = {0xAA, 0xB4, 0x06, 0x01, 0x01, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xFF, 0xFF, 0x05, 0xAB};
+    bench->run("sds011_gen_checksum", [&payload]() {
+        benchDoNotOptimize(SDS011Bench::genChecksum(payload + 2, 15));
+    });
+
+    std::vector<uint8_t> frame = makeDataFrames(1, 0);
+    sds011_response_u resp;
+    memcpy(resp.raw.bytes, frame.data(), sizeof(resp.raw.bytes));
+    bench->run("sds011_check_checksum_resp", [&resp]() {
+        benchDoNotOptimize(SDS011Bench::checkChecksumResp(&resp));
+    });
+
+    sds011_command_u cmd = {{0}};
+    cmd.setting.command = SDS011_CMD_SLEEP_WORK;
+    cmd.setting.operation = SDS011_OPERATION_SET;
+    cmd.setting.setting = SDS011_SLEEP_MODE_WORK;
+    cmd.setting.sensorID = SDS011_ANY;
+    bench->run("sds011_fill_boilerplate", [&cmd]() {
+        SDS011Bench::fillBoilerplate(&cmd);
+        benchDoNotOptimize(cmd);
+    });
+
+    // One op is one decoded frame
+    ReplayStream clean(makeDataFrames(64, 0));
+    SDS011Bench cleanSds(&clean);
+    bench->run("sds011_read_pm_data", [&clean, &cleanSds]() {
+        sds011_pm_data_t data;
+        if (!cleanSds.readPmData(&data, 0)) {
+            clean.refill();
+            cleanSds.readPmData(&data, 0);
+        }
+        benchDoNotOptimize(data);
+    });
+
+    // Tracing compiled in but disabled at runtime is what production builds pay on every frame
+    bench->run("sds011_trace_frame_disabled", [&cleanSds, &frame]() {
+        cleanSds.traceFrame("SDS011: recv ", frame.data(), frame.size());
+    });
+    cleanSds.setLogLevel(SDS011_LOG_TRACE);
+    bench->run("sds011_trace_frame_enabled", [&cleanSds, &frame]() {
+        cleanSds.traceFrame("SDS011: recv ", frame.data(), frame.size());
+    });
+    cleanSds.setLogLevel(SDS011_LOG_ERROR);
+
+    // Every fourth frame is preceded by garbage the parser has to resynchronise on
+    ReplayStream noisy(makeDataFrames(64, 4));
+    SDS011Bench noisySds(&noisy);
+
+    // One pass over the data: 16 runs of 13 bytes of garbage, each with a truncated frame that fails the checksum
+    std::vector<uint8_t> noisyBytes = makeDataFrames(64, 4);
+    ReplayStream once(noisyBytes, (int) noisyBytes.size());
+    SDS011 onceSds(&once);
+    once.refill();
+    onceSds.poll();
+    const sds011_link_stats_t &link = onceSds.linkStats();
+    if (link.frames != 64 || link.resyncBytes != 16 * 13 || link.checksumFailures == 0) {
+        bench->fail("sds011_resync_noisy", "link statistics do not match the garbage sent");
+    }
+
+    // A unit that never answers: sent, retried once, then failed
+    NullStream silent;
+    SDS011 silentSds(&silent);
+    int result = -1;
+    silentSds.queryAsync([&result](bool success, const sds011_pm_data_t *) { result = success; });
+    for (int i = 0; i < 2; i++) {
+        FakeClock::advanceMillis(1000);
+        silentSds.poll();
+    }
+    if (result != 0 || silentSds.linkStats().timeouts != 2 || silentSds.linkStats().retries != 1) {
+        bench->fail("sds011_command_retry", "command not retried once after a timeout");
+    }
+    bench->run("sds011_resync_noisy", [&noisy, &noisySds]() {
+        sds011_response_u response;
+        while (!noisySds.pollFrame(&response)) {
+            noisy.refill();
+        }
+        benchDoNotOptimize(response);
+    });
+}
+
+static void benchLogger(Bench *bench) {
+    NullStream sink;
+    HomieProperty prop;
+    HomieLogger logger(&sink, &prop);
+
+    const char line[] = "SDS011: recv aa c0 64 00 c8 00 b2 a1 d9 ab \r\n";
+    size_t lineLen = sizeof(line) - 1;
+
+    // Ten lines per second of simulated time, so batches are coalesced as they would be on the device
+    auto endOfLine = [&logger]() {
+        FakeClock::advanceMillis(100);
+        logger.loop();
+    };
+
+    // One op is one byte
+    size_t pos = 0;
+    bench->run("homie_logger_write_byte", [&]() {
+        logger.write((uint8_t) line[pos]);
+        pos = (pos + 1) % lineLen;
+        if (pos == 0) {
+            endOfLine();
+        }
+    });
+
+    // One op is one complete line
+    bench->run("homie_logger_write_bulk", [&]() {
+        logger.write((const uint8_t *) line, lineLen);
+        endOfLine();
+    });
+
+    if (logger.droppedBytes() > 0) {
+        bench->fail("homie_logger", "log output was dropped at a sustainable rate");
+    }
+}
+
+static void benchNumberFormat(Bench *bench) {
+    // Readings in the ranges the BME680 and SDS011 produce
+    static const float values[] = {21.37f, -3.5f, 101325.2f, 45.678f, 0.0f, 999.9f, 27.125f, 1234.5678f};
+    const size_t count = sizeof(values) / sizeof(values[0]);
+
+    // The formatter has to be a drop-in replacement for String(float, decimals) and String(int)
+    uint32_t rng = 7;
+    for (int i = 0; i < 100000; i++) {
+        rng ^= rng << 13;
+        rng ^= rng >> 17;
+        rng ^= rng << 5;
+        float value = ((float) (int32_t) rng) / (float) (1 << (rng % 24));
+        uint8_t decimals = rng % 5;
+        char buf[NUMBER_FORMAT_BUF_SIZE];
+        formatFixed(buf, sizeof(buf), value, decimals);
+        if (String(value, decimals) != String(buf)) {
+            bench->fail("format_fixed", "output differs from String(float)");
+            break;
+        }
+        formatInt(buf, sizeof(buf), (int32_t) rng);
+        if (String((long) (int32_t) rng) != String(buf)) {
+            bench->fail("format_int", "output differs from String(int)");
+            break;
+        }
+        formatUint(buf, sizeof(buf), rng);
+        if (String((unsigned long) rng) != String(buf)) {
+            bench->fail("format_uint", "output differs from String(unsigned long)");
+            break;
+        }
+    }
+
+    size_t i = 0;
+    bench->run("format_fixed", [&]() {
+        char buf[NUMBER_FORMAT_BUF_SIZE];
+        formatFixed(buf, sizeof(buf), values[i++ % count], 2);
+        benchDoNotOptimize(buf);
+    });
+    bench->run("format_string_float", [&]() {
+        String str(values[i++ % count]);
+        benchDoNotOptimize(str);
+    });
+    bench->run("format_int", [&]() {
+        char buf[NUMBER_FORMAT_BUF_SIZE];
+        formatInt(buf, sizeof(buf), (int32_t) (i++ % 1000) - 500);
+        benchDoNotOptimize(buf);
+    });
+    bench->run("format_string_int", [&]() {
+        String str((int) (i++ % 1000) - 500);
+        benchDoNotOptimize(str);
+    });
+}
+
+static void benchSampleEncoder(Bench *bench) {
+    air_sample_t sample = {};
+    sample.seq = 1234;
+    sample.timestamp = 1700000000;
+    sample.uptimeMs = 86400000;
+    sample.flags = SAMPLE_FLAG_BME680 | SAMPLE_FLAG_PM | SAMPLE_FLAG_RUN_IN_DONE | SAMPLE_FLAG_STABILIZATION_DONE;
+    sample.rawTemperature = 23.41f;
+    sample.temperature = 22.87f;
+    sample.pressure = 101325.2f;
+    sample.rawHumidity = 41.2f;
+    sample.humidity = 43.5f;
+    sample.gasResistance = 152345.0f;
+    sample.iaq = 57.3f;
+    sample.iaqAccuracy = 3;
+    sample.staticIaq = 48.1f;
+    sample.staticIaqAccuracy = 3;
+    sample.co2Equivalent = 612.0f;
+    sample.co2Accuracy = 3;
+    sample.breathVocEquivalent = 0.72f;
+    sample.breathVocAccuracy = 3;
+    sample.pm25 = 12.3f;
+    sample.pm10 = 20.1f;
+
+    uint8_t buf[SAMPLE_ENCODER_BUF_SIZE];
+    char *json = reinterpret_cast<char *>(buf);
+
+    // Every sensor field, a flag that is not set, a float that is not a number and counters past INT32_MAX
+    air_sample_t full = sample;
+    full.uptimeMs = 3000000000u;
+    full.flags = SAMPLE_FLAG_BME680 | SAMPLE_FLAG_PM | SAMPLE_FLAG_RUN_IN_DONE;
+    full.pm10 = NAN;
+    static const char fullJson[] =
+            "{\"seq\":1234,\"ts\":1700000000,\"up\":3000000000,\"t_raw\":23.41,\"t\":22.87,\"p\":101325,"
+            "\"h_raw\":41.20,\"h\":43.50,\"gas\":152345.00,\"iaq\":57.3,\"iaq_acc\":3,\"siaq\":48.1,\"siaq_acc\":3,"
+            "\"co2\":612,\"co2_acc\":3,\"voc\":0.72,\"voc_acc\":3,\"run_in\":true,\"stab\":false,\"pm25\":12.3,"
+            "\"pm10\":null}";
+    if (encodeSampleJson(&full, json, sizeof(buf)) != strlen(fullJson) || strcmp(json, fullJson) != 0) {
+        bench->fail("sample_encode_json", "unexpected output for a complete sample");
+    }
+    // 21 fields: a map header of major type 5 with the count inline
+    if (encodeSampleCbor(&full, buf, sizeof(buf)) == 0 || buf[0] != 0xB5) {
+        bench->fail("sample_encode_cbor", "unexpected map header for a complete sample");
+    }
+
+    // A replayed PM-only sample: BME680 fields are left out for their flag and ts for being 0
+    air_sample_t pmOnly = {};
+    pmOnly.seq = 1000;
+    pmOnly.uptimeMs = 3000000000u;
+    pmOnly.flags = SAMPLE_FLAG_PM | SAMPLE_FLAG_REPLAYED;
+    pmOnly.pm25 = 12.3f;
+    pmOnly.pm10 = 20.1f;
+    static const char pmOnlyJson[] = "{\"seq\":1000,\"up\":3000000000,\"replayed\":true,\"pm25\":12.3,\"pm10\":20.1}";
+    if (encodeSampleJson(&pmOnly, json, sizeof(buf)) != strlen(pmOnlyJson) || strcmp(json, pmOnlyJson) != 0) {
+        bench->fail("sample_encode_json", "unexpected output for a PM-only sample");
+    }
+    // No room for the terminating NUL
+    if (encodeSampleJson(&pmOnly, json, strlen(pmOnlyJson)) != 0) {
+        bench->fail("sample_encode_json", "truncated output not reported");
+    }
+    static const uint8_t pmOnlyCbor[] = {
+            0xA5,
+            0x63, 's', 'e', 'q', 0x19, 0x03, 0xE8,
+            0x62, 'u', 'p', 0x1A, 0xB2, 0xD0, 0x5E, 0x00,
+            0x68, 'r', 'e', 'p', 'l', 'a', 'y', 'e', 'd', 0xF5,
+            // float32, big-endian
+            0x64, 'p', 'm', '2', '5', 0xFA, 0x41, 0x44, 0xCC, 0xCD,
+            0x64, 'p', 'm', '1', '0', 0xFA, 0x41, 0xA0, 0xCC, 0xCD,
+    };
+    if (encodeSampleCbor(&pmOnly, buf, sizeof(buf)) != sizeof(pmOnlyCbor) ||
+        memcmp(buf, pmOnlyCbor, sizeof(pmOnlyCbor)) != 0) {
+        bench->fail("sample_encode_cbor", "unexpected output for a PM-only sample");
+    }
+    if (encodeSampleCbor(&pmOnly, buf, sizeof(pmOnlyCbor) - 1) != 0) {
+        bench->fail("sample_encode_cbor", "truncated output not reported");
+    }
+
+    bench->run("sample_encode_json", [&]() {
+        benchDoNotOptimize(encodeSampleJson(&sample, reinterpret_cast<char *>(buf), sizeof(buf)));
+    });
+    bench->run("sample_encode_cbor", [&]() {
+        benchDoNotOptimize(encodeSampleCbor(&sample, buf, sizeof(buf)));
+    });
+}
+
+static void benchScheduler(Bench *bench) {
+    // Checks on the fake clock that a slow low priority task gets deferred, but never a high priority one
+    scheduler_task_t checkTasks[3];
+    Scheduler check(checkTasks, 3, 10000, 4);
+    uint32_t highRuns = 0;
+    check.addPeriodic("high", SCHEDULER_PRIORITY_HIGH, 1000, 0, [&highRuns]() { highRuns++; });
+    check.addPeriodic("slow", SCHEDULER_PRIORITY_NORMAL, 1000, 0, []() { FakeClock::advanceMicros(15000); });
+    scheduler_task_id_t event = check.addEvent("event", SCHEDULER_PRIORITY_LOW, 1000, []() {});
+    check.signal(event);
+    check.run();
+    if (highRuns != 1 || check.task(event)->stats.runs != 0 || check.task(event)->stats.deferrals != 1 ||
+        check.task(1)->stats.overruns != 1) {
+        bench->fail("scheduler_run_pass", "slow task did not defer the low priority one");
+    }
+    check.addPeriodic("extra", SCHEDULER_PRIORITY_LOW, 0, 0, []() {});
+    if (check.count() != 3) {
+        bench->fail("scheduler_run_pass", "task added past capacity");
+    }
+
+    // A high priority task using up the budget on every pass: the others still run after 4 deferrals
+    scheduler_task_t starvedTasks[3];
+    Scheduler starved(starvedTasks, 3, 10000, 4);
+    starved.addPeriodic("network", SCHEDULER_PRIORITY_HIGH, 1000, 0, []() { FakeClock::advanceMicros(15000); });
+    starved.addPeriodic("particulate", SCHEDULER_PRIORITY_NORMAL, 1000, 0, []() {});
+    scheduler_task_id_t save = starved.addEvent("save", SCHEDULER_PRIORITY_LOW, 1000, []() {});
+    starved.signal(save);
+    for (int pass = 0; pass < 10; pass++) {
+        starved.run();
+        if (pass == 4) {
+            starved.signal(save);
+        }
+    }
+    // 10 passes: deferred 4 times, run on the 5th, then again
+    const scheduler_task_stats_t *normal = &starved.task(1)->stats;
+    const scheduler_task_stats_t *low = &starved.task(save)->stats;
+    if (normal->runs != 2 || normal->deferrals != 8 || normal->forcedRuns != 2 || low->runs != 2 ||
+        low->forcedRuns != 2 || starved.task(0)->stats.runs != 10) {
+        bench->fail("scheduler_run_pass", "tasks starved by a slow high priority one");
+    }
+
+    // A pass like the firmware's: three tasks on every pass, three periodic ones mostly not due, one event
+    scheduler_task_t tasks[8];
+    Scheduler scheduler(tasks, 8, 20000, 10);
+    uint32_t counter = 0;
+    scheduler.addPeriodic("network", SCHEDULER_PRIORITY_HIGH, 10000, 0, [&counter]() { counter++; });
+    scheduler.addPeriodic("bsec", SCHEDULER_PRIORITY_HIGH, 20000, 0, [&counter]() { counter++; });
+    scheduler.addPeriodic("particulate", SCHEDULER_PRIORITY_NORMAL, 2000, 0, [&counter]() { counter++; });
+    scheduler.addPeriodic("status", SCHEDULER_PRIORITY_NORMAL, 2000, 1000, [&counter]() { counter++; });
+    scheduler.addPeriodic("health", SCHEDULER_PRIORITY_LOW, 5000, 60000, [&counter]() { counter++; });
+    scheduler.addPeriodic("replay", SCHEDULER_PRIORITY_LOW, 20000, 1000, [&counter]() { counter++; });
+    scheduler.addEvent("save", SCHEDULER_PRIORITY_LOW, 50000, [&counter]() { counter++; });
+    bench->run("scheduler_run_pass", [&]() {
+        FakeClock::advanceMicros(100);
+        scheduler.run();
+    });
+    benchDoNotOptimize(counter);
+}
+
+static void benchLatencyStats(Bench *bench) {
+    LatencyStats check;
+    check.record(0);
+    check.record(3);
+    check.record(1000);
+    check.record(100000000);
+    char buf[LATENCY_FORMAT_BUF_SIZE];
+    size_t len = check.format(buf, sizeof(buf));
+    const char *expected = "{\"n\":4,\"min\":0,\"mean\":25000250,\"max\":100000000,"
+                           "\"hist\":[1,0,1,0,0,0,0,0,0,0,1,0,0,0,0,0,0,1]}";
+    if (len != strlen(expected) || strcmp(buf, expected) != 0) {
+        bench->fail("latency_format", buf);
+    }
+
+    // Worst case must still fit the documented buffer size
+    LatencyStatsBench full;
+    full.saturate();
+    if (full.format(buf, sizeof(buf)) == 0) {
+        bench->fail("latency_format", "LATENCY_FORMAT_BUF_SIZE too small");
+    }
+
+    LatencyStats stats;
+    uint32_t us = 0;
+    bench->run("latency_record", [&]() {
+        stats.record(us);
+        us = (us * 1103515245 + 12345) & 0xFFFFF;
+    });
+    bench->run("latency_format", [&]() {
+        benchDoNotOptimize(check.format(buf, sizeof(buf)));
+    });
+}
+
+// The firmware's loop() once every unit is configured, minus the Homie publishing whose API takes String: SDS011
+// reports parsed and filtered, logger output buffered, the pass timed. Fails if any pass allocates.
+static void benchSteadyState(Bench *bench) {
+    NullStream sink;
+    HomieLogger logger(&sink, nullptr);
+    ReplayStream stream(makeDataFrames(64, 8));
+    SDS011 sds(&stream);
+    // Never looped: configuration retries are not steady state
+    ParticulateSensor sensor(&sds, 0xA1B2, 1);
+    sds.onPmData([&sensor](const sds011_pm_data_t *data) {
+        if (sensor.accepts(data)) {
+            sensor.handlePmData(data);
+        }
+    });
+
+    Deadband deadband({0.5, 0, 5 * 60 * 1000});
+    char value[NUMBER_FORMAT_BUF_SIZE];
+    sensor.onPmData([&](const sds011_pm_data_t *data) {
+        if (deadband.update(data->pm25, millis())) {
+            formatFixed(value, sizeof(value), data->pm25, 1);
+            logger.print(F("pm25 "));
+            logger.println(value);
+        }
+    });
+
+    scheduler_task_t tasks[4];
+    Scheduler scheduler(tasks, 4, 20000, 10);
+    scheduler.addPeriodic("network", SCHEDULER_PRIORITY_HIGH, 10000, 0, [&logger]() { logger.loop(); });
+    scheduler.addPeriodic("particulate", SCHEDULER_PRIORITY_NORMAL, 2000, 0, [&sds]() { sds.poll(); });
+    scheduler.addPeriodic("refill", SCHEDULER_PRIORITY_NORMAL, 0, 100, [&stream]() { stream.refill(); });
+    LatencyStats latencyLoop;
+
+    auto pass = [&]() {
+        FakeClock::advanceMillis(1);
+        uint32_t start = LatencyStats::start();
+        scheduler.run();
+        latencyLoop.stop(start);
+    };
+
+    for (int i = 0; i < 1000; i++) {
+        pass();
+    }
+    bench_alloc_stats_t before = benchAllocStats();
+    benchSetAllocCounting(true);
+    for (int i = 0; i < 100000; i++) {
+        pass();
+    }
+    benchSetAllocCounting(false);
+    bench_alloc_stats_t after = benchAllocStats();
+    if (after.allocs != before.allocs) {
+        bench->fail("steady_state_pass", "loop passes allocated");
+    }
+    if (sensor.health().frames == 0) {
+        bench->fail("steady_state_pass", "no frames parsed");
+    }
+
+    bench->run("steady_state_pass", pass);
+
+    // Query mode, where every reading takes commands: wake up, query and sleep
+    RespondingStream unit(0xA1B2);
+    SDS011 querySds(&unit);
+    ParticulateSensor querySensor(&querySds, 0xA1B2, 0);
+    querySensor.onPmData([&](const sds011_pm_data_t *data) {
+        if (deadband.update(data->pm25, millis())) {
+            formatFixed(value, sizeof(value), data->pm25, 1);
+            logger.print(F("pm25 "));
+            logger.println(value);
+        }
+    });
+    AdaptivePolling adaptive({2000, 8000, 500, 5, 0.2f}, &querySensor);
+
+    scheduler_task_t queryTasks[2];
+    Scheduler queryScheduler(queryTasks, 2, 20000, 10);
+    queryScheduler.addPeriodic("network", SCHEDULER_PRIORITY_HIGH, 10000, 0, [&logger]() { logger.loop(); });
+    queryScheduler.addPeriodic("particulate", SCHEDULER_PRIORITY_NORMAL, 2000, 0, [&]() {
+        querySds.poll();
+        adaptive.loop();
+    });
+
+    auto queryPass = [&]() {
+        FakeClock::advanceMillis(1);
+        queryScheduler.run();
+    };
+
+    for (int i = 0; i < 10000; i++) {
+        queryPass();
+    }
+    uint32_t samplesBefore = adaptive.samples();
+    before = benchAllocStats();
+    benchSetAllocCounting(true);
+    for (int i = 0; i < 100000; i++) {
+        queryPass();
+    }
+    benchSetAllocCounting(false);
+    after = benchAllocStats();
+    if (after.allocs != before.allocs) {
+        bench->fail("steady_state_query_pass", "loop passes allocated");
+    }
+    if (adaptive.samples() - samplesBefore < 10 || adaptive.failures() != 0) {
+        bench->fail("steady_state_query_pass", "unit not sampled in query mode");
+    }
+
+    bench->run("steady_state_query_pass", queryPass);
+}
+
+// Slots in RAM. A write can be made to tear after a number of bytes, like a reset in the middle of a flash write.
+class MemoryStateSlots : public StateSlots {
+public:
+    std::vector<uint8_t> slots[STATE_STORE_SLOTS];
+    size_t tearAfter = SIZE_MAX;
+
+    size_t read(uint8_t slot, size_t offset, uint8_t *buf, size_t size) override {
+        if (offset >= slots[slot].size()) {
+            return 0;
+        }
+        size_t len = std::min(size, slots[slot].size() - offset);
+        memcpy(buf, slots[slot].data() + offset, len);
+        return len;
+    }
+
+    bool write(uint8_t slot, const state_header_t *header, const uint8_t *payload, size_t len) override {
+        std::vector<uint8_t> &data = slots[slot];
+        data.assign(reinterpret_cast<const uint8_t *>(header), reinterpret_cast<const uint8_t *>(header + 1));
+        data.insert(data.end(), payload, payload + len);
+        if (data.size() > tearAfter) {
+            data.resize(tearAfter);
+            return false;
+        }
+        return true;
+    }
+};
+
+static void benchStateStore(Bench *bench) {
+    const uint8_t check[] = "123456789";
+    if (StateStore::crc32(0, check, 9) != 0xCBF43926) {
+        bench->fail("state_store_save", "CRC32 check value mismatch");
+    }
+
+    MemoryStateSlots slots;
+    uint8_t state[139];
+    for (size_t i = 0; i < sizeof(state); i++) {
+        state[i] = (uint8_t) i;
+    }
+    {
+        StateStore store(&slots, 1);
+        bool ok = store.save(state, sizeof(state)) == STATE_STORE_WRITTEN &&
+                  store.save(state, sizeof(state)) == STATE_STORE_UNCHANGED;
+        state[0] = 0xAA;
+        ok = ok && store.save(state, sizeof(state)) == STATE_STORE_WRITTEN && store.stats().generation == 2;
+        // Torn third write: generation 2 must survive
+        state[0] = 0xBB;
+        slots.tearAfter = sizeof(state_header_t) + 10;
+        ok = ok && store.save(state, sizeof(state)) == STATE_STORE_FAILED;
+        slots.tearAfter = SIZE_MAX;
+        if (!ok) {
+            bench->fail("state_store_save", "unexpected save result");
+        }
+    }
+
+    uint8_t loaded[sizeof(state)];
+    size_t len = 0;
+    StateStore reloaded(&slots, 1);
+    if (!reloaded.load(loaded, sizeof(loaded), &len) || len != sizeof(state) || loaded[0] != 0xAA ||
+        reloaded.stats().generation != 2 || reloaded.stats().invalidSlots != 1) {
+        bench->fail("state_store_save", "torn write not recovered from the other slot");
+    }
+    StateStore otherVersion(&slots, 2);
+    if (otherVersion.load(loaded, sizeof(loaded), &len)) {
+        bench->fail("state_store_save", "state from another version accepted");
+    }
+
+    // One op is one save of a changed state, as done every few hours
+    bench->run("state_store_save", [&]() {
+        state[1]++;
+        benchDoNotOptimize(reloaded.save(state, sizeof(state)));
+    });
+}
+
+static void benchWindowStats(Bench *bench) {
+    // Exact below five values
+    P2Quantile few(0.5);
+    few.add(5);
+    few.add(1);
+    few.add(3);
+    if (few.value() != 3) {
+        bench->fail("window_stats_add", "median of three values");
+    }
+
+    // Uniform values in [0, 100): the estimates should land close to the exact quantiles
+    P2Quantile p50(0.5);
+    P2Quantile p95(0.95);
+    uint32_t rng = 1;
+    for (int i = 0; i < 20000; i++) {
+        rng = rng * 1103515245 + 12345;
+        float value = (float) ((rng >> 8) % 10000) / 100;
+        p50.add(value);
+        p95.add(value);
+    }
+    if (fabsf(p50.value() - 50) > 2 || fabsf(p95.value() - 95) > 2) {
+        bench->fail("window_stats_add", "P2 estimate off by more than 2 %");
+    }
+
+    WindowStats hourly(3600);
+    hourly.add(7199, 1);
+    hourly.add(7199, 3);
+    char buf[WINDOW_STATS_FORMAT_BUF_SIZE];
+    const window_summary_t *summary = hourly.takeClosed(7200);
+    const char *expected = "{\"start\":3600,\"n\":2,\"mean\":2.0,\"min\":1.0,\"max\":3.0,\"p50\":3.0,\"p95\":3.0}";
+    if (summary == nullptr || WindowStats::format(summary, 1, buf, sizeof(buf)) != strlen(expected) ||
+        strcmp(buf, expected) != 0) {
+        bench->fail("window_stats_add", summary != nullptr ? buf : "window not closed");
+    }
+    if (hourly.takeClosed(7300) != nullptr) {
+        bench->fail("window_stats_add", "window taken twice");
+    }
+
+    // Worst case must still fit the documented buffer size
+    const float large = -999999936.0f;
+    window_summary_t full = {UINT32_MAX, UINT32_MAX, large, large, large, large, large};
+    if (WindowStats::format(&full, 6, buf, sizeof(buf)) == 0) {
+        bench->fail("window_stats_add", "WINDOW_STATS_FORMAT_BUF_SIZE too small");
+    }
+
+    // One op is one reading added to one window, which updates both quantile estimates
+    WindowStats daily(24 * 3600);
+    uint32_t now = 1700000000;
+    bench->run("window_stats_add", [&]() {
+        rng = rng * 1103515245 + 12345;
+        daily.add(now++, (float) ((rng >> 8) % 1000) / 10);
+    });
+    benchDoNotOptimize(daily.count());
+}
+
+static float registryTemperature = 21.5;
+
+static const homie_property_desc_t registryTable[] PROGMEM = {
+        {"temperature", "Temperature", "°C", "", homieFloat,
+         []() -> float { return registryTemperature; }, nullptr, 2, 0.1, 0},
+        {"accuracy", "Accuracy", "", "0:3", homieInteger, nullptr, []() -> uint32_t { return 3; }, 0, 0, 0},
+        {"status", "Status", "", "", homieInteger, nullptr, nullptr, 0, 0, 0},
+};
+#define REGISTRY_ROWS (sizeof(registryTable) / sizeof(registryTable[0]))
+
+static void benchHomieRegistry(Bench *bench) {
+    HomieNode node;
+    HomieProperty *props[REGISTRY_ROWS];
+    Deadband deadbands[REGISTRY_ROWS];
+    HomieRegistry registry(registryTable, REGISTRY_ROWS, props, deadbands);
+    registry.build(&node, 5 * 60 * 1000);
+    if (props[0]->strID != "temperature" || props[1]->strFormat != "0:3" || props[2]->datatype != homieInteger) {
+        bench->fail("homie_registry_publish", "properties not built from the table");
+    }
+
+    registry.publish(millis(), false);
+    registryTemperature += 0.05f;
+    registry.publish(millis(), false);
+    if (props[0]->GetValue() != "21.50" || props[0]->GetPublishCount() != 1 || props[1]->GetPublishCount() != 1 ||
+        props[2]->GetPublishCount() != 0) {
+        bench->fail("homie_registry_publish", "deadband not applied per row");
+    }
+    registry.publishInt(2, -12);
+    if (props[2]->GetValue() != "-12") {
+        bench->fail("homie_registry_publish", "publishInt() formatting");
+    }
+    // Past 2^24 a float would round this to 16777216, and past INT32_MAX a cast to int32_t would be undefined
+    registry.publishUint(2, 16777217);
+    bool exact = props[2]->GetValue() == "16777217";
+    registry.publishUint(2, 4000000000u);
+    if (!exact || props[2]->GetValue() != "4000000000") {
+        bench->fail("homie_registry_publish", "publishUint() lost precision");
+    }
+
+    // One op is a publish pass in which nothing leaves its deadband, as for most BSEC samples
+    bench_alloc_stats_t before = benchAllocStats();
+    benchSetAllocCounting(true);
+    registry.publish(millis(), false);
+    benchSetAllocCounting(false);
+    if (benchAllocStats().allocs != before.allocs) {
+        bench->fail("homie_registry_publish", "publish pass allocated");
+    }
+    bench->run("homie_registry_publish", [&]() { registry.publish(millis(), false); });
+}
+
+static void benchAdaptiveInterval(Bench *bench) {
+    adaptive_polling_config_t config = {60 * 1000, 900 * 1000, 30 * 1000, 2, 0.1};
+    AdaptiveInterval interval(config);
+    unsigned long now = 0;
+    interval.add(now, 10, 20);
+    // Stable air: doubles per reading up to the maximum
+    for (int i = 0; i < 6; i++) {
+        now += interval.intervalMs();
+        interval.add(now, 10.5f, 20.5f);
+    }
+    if (interval.intervalMs() != config.maxIntervalMs || !interval.sleeps()) {
+        bench->fail("adaptive_interval_add", "no back off in stable air");
+    }
+    // A jump of 50 µg/m³ over 15 minutes asks for readings as close as the minimum
+    now += interval.intervalMs();
+    interval.add(now, 60, 80);
+    if (interval.intervalMs() != config.minIntervalMs) {
+        bench->fail("adaptive_interval_add", "no fast sampling on a jump");
+    }
+
+    bench->run("adaptive_interval_add", [&]() {
+        now += 1000;
+        interval.add(now, 10.5f, 20.5f);
+    });
+}
+
+static void benchBsecRatePolicy(Bench *bench) {
+    bsec_rate_config_t config = {10, 30 * 60 * 1000, 2, 22, 6, 10 * 60 * 1000};
+    BsecRatePolicy policy(config);
+    unsigned long now = 0;
+    // Calibrating: LP however stable IAQ is
+    for (; now <= 60 * 60 * 1000; now += 3000) {
+        policy.add(now, 50, 1);
+    }
+    if (policy.decide(now, 12) != BSEC_RATE_LP || policy.reason() != BSEC_RATE_REASON_CALIBRATING) {
+        bench->fail("bsec_rate_decide", "ULP while calibrating");
+    }
+    // Calibrated and within the band for stableMs: ULP, and LP once a sample leaves the band
+    unsigned long calibratedMs = now;
+    for (; now - calibratedMs < config.stableMs; now += 3000) {
+        policy.add(now, 50 + (now / 3000) % 5, 3);
+        if (policy.decide(now, 12) != BSEC_RATE_LP) {
+            bench->fail("bsec_rate_decide", "ULP before IAQ was stable for long enough");
+            break;
+        }
+    }
+    policy.add(now, 52, 3);
+    if (policy.decide(now, 12) != BSEC_RATE_ULP) {
+        bench->fail("bsec_rate_decide", "no ULP in stable air");
+    }
+    policy.applied(BSEC_RATE_ULP);
+    now += 300 * 1000;
+    policy.add(now, 80, 3);
+    if (policy.decide(now, 12) != BSEC_RATE_LP || policy.reason() != BSEC_RATE_REASON_CHANGING) {
+        bench->fail("bsec_rate_decide", "no LP on an IAQ change");
+    }
+    // ULP hours wrap around midnight; the override wins over both
+    if (policy.decide(now, 23) != BSEC_RATE_ULP || policy.decide(now, 5) != BSEC_RATE_ULP) {
+        bench->fail("bsec_rate_decide", "ULP hours not applied");
+    }
+    bsec_rate_mode_t mode;
+    if (!BsecRatePolicy::parseMode("lp", &mode) || BsecRatePolicy::parseMode("fast", &mode)) {
+        bench->fail("bsec_rate_decide", "mode names");
+    }
+    policy.setMode(mode);
+    if (policy.decide(now, 23) != BSEC_RATE_LP) {
+        bench->fail("bsec_rate_decide", "override not applied");
+    }
+    // A failed switch is not retried before retryMs
+    policy.setMode(BSEC_RATE_MODE_AUTO);
+    policy.applied(BSEC_RATE_LP);
+    policy.failed(now);
+    if (policy.decide(now + 1000, 23) != BSEC_RATE_LP || policy.decide(now + config.retryMs, 23) != BSEC_RATE_ULP) {
+        bench->fail("bsec_rate_decide", "failed switch retried too early or never");
+    }
+
+    bench->run("bsec_rate_decide", [&]() {
+        now += 3000;
+        policy.add(now, 50, 3);
+        policy.decide(now, 12);
+    });
+}
+
+// Takes messages while `up`, keeping the last one
+class LoopbackPublisher : public Publisher {
+public:
+    bool up = true;
+    uint32_t messages = 0;
+    uint8_t lastQos = 0;
+    air_sample_t last = {};
+
+    bool connected() override { return up; }
+
+    bool publish(const char *topic, const uint8_t *payload, size_t len, uint8_t qos, bool retain) override {
+        (void) topic;
+        (void) payload;
+        (void) len;
+        (void) retain;
+        if (!up) {
+            return false;
+        }
+        messages++;
+        lastQos = qos;
+        return true;
+    }
+};
+
+static void benchSamplePipeline(Bench *bench) {
+    LoopbackPublisher publisher;
+    air_sample_t ring[8];
+    SampleBuffer buffer(ring, 8, nullptr, 0);
+    SamplePipeline pipeline({SAMPLE_FORMAT_CBOR, "air-sensor/sample", 2}, &publisher, &buffer);
+
+    gas_sensor_output_t output = {};
+    output.iaq = 57.3f;
+    output.runInDone = true;
+    sds011_pm_data_t pm = {12.3f, 20.1f, 0xA1B2};
+    pipeline.addGasOutput(&output);
+    pipeline.addPm(&pm);
+    const air_sample_t *sample = pipeline.publish(0, 1000);
+    if (sample->seq != 0 || sample->flags != (SAMPLE_FLAG_BME680 | SAMPLE_FLAG_PM | SAMPLE_FLAG_RUN_IN_DONE) ||
+        publisher.messages != 1 || publisher.lastQos != 0) {
+        bench->fail("sample_pipeline_publish", "live sample not sent as is");
+    }
+
+    // Offline: buffered, then replayed a batch at a time with QoS 1
+    publisher.up = false;
+    for (int i = 0; i < 3; i++) {
+        pipeline.publish(0, 2000 + i);
+    }
+    if (pipeline.replay(1700000000, 3000) != 0 || buffer.size() != 3 || pipeline.stats().buffered != 3) {
+        bench->fail("sample_pipeline_publish", "samples not buffered while offline");
+    }
+    publisher.up = true;
+    if (pipeline.replay(1700000000, 3000) != 2 || pipeline.replay(1700000000, 3000) != 1 || !buffer.empty() ||
+        publisher.lastQos != 1 || pipeline.stats().replayed != 3) {
+        bench->fail("sample_pipeline_publish", "buffered samples not replayed in batches");
+    }
+
+    // Booted offline: samples spilled before SNTP set the clock get their timestamp on replay, unlike one spilled
+    // in an earlier boot, whose uptime means nothing now
+    MemorySampleSpill spill;
+    air_sample_t earlier = {};
+    earlier.uptimeMs = 500;
+    spill.append(&earlier, 1);
+    air_sample_t spillRing[4];
+    SampleBuffer spilling(spillRing, 4, &spill, 64);
+    spilling.begin();
+    for (uint32_t i = 1; i <= 10; i++) {
+        air_sample_t unstamped = {};
+        unstamped.seq = i;
+        unstamped.uptimeMs = i * 3000;
+        spilling.push(&unstamped);
+    }
+    spilling.fixTimestamps(1700000100, 40000);
+    bool stamped = spill.count() > 1;
+    size_t replayed = spilling.replay([&stamped](const air_sample_t *s) {
+        uint32_t expected = s->seq == 0 ? 0 : 1700000100 - (40000 - s->uptimeMs) / 1000;
+        stamped = stamped && s->timestamp == expected;
+        return true;
+    }, 64);
+    if (replayed != 11 || !stamped) {
+        bench->fail("sample_pipeline_publish", "samples spilled before the clock was set not stamped on replay");
+    }
+
+    bench->run("sample_pipeline_publish", [&]() { benchDoNotOptimize(pipeline.publish(1700000000, 4000)); });
+}
+
+int main(int argc, char **argv) {
+    const char *filter = nullptr;
+    uint32_t minTimeMs = 200;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--filter") == 0) {
+            filter = argv[i + 1];
+        } else if (strcmp(argv[i], "--min-time-ms") == 0) {
+            minTimeMs = strtoul(argv[i + 1], nullptr, 10);
+        } else {
+            fprintf(stderr, "Usage: %s [--filter SUBSTRING] [--min-time-ms N]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    // The driver logs every frame; keep that cost in the numbers but off the terminal
+    NullStream sink;
+    HLogger.setSerial(&sink);
+
+    Bench bench(filter, minTimeMs);
+    benchSDS011(&bench);
+    benchLogger(&bench);
+    benchNumberFormat(&bench);
+    benchSampleEncoder(&bench);
+    benchScheduler(&bench);
+    benchLatencyStats(&bench);
+    benchSteadyState(&bench);
+    benchStateStore(&bench);
+    benchWindowStats(&bench);
+    benchHomieRegistry(&bench);
+    benchAdaptiveInterval(&bench);
+    benchBsecRatePolicy(&bench);
+    benchSamplePipeline(&bench);
+    return bench.failures() == 0 ? 0 : 1;
+}
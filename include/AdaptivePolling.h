@@ -0,0 +1,124 @@
+//
+// Query-mode SDS011 sampling at an interval that follows how fast PM changes. Active reporting with a fixed working
+// period runs the fan and laser, which are rated for about 8000 h, at the same duty in stable air as during a cooking
+// spike. Here the unit sleeps between samples and is woken warmupMs before each one. After every reading the next
+// interval is chosen so that, at the rate PM just changed, the next reading would differ by about the configured
+// change: it drops to minIntervalMs at once when PM moves fast, and at most doubles per sample towards maxIntervalMs
+// while it is stable. Intervals under twice the warm-up keep the unit running, as sleeping would save little.
+//
+// Like LowPowerCycle, the unit is driven directly through its bus; ParticulateSensor::loop(), which would configure
+// it for active reporting, must not be called in this mode.
+//
+
+#ifndef AIR_SENSORS_SENDER_ADAPTIVEPOLLING_H
+#define AIR_SENSORS_SENDER_ADAPTIVEPOLLING_H
+
+#include <Arduino.h>
+#include <SDS011.h>
+#include "ParticulateSensor.h"
+
+typedef struct adaptive_polling_config {
+    uint32_t minIntervalMs;
+    uint32_t maxIntervalMs;
+    // How long the fan runs before a reading is taken; the datasheet asks for 30 s
+    uint32_t warmupMs;
+    // The change between readings the interval adapts to, in µg/m³ or as a fraction of the last reading, whichever
+    // is larger. Checked for PM2.5 and PM10 alike.
+    float changeAbs;
+    float changeRel;
+} adaptive_polling_config_t;
+
+// The interval policy on its own, without the unit, so that it can be evaluated on recorded data
+class AdaptiveInterval {
+protected:
+    adaptive_polling_config_t _config;
+    uint32_t _intervalMs;
+    float _pm25 = 0;
+    float _pm10 = 0;
+    unsigned long _lastMs = 0;
+    bool _haveLast = false;
+
+    // Change since the last reading, in multiples of the configured change
+    float change(float last, float value) const;
+
+public:
+    explicit AdaptiveInterval(adaptive_polling_config_t config)
+            : _config{config}, _intervalMs{config.minIntervalMs} {};
+
+    // Takes a reading and returns the interval until the next one
+    uint32_t add(unsigned long nowMs, float pm25, float pm10);
+
+    uint32_t intervalMs() const { return _intervalMs; }
+
+    // Whether the unit should sleep until the next reading
+    bool sleeps() const { return _intervalMs >= 2 * _config.warmupMs; }
+};
+
+typedef enum adaptive_polling_step {
+    // Waiting to wake the unit up
+    ADAPTIVE_POLLING_STEP_WAKE = 0,
+    ADAPTIVE_POLLING_STEP_STARTING,
+    // Running, waiting to take the next reading
+    ADAPTIVE_POLLING_STEP_WARMUP,
+    ADAPTIVE_POLLING_STEP_QUERYING,
+    // Read, to be put to sleep
+    ADAPTIVE_POLLING_STEP_SLEEP,
+    ADAPTIVE_POLLING_STEP_STOPPING,
+} adaptive_polling_step_t;
+
+class AdaptivePolling {
+protected:
+    adaptive_polling_config_t _config;
+    ParticulateSensor *_sensor;
+    AdaptiveInterval _interval;
+
+    adaptive_polling_step_t _step = ADAPTIVE_POLLING_STEP_WAKE;
+    unsigned long _waitStartMs = 0;
+    uint32_t _waitMs = 0;
+
+    // Query mode and continuous working period took; they are kept by the SDS011 across power cycles
+    bool _configured = false;
+    uint8_t _pending = 0;
+    bool _commandsOk = true;
+
+    bool _working = false;
+    unsigned long _workSinceMs = 0;
+    uint64_t _onTimeMs = 0;
+    uint32_t _samples = 0;
+    uint32_t _failures = 0;
+
+    void wait(uint32_t ms);
+
+    void queued(bool success);
+
+    void commandResult(bool success);
+
+    void reading(const sds011_pm_data_t *data);
+
+    void setWorking(bool working);
+
+    // Acts on the results of the commands sent by the previous step
+    void finishStep();
+
+public:
+    AdaptivePolling(adaptive_polling_config_t config, ParticulateSensor *sensor)
+            : _config{config}, _sensor{sensor}, _interval{config} {};
+
+    // Call from loop(), after the bus' poll()
+    void loop();
+
+    uint32_t intervalMs() const { return _interval.intervalMs(); }
+
+    // Time the fan and laser have been running since boot
+    uint64_t onTimeMs() const { return _onTimeMs + (_working ? millis() - _workSinceMs : 0); }
+
+    uint32_t samples() const { return _samples; }
+
+    // Commands that failed, after which the unit is woken and configured again after minIntervalMs
+    uint32_t failures() const { return _failures; }
+
+    adaptive_polling_step_t step() const { return _step; }
+};
+
+
+#endif //AIR_SENSORS_SENDER_ADAPTIVEPOLLING_H
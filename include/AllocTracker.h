@@ -0,0 +1,50 @@
+//
+// Debug option counting heap allocations per loop() pass and by call site. Build with
+//
+//   -D ALLOC_TRACKING -Wl,--wrap=malloc -Wl,--wrap=calloc -Wl,--wrap=realloc
+//
+// so that every allocation (including operator new and String) goes through the wrappers in AllocTracker.cpp. Call
+// sites are return addresses; decode them with xtensa-lx106-elf-addr2line -e firmware.elf. Without ALLOC_TRACKING
+// this module compiles to nothing.
+//
+
+#ifndef AIR_SENSORS_SENDER_ALLOCTRACKER_H
+#define AIR_SENSORS_SENDER_ALLOCTRACKER_H
+
+#ifdef ALLOC_TRACKING
+
+#include <Arduino.h>
+
+// Distinct call sites remembered; once full, further sites are only counted in the totals
+#define ALLOC_TRACKER_SITES 16
+
+typedef struct alloc_site {
+    void *address;
+    uint32_t count;
+    uint32_t bytes;
+} alloc_site_t;
+
+typedef struct alloc_tracker_stats {
+    uint32_t allocs;
+    uint32_t bytes;
+    uint32_t passes;
+    uint32_t passesWithAllocs;
+    uint32_t maxPerPass;
+} alloc_tracker_stats_t;
+
+// Marks the end of a loop() pass
+void allocTrackerEndPass();
+
+const alloc_tracker_stats_t *allocTrackerStats();
+
+// Copies up to `max` call sites, most frequent first, and returns how many were copied
+uint8_t allocTrackerTopSites(alloc_site_t *sites, uint8_t max);
+
+// Prints the totals and the `max` most frequent call sites
+void allocTrackerLog(Print *out, uint8_t max);
+
+void allocTrackerReset();
+
+#endif //ALLOC_TRACKING
+
+#endif //AIR_SENSORS_SENDER_ALLOCTRACKER_H
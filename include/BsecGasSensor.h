@@ -0,0 +1,25 @@
+//
+// GasSensor backed by the BSEC library on the device
+//
+
+#ifndef AIR_SENSORS_SENDER_BSECGASSENSOR_H
+#define AIR_SENSORS_SENDER_BSECGASSENSOR_H
+
+#include <bsec.h>
+#include "GasSensor.h"
+
+class BsecGasSensor : public GasSensor {
+protected:
+    Bsec *_bsec;
+    gas_sensor_output_t _output = {};
+
+public:
+    explicit BsecGasSensor(Bsec *bsec) : _bsec{bsec} {};
+
+    bool run(int64_t timeMs) override;
+
+    const gas_sensor_output_t &output() const override { return _output; }
+};
+
+
+#endif //AIR_SENSORS_SENDER_BSECGASSENSOR_H
@@ -0,0 +1,102 @@
+//
+// Chooses the BSEC sample rate: LP, a BME680 measurement every 3 s, or ULP, one every 5 minutes at a fraction of the
+// CPU time and heater power. LP is only worth it while the air changes; once IAQ has stayed within iaqBand of where
+// it settled for stableMs, ULP is chosen, and LP again as soon as a ULP sample leaves the band. While BSEC is still
+// calibrating (IAQ accuracy under minAccuracy) LP is kept, as calibration needs the samples. ULP hours, e.g. the
+// night, and a remote override take precedence over IAQ.
+//
+// The policy only decides; the caller switches BSEC and reports back with applied() or failed(). After a failed
+// switch the current rate is kept for retryMs.
+//
+
+#ifndef AIR_SENSORS_SENDER_BSECRATEPOLICY_H
+#define AIR_SENSORS_SENDER_BSECRATEPOLICY_H
+
+#include <Arduino.h>
+
+typedef enum bsec_rate {
+    BSEC_RATE_LP = 0,
+    BSEC_RATE_ULP,
+} bsec_rate_t;
+
+typedef enum bsec_rate_mode {
+    BSEC_RATE_MODE_AUTO = 0,
+    BSEC_RATE_MODE_LP,
+    BSEC_RATE_MODE_ULP,
+} bsec_rate_mode_t;
+
+// Why decide() chose its rate
+typedef enum bsec_rate_reason {
+    BSEC_RATE_REASON_CHANGING = 0,
+    BSEC_RATE_REASON_CALIBRATING,
+    BSEC_RATE_REASON_STABLE,
+    BSEC_RATE_REASON_SCHEDULE,
+    BSEC_RATE_REASON_OVERRIDE,
+    BSEC_RATE_REASON_RETRY,
+} bsec_rate_reason_t;
+
+typedef struct bsec_rate_config {
+    float iaqBand;
+    uint32_t stableMs;
+    uint8_t minAccuracy;
+    // ULP from ulpFromHour up to ulpToHour, wrapping around midnight; equal for no ULP hours
+    uint8_t ulpFromHour;
+    uint8_t ulpToHour;
+    uint32_t retryMs;
+} bsec_rate_config_t;
+
+class BsecRatePolicy {
+protected:
+    bsec_rate_config_t _config;
+    bsec_rate_mode_t _mode = BSEC_RATE_MODE_AUTO;
+    bsec_rate_t _rate = BSEC_RATE_LP;
+    bsec_rate_reason_t _reason = BSEC_RATE_REASON_CALIBRATING;
+
+    // IAQ the current stable period started at, and when
+    float _anchorIaq = 0;
+    unsigned long _stableSinceMs = 0;
+    bool _calibrated = false;
+    bool _haveAnchor = false;
+
+    bool _failed = false;
+    unsigned long _failedAtMs = 0;
+    uint32_t _switches = 0;
+
+    bool ulpHour(int hour) const;
+
+public:
+    explicit BsecRatePolicy(bsec_rate_config_t config) : _config{config} {};
+
+    // Takes a BSEC output
+    void add(unsigned long nowMs, float iaq, uint8_t accuracy);
+
+    // Rate BSEC should run at. `hour` is the hour of the day, or -1 while the clock is not set.
+    bsec_rate_t decide(unsigned long nowMs, int hour);
+
+    void applied(bsec_rate_t rate);
+
+    void failed(unsigned long nowMs);
+
+    void setMode(bsec_rate_mode_t mode) { _mode = mode; }
+
+    bsec_rate_mode_t mode() const { return _mode; }
+
+    // Rate BSEC runs at, as last reported through applied()
+    bsec_rate_t rate() const { return _rate; }
+
+    bsec_rate_reason_t reason() const { return _reason; }
+
+    uint32_t switches() const { return _switches; }
+
+    static const char *rateName(bsec_rate_t rate);
+
+    static const char *modeName(bsec_rate_mode_t mode);
+
+    static const char *reasonName(bsec_rate_reason_t reason);
+
+    // Parses "auto", "lp" or "ulp"; false for anything else
+    static bool parseMode(const char *name, bsec_rate_mode_t *mode);
+};
+
+
+#endif //AIR_SENSORS_SENDER_BSECRATEPOLICY_H
@@ -0,0 +1,45 @@
+//
+// Publish-on-change filter for a single measurement. A value passes when it differs from the last value that passed by
+// more than max(absolute, relative * |last|), when nothing has passed for the heartbeat interval, or on first use.
+// With both deadbands set to 0 every change passes, which suits integer and boolean properties.
+//
+
+#ifndef AIR_SENSORS_SENDER_DEADBAND_H
+#define AIR_SENSORS_SENDER_DEADBAND_H
+
+#include <Arduino.h>
+
+typedef struct deadband_config {
+    float absolute;
+    float relative;
+    // Maximum time without publishing, 0 for none
+    uint32_t heartbeatMs;
+} deadband_config_t;
+
+class Deadband {
+protected:
+    deadband_config_t _config;
+    float _last = 0;
+    uint32_t _lastExact = 0;
+    unsigned long _lastPass = 0;
+    bool _primed = false;
+
+public:
+    // Passes every change until configured
+    Deadband() : _config{0, 0, 0} {};
+
+    explicit Deadband(deadband_config_t config) : _config{config} {};
+
+    // Returns true if `value` should be published, and if so remembers it as the last published value
+    bool update(float value, unsigned long now);
+
+    // For integers, which a float only holds exactly up to 2^24: passes every change and the heartbeat, ignoring the
+    // deadbands
+    bool updateExact(uint32_t value, unsigned long now);
+
+    // Forces the next value through, e.g. after reconnecting to the broker
+    void reset() { _primed = false; }
+};
+
+
+#endif //AIR_SENSORS_SENDER_DEADBAND_H
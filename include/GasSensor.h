@@ -0,0 +1,44 @@
+//
+// Source of BME680 measurements as processed by BSEC, so that the sampling pipeline can run against a recorded trace
+// on the host. BsecGasSensor is the implementation on the device; state persistence, configuration and the sample rate
+// are BSEC matters and stay with it.
+//
+
+#ifndef AIR_SENSORS_SENDER_GASSENSOR_H
+#define AIR_SENSORS_SENDER_GASSENSOR_H
+
+#include <Arduino.h>
+
+typedef struct gas_sensor_output {
+    float rawTemperature;
+    float temperature;
+    float pressure;
+    float rawHumidity;
+    float humidity;
+    float gasResistance;
+    float iaq;
+    float staticIaq;
+    float co2Equivalent;
+    float breathVocEquivalent;
+    uint8_t iaqAccuracy;
+    uint8_t staticIaqAccuracy;
+    uint8_t co2Accuracy;
+    uint8_t breathVocAccuracy;
+    bool runInDone;
+    bool stabilizationDone;
+} gas_sensor_output_t;
+
+class GasSensor {
+public:
+    virtual ~GasSensor() = default;
+
+    // Takes a measurement if one is due; returns true if output() has a new one. `timeMs` is the time to take it at,
+    // for a clock that runs through deep sleep, or -1 for the sensor's own clock.
+    virtual bool run(int64_t timeMs) = 0;
+
+    // Latest measurement
+    virtual const gas_sensor_output_t &output() const = 0;
+};
+
+
+#endif //AIR_SENSORS_SENDER_GASSENSOR_H
@@ -9,56 +9,82 @@
 #include <Stream.h>
 #include <HomieNode.h>
 
+// Bytes of log kept in RAM until they are published
+#ifndef HOMIE_LOGGER_BUFFER_SIZE
+#define HOMIE_LOGGER_BUFFER_SIZE 1024
+#endif
+
+// Largest single MQTT publish
+#ifndef HOMIE_LOGGER_MAX_PUBLISH
+#define HOMIE_LOGGER_MAX_PUBLISH 512
+#endif
+
+// Buffered lines are published at most this often...
+#ifndef HOMIE_LOGGER_FLUSH_INTERVAL_MS
+#define HOMIE_LOGGER_FLUSH_INTERVAL_MS 2000
+#endif
+
+// ...unless at least this many bytes are waiting, in which case they go out after HOMIE_LOGGER_MIN_INTERVAL_MS
+#ifndef HOMIE_LOGGER_FLUSH_THRESHOLD
+#define HOMIE_LOGGER_FLUSH_THRESHOLD 384
+#endif
+
+#ifndef HOMIE_LOGGER_MIN_INTERVAL_MS
+#define HOMIE_LOGGER_MIN_INTERVAL_MS 250
+#endif
+
+// Writes go straight to the serial port and into a fixed-size ring buffer. loop() publishes the buffered lines to the
+// Homie property in batches. When the buffer is full new output is dropped and counted instead of growing the heap;
+// the number of dropped bytes is reported in the next publish.
 class HomieLogger : public Stream {
 protected:
     HomieProperty *_homieProp;
     Stream *_serial;
-    String _printBuf = String();
 
-public:
-    HomieLogger(Stream *serial, HomieProperty *homieProperty) : _homieProp{homieProperty}, _serial{serial} {};
+    char _ring[HOMIE_LOGGER_BUFFER_SIZE];
+    size_t _ringHead = 0;
+    size_t _ringLen = 0;
+    char _publishBuf[HOMIE_LOGGER_MAX_PUBLISH + 1];
 
-    size_t write(const uint8_t *buffer, size_t size) override {
-        size_t ret = 0;
-        bool bufInHeap = false;
+    uint32_t _dropped = 0;
+    uint32_t _droppedTotal = 0;
+    unsigned long _lastPublish = 0;
+    uint32_t _flushIntervalMs = HOMIE_LOGGER_FLUSH_INTERVAL_MS;
+    size_t _flushThreshold = HOMIE_LOGGER_FLUSH_THRESHOLD;
 
-        if (_printBuf.length() > 0) {
-            bufInHeap = true;
-            size_t len = _printBuf.length() + 1;
-            uint8_t *buf = static_cast<uint8_t *>(malloc((len + size) * sizeof(char)));
+    char ringAt(size_t index) const { return _ring[(_ringHead + index) % sizeof(_ring)]; }
 
-            _printBuf.toCharArray(reinterpret_cast<char *>(buf), len);
-            memcpy(buf + _printBuf.length(), buffer, size);
-            buf[_printBuf.length() + size] = 0;
+    // Publishes up to the last complete line that fits in one message. With `partial` set, an incomplete trailing
+    // line is published too.
+    void publish(bool partial);
 
-            buffer = buf;
-            size += _printBuf.length();
-            _printBuf = String();
-        }
+public:
+    HomieLogger(Stream *serial, HomieProperty *homieProperty) : _homieProp{homieProperty}, _serial{serial} {};
 
-        if (size > 0) {
-            if (_serial != nullptr) {
-                ret = _serial->write(buffer, size);
-            }
-            if (_homieProp != nullptr) {
-                _homieProp->SetValue(String((char *) buffer));
-                if (ret != 0) {
-                    ret = size;
-                }
-            }
-        }
+    size_t write(const uint8_t *buffer, size_t size) override;
 
-        if (bufInHeap) {
-            free((void *) buffer);
-        }
+    size_t write(uint8_t byte) override { return write(&byte, 1); }
 
-        return ret;
-    }
+    using Print::write; // Import other write() methods to support things like write(0) properly
+
+    // Publishes buffered lines when the flush interval has elapsed or enough output has accumulated
+    void loop();
+
+    // Publishes everything that is buffered right away
+    void flush() override;
 
     void setSerial(Stream *serial) { _serial = serial; };
 
     void setHomieProp(HomieProperty *prop) { _homieProp = prop; }
 
+    void setFlushInterval(uint32_t intervalMs) { _flushIntervalMs = intervalMs; }
+
+    void setFlushThreshold(size_t bytes) { _flushThreshold = bytes; }
+
+    size_t buffered() const { return _ringLen; }
+
+    uint32_t droppedBytes() const { return _droppedTotal; }
+
     int available() override {
         if (_serial != nullptr) {
             return _serial->available();
@@ -79,16 +105,6 @@ public:
         }
         return 0;
     };
-
-    size_t write(uint8_t uint81) override {
-        _printBuf += (char) uint81;
-        if (uint81 == '\n') {
-            write((uint8_t *) nullptr, 0);
-        }
-        return 1;
-    }
-
-    using Print::write; // Import other write() methods to support things like write(0) properly
 };
 
 
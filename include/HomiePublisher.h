@@ -0,0 +1,24 @@
+//
+// Publisher backed by the Homie device's MQTT client
+//
+
+#ifndef AIR_SENSORS_SENDER_HOMIEPUBLISHER_H
+#define AIR_SENSORS_SENDER_HOMIEPUBLISHER_H
+
+#include <LeifHomieLib.h>
+#include "Publisher.h"
+
+class HomiePublisher : public Publisher {
+protected:
+    HomieDevice *_homie;
+
+public:
+    explicit HomiePublisher(HomieDevice *homie) : _homie{homie} {};
+
+    bool connected() override;
+
+    bool publish(const char *topic, const uint8_t *payload, size_t len, uint8_t qos, bool retain) override;
+};
+
+
+#endif //AIR_SENSORS_SENDER_HOMIEPUBLISHER_H
@@ -0,0 +1,88 @@
+//
+// Table-driven Homie properties. A node's properties are described by a table of homie_property_desc_t in flash, from
+// which the node is built, and from which properties with a value accessor are published by iterating, each through
+// its own deadband. Adding a property is one table row.
+//
+// Integer and boolean rows go through uint32_t/int32_t rather than float, which only holds integers exactly up to
+// 2^24: a counter would publish in ever coarser steps.
+//
+// The strings are stored in the rows rather than pointed to, so that a whole table is one PROGMEM object; rows are
+// copied to the stack one at a time when read. Per-row state (the HomieProperty and the deadband) lives in storage
+// provided by the caller, like Scheduler's tasks.
+//
+
+#ifndef AIR_SENSORS_SENDER_HOMIEREGISTRY_H
+#define AIR_SENSORS_SENDER_HOMIEREGISTRY_H
+
+#include <Arduino.h>
+#include <HomieNode.h>
+#include "Deadband.h"
+
+#define HOMIE_DESC_ID_SIZE 32
+#define HOMIE_DESC_NAME_SIZE 48
+#define HOMIE_DESC_UNIT_SIZE 8
+#define HOMIE_DESC_FORMAT_SIZE 12
+
+typedef float (*homie_value_accessor_t)();
+
+typedef uint32_t (*homie_integer_accessor_t)();
+
+typedef struct homie_property_desc {
+    char id[HOMIE_DESC_ID_SIZE];
+    char name[HOMIE_DESC_NAME_SIZE];
+    // Empty for none
+    char unit[HOMIE_DESC_UNIT_SIZE];
+    char format[HOMIE_DESC_FORMAT_SIZE];
+    HomieDataType datatype;
+    // Read by publish(), `value` for homieFloat rows and `integerValue` for homieInteger and homieBool ones; both null
+    // for properties published elsewhere, e.g. when an event happens
+    homie_value_accessor_t value;
+    homie_integer_accessor_t integerValue;
+    // homieFloat only
+    uint8_t decimals;
+    // See Deadband.h. Both 0 publishes every change. Not applied to `integerValue`, which passes every change.
+    float absolute;
+    float relative;
+} homie_property_desc_t;
+
+class HomieRegistry {
+protected:
+    // In flash on the ESP8266
+    const homie_property_desc_t *_table;
+    size_t _count;
+    HomieProperty **_props;
+    // May be null if no row has an accessor
+    Deadband *_deadbands;
+
+    void readRow(size_t index, homie_property_desc_t *row) const;
+
+    void setValue(size_t index, const homie_property_desc_t *row, float value);
+
+    void setInteger(size_t index, const homie_property_desc_t *row, uint32_t value);
+
+public:
+    // `props` (and `deadbands`, if not null) must hold `count` entries
+    HomieRegistry(const homie_property_desc_t *table, size_t count, HomieProperty **props, Deadband *deadbands)
+            : _table{table}, _count{count}, _props{props}, _deadbands{deadbands} {};
+
+    // Adds a retained, non-settable property to `node` for every row. `heartbeatMs` applies to every deadband.
+    void build(HomieNode *node, uint32_t heartbeatMs);
+
+    // Publishes the rows with an accessor whose value passes the deadband, or all of them if `force` is set
+    void publish(unsigned long now, bool force);
+
+    // Publish a value as row `index` would be, bypassing the deadband. For rows without an accessor: publishValue()
+    // for homieFloat rows, publishUint() and publishInt() for homieInteger and homieBool ones.
+    void publishValue(size_t index, float value);
+
+    void publishUint(size_t index, uint32_t value);
+
+    void publishInt(size_t index, int32_t value);
+
+    HomieProperty *property(size_t index) const { return index < _count ? _props[index] : nullptr; }
+
+    size_t count() const { return _count; }
+};
+
+
+#endif //AIR_SENSORS_SENDER_HOMIEREGISTRY_H
@@ -0,0 +1,74 @@
+//
+// Latency statistics for one stage of the main loop: count, min, max, mean and a histogram with power of two buckets.
+// Durations are taken from the CPU cycle counter on the ESP8266 (micros() on host builds), which costs a couple of
+// instructions per measurement. Recording never allocates.
+//
+
+#ifndef AIR_SENSORS_SENDER_LATENCYSTATS_H
+#define AIR_SENSORS_SENDER_LATENCYSTATS_H
+
+#include <Arduino.h>
+
+// Bucket 0 counts durations under 1 µs, bucket i durations in [2^(i-1), 2^i) µs and the last one everything from
+// 2^(LATENCY_BUCKETS-2) µs (65.5 ms) up
+#define LATENCY_BUCKETS 18
+
+// Enough for format() with every counter at its maximum
+#define LATENCY_FORMAT_BUF_SIZE 320
+
+class LatencyStats {
+protected:
+    uint32_t _count = 0;
+    uint32_t _minUs = UINT32_MAX;
+    uint32_t _maxUs = 0;
+    uint64_t _sumUs = 0;
+    uint32_t _buckets[LATENCY_BUCKETS] = {0};
+
+public:
+    // Timestamp to pass to elapsedUs(). The cycle counter wraps every 53 s at 80 MHz, far longer than any stage.
+    static uint32_t start() {
+#ifdef ESP8266
+        return ESP.getCycleCount();
+#else
+        return micros();
+#endif
+    }
+
+    static uint32_t elapsedUs(uint32_t start) {
+#ifdef ESP8266
+        return (ESP.getCycleCount() - start) / clockCyclesPerMicrosecond();
+#else
+        return micros() - start;
+#endif
+    }
+
+    void record(uint32_t us);
+
+    // Records the time since `startTimestamp`, as returned by start(), and returns it
+    uint32_t stop(uint32_t startTimestamp) {
+        uint32_t us = elapsedUs(startTimestamp);
+        record(us);
+        return us;
+    }
+
+    void reset();
+
+    uint32_t count() const { return _count; }
+
+    uint32_t minUs() const { return _count > 0 ? _minUs : 0; }
+
+    uint32_t maxUs() const { return _maxUs; }
+
+    uint32_t meanUs() const { return _count > 0 ? (uint32_t) (_sumUs / _count) : 0; }
+
+    uint32_t bucket(uint8_t index) const { return index < LATENCY_BUCKETS ? _buckets[index] : 0; }
+
+    static uint8_t bucketFor(uint32_t us);
+
+    // Writes {"n":..,"min":..,"mean":..,"max":..,"hist":[..]} (times in µs, trailing empty buckets left out) and
+    // returns its length, or 0 if it does not fit
+    size_t format(char *buf, size_t size) const;
+};
+
+
+#endif //AIR_SENSORS_SENDER_LATENCYSTATS_H
@@ -0,0 +1,119 @@
+//
+// Duty-cycled operation for battery power. The ESP8266 spends most of each measurement cycle in deep sleep and wakes
+// twice: the warm-up wake, with the radio off, only starts the SDS011 fans, which need half a minute of air flow
+// before their readings settle; the measurement wake, warmupMs later, queries the units, puts them back to sleep and
+// stays up until the caller has taken its BME680 sample and published everything (or maxAwakeMs has passed).
+//
+// Nothing but the RTC memory survives deep sleep, so every wake starts from scratch with a LowPowerCycle restored
+// from the low_power_state_t saved before the previous sleep. The state includes a clock that keeps counting through
+// deep sleep, as BSEC needs monotonic timestamps.
+//
+// The units are driven directly through their buses; ParticulateSensor::loop(), which would configure them for
+// active reporting, must not be called in this mode.
+//
+
+#ifndef AIR_SENSORS_SENDER_LOWPOWERCYCLE_H
+#define AIR_SENSORS_SENDER_LOWPOWERCYCLE_H
+
+#include <Arduino.h>
+#include <SDS011.h>
+#include "ParticulateSensor.h"
+
+// ESP.deepSleep(0) means "until reset", so a wake that overran its slot still sleeps for a moment
+#define LOW_POWER_MIN_SLEEP_MS 100
+
+typedef enum low_power_phase {
+    LOW_POWER_PHASE_WARMUP = 0,
+    LOW_POWER_PHASE_MEASURE,
+} low_power_phase_t;
+
+typedef struct low_power_config {
+    // Time between measurements
+    uint32_t cycleMs;
+    // How long the SDS011 fans run before a reading is taken; the datasheet asks for 30 s
+    uint32_t warmupMs;
+    // A wake is cut short after this long, e.g. while the network is unreachable
+    uint32_t maxAwakeMs;
+} low_power_config_t;
+
+// Kept across deep sleep, see RtcState.h. All zero means a cold boot.
+typedef struct low_power_state {
+    // Time on the clock that runs through deep sleep, as of the start of the wake this state is restored on
+    uint64_t clockMs;
+    uint64_t nextMeasureMs;
+    uint32_t cycles;
+    // Wakes cut short by maxAwakeMs
+    uint16_t timeouts;
+    uint8_t phase;
+    // The units have been set to query mode and continuous working period
+    uint8_t configured;
+} low_power_state_t;
+
+typedef enum low_power_step {
+    LOW_POWER_STEP_COMMANDS = 0,
+    LOW_POWER_STEP_WAITING,
+    LOW_POWER_STEP_SLEEPING,
+} low_power_step_t;
+
+// Whether the caller is done with the measurement wake
+typedef std::function<bool()> low_power_ready_callback_t;
+// Puts the device to sleep; does not return on the ESP8266. `radio` is whether the next wake needs WiFi.
+typedef std::function<void(uint32_t sleepMs, bool radio)> low_power_sleep_callback_t;
+
+class LowPowerCycle {
+protected:
+    low_power_config_t _config;
+    ParticulateSensor *const *_sensors;
+    uint8_t _sensorCount;
+
+    low_power_state_t _state = {};
+    low_power_step_t _step = LOW_POWER_STEP_SLEEPING;
+    unsigned long _wakeMs = 0;
+
+    // Units are handled one at a time, so that units sharing a bus never overflow its command queue
+    uint8_t _nextUnit = 0;
+    uint8_t _pending = 0;
+    bool _commandsOk = true;
+
+    low_power_ready_callback_t _readyCallback = nullptr;
+    low_power_sleep_callback_t _sleepCallback = nullptr;
+
+    void sendCommands(ParticulateSensor *sensor);
+
+    void queued(bool success);
+
+    void commandResult(bool success);
+
+    void sleep(bool timedOut);
+
+public:
+    LowPowerCycle(low_power_config_t config, ParticulateSensor *const *sensors, uint8_t sensorCount)
+            : _config{config}, _sensors{sensors}, _sensorCount{sensorCount} {};
+
+    // Starts the wake described by `state`. Call as early as possible after waking up, since the clock only counts
+    // from here.
+    void begin(const low_power_state_t *state);
+
+    // Sends the commands for this wake and sleeps once done. Call from loop(), after the buses' poll().
+    void loop();
+
+    // Milliseconds on the clock that runs through deep sleep
+    uint64_t clockMs() const { return _state.clockMs + (millis() - _wakeMs); }
+
+    // Measurement wake: the units have been read, or failed to answer, and are asleep again
+    bool measured() const { return _state.phase == LOW_POWER_PHASE_MEASURE && _step != LOW_POWER_STEP_COMMANDS; }
+
+    low_power_phase_t phase() const { return (low_power_phase_t) _state.phase; }
+
+    // What to save before a reset: the current wake, or once the sleep callback runs, the next one
+    low_power_state_t state() const;
+
+    unsigned long awakeMs() const { return millis() - _wakeMs; }
+
+    void onReady(low_power_ready_callback_t callback) { _readyCallback = callback; }
+
+    void onSleep(low_power_sleep_callback_t callback) { _sleepCallback = callback; }
+};
+
+
+#endif //AIR_SENSORS_SENDER_LOWPOWERCYCLE_H
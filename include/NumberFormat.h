@@ -0,0 +1,23 @@
+//
+// Allocation-free number formatting for published values. Output matches String(float, decimals) and String(int) from
+// the Arduino core, without going through the heap.
+//
+
+#ifndef AIR_SENSORS_SENDER_NUMBERFORMAT_H
+#define AIR_SENSORS_SENDER_NUMBERFORMAT_H
+
+#include <Arduino.h>
+
+// Large enough for any int32_t or uint32_t and for floats up to 1e9 with 6 decimals
+#define NUMBER_FORMAT_BUF_SIZE 20
+
+// Formats `value` rounded to `decimals` places (at most 6). Returns the length written, excluding the terminating NUL,
+// or 0 if the value does not fit into `size` bytes, in which case `buf` holds an empty string.
+size_t formatFixed(char *buf, size_t size, float value, uint8_t decimals);
+
+size_t formatInt(char *buf, size_t size, int32_t value);
+
+size_t formatUint(char *buf, size_t size, uint32_t value);
+
+
+#endif //AIR_SENSORS_SENDER_NUMBERFORMAT_H
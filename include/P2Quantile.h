@@ -0,0 +1,48 @@
+//
+// Streaming quantile estimate with the P² algorithm (Jain and Chlamtac, 1985): five markers track the minimum, the
+// maximum, the wanted quantile and the two halfway points, and are nudged along with each value using a piecewise
+// parabolic fit. Memory and time per value are constant, whatever the number of values; the estimate is typically
+// within a few percent of the exact quantile for the smooth distributions PM readings have.
+//
+
+#ifndef AIR_SENSORS_SENDER_P2QUANTILE_H
+#define AIR_SENSORS_SENDER_P2QUANTILE_H
+
+#include <Arduino.h>
+
+#define P2_QUANTILE_MARKERS 5
+
+class P2Quantile {
+protected:
+    float _p;
+    uint32_t _count = 0;
+    // Marker heights; until there are five values, the values themselves, unsorted
+    float _heights[P2_QUANTILE_MARKERS] = {0};
+    // Actual and desired marker positions, 0-based
+    int32_t _positions[P2_QUANTILE_MARKERS] = {0};
+    float _desired[P2_QUANTILE_MARKERS] = {0};
+
+    float increment(uint8_t marker) const;
+
+    float parabolic(uint8_t i, int8_t d) const;
+
+    float linear(uint8_t i, int8_t d) const;
+
+public:
+    // `p` in [0, 1], e.g. 0.95 for the 95th percentile
+    explicit P2Quantile(float p) : _p{p} {};
+
+    void add(float value);
+
+    // Estimate of the quantile, exact for up to five values. NAN without any value.
+    float value() const;
+
+    uint32_t count() const { return _count; }
+
+    float p() const { return _p; }
+
+    void reset();
+};
+
+
+#endif //AIR_SENSORS_SENDER_P2QUANTILE_H
@@ -0,0 +1,129 @@
+//
+// One SDS011 unit, addressed by device ID on a (possibly shared) serial bus. Keeps the unit configured without
+// blocking: configuration commands go through the bus' SDS011 command queue and are retried after
+// PARTICULATE_RETRY_INTERVAL_MS if any of them fails, so a missing or faulty unit does not affect the others.
+//
+// Several units may share one SDS011 instance when their TX lines are wired together; each must then have its own
+// device ID, since SDS011_ANY would address (and claim the frames of) all of them.
+//
+
+#ifndef AIR_SENSORS_SENDER_PARTICULATESENSOR_H
+#define AIR_SENSORS_SENDER_PARTICULATESENSOR_H
+
+#include <Arduino.h>
+#include <SDS011.h>
+#include "PmSensor.h"
+
+#ifndef PARTICULATE_RETRY_INTERVAL_MS
+#define PARTICULATE_RETRY_INTERVAL_MS (30 * 1000)
+#endif
+
+// Static description of a unit, see SDS_SENSORS in config.sample.h
+typedef struct particulate_sensor_config {
+    uint8_t rxPin;
+    uint8_t txPin;
+    uint16_t deviceId;
+    const char *nodeId;
+    const char *name;
+    // Minutes between measurements, 0 for continuous
+    uint8_t workingPeriod;
+} particulate_sensor_config_t;
+
+typedef enum particulate_state {
+    PARTICULATE_STATE_IDLE = 0,
+    PARTICULATE_STATE_CONFIGURING,
+    PARTICULATE_STATE_READY,
+    PARTICULATE_STATE_FAILED,
+} particulate_state_t;
+
+typedef struct particulate_health {
+    uint32_t frames;
+    // Readings of 0.0 for both PM2.5 and PM10, which the SDS011 reports while its fan spins up
+    uint32_t zeroFrames;
+    uint32_t commandFailures;
+    uint32_t configAttempts;
+    unsigned long lastFrameMs;
+} particulate_health_t;
+
+typedef std::function<void(const sds011_dev_info_t *devInfo)> particulate_ready_callback_t;
+typedef std::function<void()> particulate_failed_callback_t;
+
+class ParticulateSensor : public PmSensor {
+protected:
+    SDS011 *_sds;
+    uint16_t _deviceId;
+    uint8_t _workingPeriod;
+
+    particulate_state_t _state = PARTICULATE_STATE_IDLE;
+    particulate_health_t _health = {};
+    sds011_dev_info_t _info = {};
+    sds011_pm_data_t _lastReading = {};
+    bool _haveReading = false;
+
+    // Set by assumeConfigured() until the first frame confirms it
+    bool _assumed = false;
+    unsigned long _assumedSinceMs = 0;
+
+    // Configuration in progress. Callbacks from a previous attempt are told apart by the attempt number.
+    uint8_t _configPending = 0;
+    bool _configOk = false;
+    unsigned long _configStartedMs = 0;
+
+    sds011_pm_data_callback_t _pmDataCallback = nullptr;
+    particulate_ready_callback_t _readyCallback = nullptr;
+    particulate_failed_callback_t _failedCallback = nullptr;
+
+    void configure();
+
+    void configResult(uint32_t attempt, bool success);
+
+    // Working period, or a minute if continuous
+    uint32_t periodMs() const;
+
+public:
+    ParticulateSensor(SDS011 *sds, uint16_t deviceId, uint8_t workingPeriod)
+            : _sds{sds}, _deviceId{deviceId}, _workingPeriod{workingPeriod} {};
+
+    // Whether an unclaimed data frame from the bus belongs to this unit
+    bool accepts(const sds011_pm_data_t *data) const {
+        return _deviceId == SDS011_ANY || data->deviceId == _deviceId;
+    }
+
+    // Feeds a data frame from the bus; readings go to the PM data callback unless they are 0/0
+    void handlePmData(const sds011_pm_data_t *data);
+
+    // Starts or retries configuration when due. Call from loop(), after the bus' poll().
+    void loop() override;
+
+    // Asks for a reading right away, e.g. on start to avoid waiting a full working period
+    bool query();
+
+    // Skips configuration after a warm restart, when the unit is known to be configured already. If it does not report
+    // within two working periods it is configured anyway.
+    void assumeConfigured();
+
+    // Last reading passed to the PM data callback, null if there was none yet
+    const sds011_pm_data_t *lastReading() const override { return _haveReading ? &_lastReading : nullptr; }
+
+    void onPmData(sds011_pm_data_callback_t callback) override { _pmDataCallback = callback; }
+
+    void onReady(particulate_ready_callback_t callback) { _readyCallback = callback; }
+
+    void onFailed(particulate_failed_callback_t callback) { _failedCallback = callback; }
+
+    particulate_state_t state() const { return _state; }
+
+    const particulate_health_t &health() const { return _health; }
+
+    // A unit is online once it has reported within the last two working periods (or minute, if continuous)
+    bool online(unsigned long now) const override;
+
+    uint8_t workingPeriod() const { return _workingPeriod; }
+
+    uint16_t deviceId() const { return _deviceId; }
+
+    SDS011 *bus() const { return _sds; }
+};
+
+
+#endif //AIR_SENSORS_SENDER_PARTICULATESENSOR_H
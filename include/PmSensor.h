@@ -0,0 +1,29 @@
+//
+// Source of PM2.5/PM10 readings, so that the sampling pipeline can run against a recorded trace on the host.
+// ParticulateSensor, one SDS011 unit on a serial bus, is the implementation on the device.
+//
+
+#ifndef AIR_SENSORS_SENDER_PMSENSOR_H
+#define AIR_SENSORS_SENDER_PMSENSOR_H
+
+#include <Arduino.h>
+#include <SDS011.h>
+
+class PmSensor {
+public:
+    virtual ~PmSensor() = default;
+
+    // Call from loop()
+    virtual void loop() = 0;
+
+    // Called with every reading
+    virtual void onPmData(sds011_pm_data_callback_t callback) = 0;
+
+    // Last reading, null if there was none yet
+    virtual const sds011_pm_data_t *lastReading() const = 0;
+
+    virtual bool online(unsigned long now) const = 0;
+};
+
+
+#endif //AIR_SENSORS_SENDER_PMSENSOR_H
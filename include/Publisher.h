@@ -0,0 +1,22 @@
+//
+// MQTT connection the combined samples go out on, so that the sampling pipeline can run without a broker on the host.
+// HomiePublisher, the Homie device's client, is the implementation on the device.
+//
+
+#ifndef AIR_SENSORS_SENDER_PUBLISHER_H
+#define AIR_SENSORS_SENDER_PUBLISHER_H
+
+#include <Arduino.h>
+
+class Publisher {
+public:
+    virtual ~Publisher() = default;
+
+    virtual bool connected() = 0;
+
+    // Hands the message to the client. Returns false if it could not take it, e.g. while disconnected.
+    virtual bool publish(const char *topic, const uint8_t *payload, size_t len, uint8_t qos, bool retain) = 0;
+};
+
+
+#endif //AIR_SENSORS_SENDER_PUBLISHER_H
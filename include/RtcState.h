@@ -0,0 +1,57 @@
+//
+// Runtime state kept in the ESP8266 RTC user memory, which survives resets (OTA, crashes, panics, the reset button)
+// but not power loss. A CRC tells a warm restart, where the state can be trusted, from a cold boot.
+//
+// The first 128 bytes of the RTC user memory are used by the OTA bootloader, so the state is stored after them.
+//
+
+#ifndef AIR_SENSORS_SENDER_RTCSTATE_H
+#define AIR_SENSORS_SENDER_RTCSTATE_H
+
+#include <Arduino.h>
+#include "LowPowerCycle.h"
+
+#define RTC_STATE_MAGIC 0x52544332 // "RTC2", bump when the layout changes
+// In 4-byte blocks, past the area used by OTA
+#define RTC_STATE_OFFSET 32
+#define RTC_STATE_MAX_UNITS 4
+// At least BSEC_MAX_STATE_BLOB_SIZE, which main.cpp checks; bsec.h is not included here
+#define RTC_STATE_BSEC_SIZE 140
+
+typedef struct rtc_unit_state {
+    uint16_t deviceId;
+    uint8_t workingPeriod;
+    // Working period, reporting mode and sleep mode have been applied
+    uint8_t configured;
+    // Last reading, 0/0 if none
+    float pm25;
+    float pm10;
+} rtc_unit_state_t;
+
+typedef struct rtc_state {
+    uint32_t magic;
+    // Warm restarts since the last cold boot
+    uint32_t warmBoots;
+    uint32_t sampleSeq;
+    uint32_t bsecGeneration;
+    rtc_unit_state_t units[RTC_STATE_MAX_UNITS];
+    // Low power mode only, see LowPowerCycle.h. The BSEC state is kept here between wakes, saving a flash write
+    // every cycle.
+    low_power_state_t lowPower;
+    uint32_t bsecStateValid;
+    uint8_t bsecState[RTC_STATE_BSEC_SIZE];
+    // CRC32 of everything above
+    uint32_t crc;
+} rtc_state_t;
+
+static_assert(sizeof(rtc_state_t) % 4 == 0, "RTC memory is accessed in 4-byte blocks");
+static_assert(RTC_STATE_OFFSET * 4 + sizeof(rtc_state_t) <= 512, "RTC user memory is 512 bytes");
+
+// Returns false, leaving `state` undefined, if the RTC memory does not hold a valid state (e.g. after power loss)
+bool rtcStateLoad(rtc_state_t *state);
+
+// Sets the magic and CRC and writes the state
+bool rtcStateSave(rtc_state_t *state);
+
+
+#endif //AIR_SENSORS_SENDER_RTCSTATE_H
@@ -11,11 +11,29 @@
 #define AIR_SENSORS_SENDER_SDS011_H
 
 #include <HardwareSerial.h>
+#include <functional>
 
 #define SDS011_ANY 0xFFFF
 
 #define SDS011_ERR -1
 
+#define SDS011_HEAD 0xAA
+#define SDS011_TAIL 0xAB
+#define SDS011_CMD_ID 0xB4
+#define SDS011_RESP_ID_DATA 0xC0
+#define SDS011_RESP_ID_REPLY 0xC5
+
+// Log levels. SDS011_LOG_LEVEL is the highest level compiled in; the level actually logged is picked at runtime with
+// setLogLevel(). Frame tracing (every byte sent and received) is compiled out unless built with
+// -D SDS011_LOG_LEVEL=SDS011_LOG_TRACE.
+#define SDS011_LOG_OFF 0
+#define SDS011_LOG_ERROR 1
+#define SDS011_LOG_TRACE 2
+
+#ifndef SDS011_LOG_LEVEL
+#define SDS011_LOG_LEVEL SDS011_LOG_ERROR
+#endif
+
 // Enums
 
 typedef enum sds011_operation {
@@ -42,6 +60,14 @@ typedef enum sds011_command {
     SDS011_CMD_VERSION = 7,
 } sds011_command_t;
 
+typedef enum sds011_parser_state {
+    SDS011_PARSER_HEAD = 0,
+    SDS011_PARSER_COMMAND,
+    SDS011_PARSER_PAYLOAD,
+    SDS011_PARSER_CHECKSUM,
+    SDS011_PARSER_TAIL,
+} sds011_parser_state_t;
+
 
 // Command payloads
 
@@ -161,10 +187,88 @@ typedef struct sds011_pm_data {
     uint16_t deviceId;
 } sds011_pm_data_t;
 
+typedef std::function<void(const sds011_response_u *response)> sds011_frame_callback_t;
+typedef std::function<void(const sds011_pm_data_t *data)> sds011_pm_data_callback_t;
+
+// Asynchronous command completion callbacks. `devInfo`/`data` are only valid when `success` is true.
+typedef std::function<void(bool success)> sds011_result_callback_t;
+typedef std::function<void(bool success, const sds011_dev_info_t *devInfo)> sds011_info_callback_t;
+typedef std::function<void(bool success, const sds011_pm_data_t *data)> sds011_query_callback_t;
+
+#ifndef SDS011_QUEUE_SIZE
+#define SDS011_QUEUE_SIZE 8
+#endif
+
+// Times a command is sent again after getting no response, before it fails
+#ifndef SDS011_COMMAND_RETRIES
+#define SDS011_COMMAND_RETRIES 1
+#endif
+
+// How a queued command reports its completion, i.e. which of its callbacks is set
+typedef enum sds011_completion {
+    SDS011_COMPLETION_RESULT = 0,
+    SDS011_COMPLETION_INFO,
+    SDS011_COMPLETION_QUERY,
+    // A caller of the blocking API, waiting in execute()
+    SDS011_COMPLETION_WAIT,
+} sds011_completion_t;
+
+typedef struct sds011_wait {
+    bool done;
+    bool success;
+    sds011_response_u *response;
+} sds011_wait_t;
+
+// The caller's callback is stored as given and the response decoded for it when the command completes. Wrapping it in
+// a decoding lambda instead would not fit in std::function's inline storage and cost a heap allocation per command.
+typedef struct sds011_pending_command {
+    sds011_command_u cmd;
+    uint32_t timeout;
+    uint8_t retriesLeft;
+    sds011_completion_t completion;
+    sds011_result_callback_t onResult;
+    sds011_info_callback_t onInfo;
+    sds011_query_callback_t onQuery;
+    sds011_wait_t *wait;
+} sds011_pending_command_t;
+
+// Counters of everything received and sent on the bus since boot, to tell bad cabling (checksum failures, resync
+// bytes) from units that stopped responding (timeouts)
+typedef struct sds011_link_stats {
+    // Complete frames with a valid checksum
+    uint32_t frames;
+    uint32_t checksumFailures;
+    // Bytes skipped while looking for the start of a frame: noise, and frames cut short or failing the checksum
+    uint32_t resyncBytes;
+    // Commands that got no response in time, including those retried afterwards
+    uint32_t timeouts;
+    uint32_t retries;
+} sds011_link_stats_t;
+
 class SDS011 {
 protected:
     Stream *_serial;
     uint32_t _timeout = 1000;
+    uint8_t _retries = SDS011_COMMAND_RETRIES;
+    uint8_t _logLevel = SDS011_LOG_ERROR;
+    sds011_link_stats_t _linkStats = {};
+
+    // Incremental response parser, fed one byte at a time
+    sds011_parser_state_t _rxState = SDS011_PARSER_HEAD;
+    uint8_t _rxPos = 0;
+    sds011_response_u _rxFrame = {{0}};
+    // Bytes read since the end of the last frame. Once the next one completes, all but its own were skipped.
+    uint32_t _rxSinceFrame = 0;
+    sds011_frame_callback_t _frameCallback = nullptr;
+    sds011_pm_data_callback_t _pmDataCallback = nullptr;
+
+    // Command queue. Only the command at the head is on the wire at any time, since responses carry no sequence
+    // number and can only be matched by command and device ID.
+    sds011_pending_command_t _queue[SDS011_QUEUE_SIZE];
+    uint8_t _queueHead = 0;
+    uint8_t _queueLen = 0;
+    bool _inFlight = false;
+    unsigned long _inFlightSince = 0;
 
     static void fillBoilerplate(sds011_command_u *cmd);
 
@@ -174,17 +278,50 @@ protected:
 
     bool readPmData(sds011_pm_data_t *data, uint32_t timeout);
 
-    bool seekRespStart();
+    static void decodePmData(const sds011_response_u *response, sds011_pm_data_t *data);
+
+    bool parseByte(uint8_t byte);
+
+    void resyncParser(uint8_t byte);
+
+    bool pollFrame(sds011_response_u *response);
+
+    void logError(const __FlashStringHelper *msg) const;
+
+    // Formats the frame into a stack buffer, no heap allocations
+    void traceFrame(const char *prefix, const uint8_t *bytes, size_t len) const;
 
     static bool checkChecksumResp(sds011_response_u *response);
 
     static uint8_t genChecksum(uint8_t *data, size_t len);
 
+    static bool matchesCommand(const sds011_command_u *cmd, const sds011_response_u *response);
+
+    void dispatchFrame(const sds011_response_u *response);
+
+    void completeHead(bool success, const sds011_response_u *response);
+
+    void serviceQueue();
+
+    // Reserves a queue slot for the command, or returns nullptr if the queue is full. The caller sets the callback
+    // matching `completion`, then sends it with serviceQueue().
+    sds011_pending_command_t *enqueue(sds011_command_u *cmd, sds011_completion_t completion);
+
+    bool execute(sds011_command_u *cmd, sds011_response_u *response);
+
+    static void buildSetting(sds011_command_u *cmd, uint16_t sensorID, sds011_operation_t operation,
+                             sds011_command_t setting, uint8_t value);
+
     bool getSetSetting(uint16_t sensorID, sds011_operation_t operation, sds011_command_t setting, uint8_t value, sds011_response_u *response);
 
+    bool getSetSettingAsync(uint16_t sensorID, sds011_operation_t operation, sds011_command_t setting, uint8_t value,
+                            sds011_result_callback_t callback);
+
 public:
     explicit SDS011(Stream *serial) : _serial{serial} {};
 
+    // Blocking API. Each call waits for its own response (and for any queued command ahead of it).
+
     bool setDataReporting(sds011_reporting_mode_t mode, uint16_t sensorID);
 
     bool setDataReporting(sds011_reporting_mode_t mode) { return setDataReporting(mode, SDS011_ANY); }
@@ -217,9 +354,60 @@ public:
 
     bool query(sds011_pm_data_t *data) { return query(SDS011_ANY, data); };
 
+    // Reads a data frame if one is already buffered. Do not mix with poll(), which consumes frames as well.
     bool read(sds011_pm_data_t *data);
 
+    // Asynchronous API. Commands are queued and sent one at a time from poll(); callbacks run from poll() once the
+    // matching response arrives or the command times out. Returns false if the queue is full.
+
+    bool setDataReportingAsync(sds011_reporting_mode_t mode, uint16_t sensorID, sds011_result_callback_t callback);
+
+    bool setDataReportingAsync(sds011_reporting_mode_t mode, sds011_result_callback_t callback) {
+        return setDataReportingAsync(mode, SDS011_ANY, callback);
+    }
+
+    bool setSleepModeAsync(sds011_sleep_mode_t mode, uint16_t sensorID, sds011_result_callback_t callback);
+
+    bool setSleepModeAsync(sds011_sleep_mode_t mode, sds011_result_callback_t callback) {
+        return setSleepModeAsync(mode, SDS011_ANY, callback);
+    }
+
+    bool setWorkingPeriodAsync(uint8_t workPeriod, uint16_t sensorID, sds011_result_callback_t callback);
+
+    bool setWorkingPeriodAsync(uint8_t workPeriod, sds011_result_callback_t callback) {
+        return setWorkingPeriodAsync(workPeriod, SDS011_ANY, callback);
+    }
+
+    bool getInfoAsync(uint16_t sensorID, sds011_info_callback_t callback);
+
+    bool getInfoAsync(sds011_info_callback_t callback) { return getInfoAsync(SDS011_ANY, callback); }
+
+    bool queryAsync(uint16_t sensorID, sds011_query_callback_t callback);
+
+    bool queryAsync(sds011_query_callback_t callback) { return queryAsync(SDS011_ANY, callback); }
+
+    // Consumes whatever is buffered on the serial port without waiting, completes or times out the in-flight
+    // command and sends the next queued one. Frames not claimed by a command go to the frame callback and, for
+    // data frames, to the PM data callback. Returns the number of frames parsed.
+    uint8_t poll();
+
+    bool busy() const { return _queueLen > 0; }
+
+    void onFrame(sds011_frame_callback_t callback) { _frameCallback = callback; }
+
+    // Called for data frames that do not answer a queued query, i.e. active mode reports
+    void onPmData(sds011_pm_data_callback_t callback) { _pmDataCallback = callback; }
+
     void setTimeout(uint32_t timeout) { _timeout = timeout; }
+
+    // Resends after a timeout. A late response to the first send then completes the command, and the response to the
+    // resend is handled like any unclaimed frame.
+    void setRetries(uint8_t retries) { _retries = retries; }
+
+    const sds011_link_stats_t &linkStats() const { return _linkStats; }
+
+    // One of SDS011_LOG_*. Levels above SDS011_LOG_LEVEL are not compiled in and have no effect.
+    void setLogLevel(uint8_t level) { _logLevel = level; }
 };
 
 
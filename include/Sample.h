@@ -0,0 +1,45 @@
+//
+// One combined measurement: the BME680/BSEC outputs of a BSEC sample together with the latest SDS011 reading.
+// Packed, so that the same layout can be stored and replayed as a binary record.
+//
+
+#ifndef AIR_SENSORS_SENDER_SAMPLE_H
+#define AIR_SENSORS_SENDER_SAMPLE_H
+
+#include <stdint.h>
+
+#define SAMPLE_FLAG_BME680 (1 << 0)
+#define SAMPLE_FLAG_PM (1 << 1)
+#define SAMPLE_FLAG_RUN_IN_DONE (1 << 2)
+#define SAMPLE_FLAG_STABILIZATION_DONE (1 << 3)
+// Replayed from the offline buffer rather than published live
+#define SAMPLE_FLAG_REPLAYED (1 << 4)
+
+typedef struct __attribute__((packed)) air_sample {
+    uint32_t seq;
+    // Unix time in seconds, 0 if the clock was not synchronised yet
+    uint32_t timestamp;
+    uint32_t uptimeMs;
+    uint8_t flags;
+
+    float rawTemperature;
+    float temperature;
+    float pressure;
+    float rawHumidity;
+    float humidity;
+    float gasResistance;
+    float iaq;
+    float staticIaq;
+    float co2Equivalent;
+    float breathVocEquivalent;
+    uint8_t iaqAccuracy;
+    uint8_t staticIaqAccuracy;
+    uint8_t co2Accuracy;
+    uint8_t breathVocAccuracy;
+
+    float pm25;
+    float pm10;
+} air_sample_t;
+
+
+#endif //AIR_SENSORS_SENDER_SAMPLE_H
@@ -0,0 +1,97 @@
+//
+// Store-and-forward buffer for samples that could not be published. Samples are kept in a RAM ring; when it fills up
+// the oldest half is spilled to flash in one write, if a spill is configured. Replay hands out the oldest samples
+// first: spilled ones, then those still in RAM.
+//
+// Delivery is at-least-once: spilled samples are only removed once all of them have been replayed, so a reboot in the
+// middle of a replay sends some of them again. Consumers can deduplicate on timestamp and sequence number.
+//
+
+#ifndef AIR_SENSORS_SENDER_SAMPLEBUFFER_H
+#define AIR_SENSORS_SENDER_SAMPLEBUFFER_H
+
+#include <Arduino.h>
+#include <functional>
+#include "Sample.h"
+
+// Persistent overflow storage for SampleBuffer
+class SampleSpill {
+public:
+    virtual ~SampleSpill() = default;
+
+    virtual size_t count() = 0;
+
+    virtual bool append(const air_sample_t *samples, size_t n) = 0;
+
+    // Returns the number of samples read
+    virtual size_t read(size_t index, air_sample_t *samples, size_t n) = 0;
+
+    virtual void clear() = 0;
+};
+
+// Returns false if the sample could not be sent; it stays buffered and replay stops
+typedef std::function<bool(const air_sample_t *sample)> sample_replay_callback_t;
+
+class SampleBuffer {
+protected:
+    air_sample_t *_ring;
+    size_t _capacity;
+    size_t _head = 0;
+    size_t _len = 0;
+
+    SampleSpill *_spill;
+    size_t _spillMax;
+    size_t _spillCount = 0;
+    size_t _spillRead = 0;
+    // Spilled samples from this index on were spilled since boot; those before it were found by begin()
+    size_t _spillBootStart = 0;
+
+    // Clock reference from the last fixTimestamps(), 0 if none yet
+    uint32_t _clockUnix = 0;
+    uint32_t _clockUptimeMs = 0;
+
+    uint32_t _dropped = 0;
+
+    air_sample_t *at(size_t index) { return &_ring[(_head + index) % _capacity]; }
+
+    void popFront(size_t n);
+
+    // Moves the oldest `n` samples to the spill. Returns false, having dropped them, if the write failed.
+    bool spillFront(size_t n);
+
+    void spillOldest();
+
+    void fixTimestamp(air_sample_t *sample) const;
+
+public:
+    // `storage` must hold `capacity` samples. `spill` may be null, in which case the oldest samples are dropped once
+    // the ring is full.
+    SampleBuffer(air_sample_t *storage, size_t capacity, SampleSpill *spill, size_t spillMax);
+
+    // Picks up samples spilled before a reboot, so they are replayed like any other. Call once the spill storage is
+    // available.
+    void begin();
+
+    void push(const air_sample_t *sample);
+
+    // Moves every sample still in RAM to the spill, e.g. before a deep sleep would lose them. Returns false if they
+    // did not fit or the write failed; they are then kept in RAM, or dropped, respectively.
+    bool persist();
+
+    // Sends up to `max` of the oldest samples through `publish`. Returns the number sent.
+    size_t replay(const sample_replay_callback_t &publish, size_t max);
+
+    // Fills in the timestamp of samples taken before the clock was synchronised: right away for those in RAM, and
+    // as they are replayed for spilled ones. Only samples from the current boot are touched, since the uptime of
+    // earlier ones does not relate to the clock.
+    void fixTimestamps(uint32_t nowUnix, uint32_t nowUptimeMs);
+
+    bool empty() const { return _len == 0 && _spillRead >= _spillCount; }
+
+    size_t size() const { return _len + (_spillCount - _spillRead); }
+
+    uint32_t dropped() const { return _dropped; }
+};
+
+
+#endif //AIR_SENSORS_SENDER_SAMPLEBUFFER_H
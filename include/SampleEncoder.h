@@ -0,0 +1,27 @@
+//
+// Serialises a whole sample into one payload: JSON for debugging, CBOR (RFC 8949) for production. Both use the same
+// short keys; fields of sensors missing from the sample (see SAMPLE_FLAG_*) are omitted.
+//
+
+#ifndef AIR_SENSORS_SENDER_SAMPLEENCODER_H
+#define AIR_SENSORS_SENDER_SAMPLEENCODER_H
+
+#include <Arduino.h>
+#include "Sample.h"
+
+#define SAMPLE_FORMAT_NONE 0
+#define SAMPLE_FORMAT_JSON 1
+#define SAMPLE_FORMAT_CBOR 2
+
+// Fits a complete sample in either format
+#define SAMPLE_ENCODER_BUF_SIZE 448
+
+// Both return the payload length, or 0 if it does not fit into `size` bytes. The JSON output is NUL-terminated.
+size_t encodeSampleJson(const air_sample_t *sample, char *buf, size_t size);
+
+size_t encodeSampleCbor(const air_sample_t *sample, uint8_t *buf, size_t size);
+
+size_t encodeSample(uint8_t format, const air_sample_t *sample, uint8_t *buf, size_t size);
+
+
+#endif //AIR_SENSORS_SENDER_SAMPLEENCODER_H
@@ -0,0 +1,78 @@
+//
+// The combined sample on its way out: the latest gas sensor output and PM reading are merged into one air_sample_t,
+// which is published as a single message in the configured format, or kept in a SampleBuffer while the publisher
+// cannot take it and replayed later. It only reaches the outside through Publisher, so the whole path runs unchanged
+// on the host against fakes, see the host simulation's --pipeline mode.
+//
+
+#ifndef AIR_SENSORS_SENDER_SAMPLEPIPELINE_H
+#define AIR_SENSORS_SENDER_SAMPLEPIPELINE_H
+
+#include <Arduino.h>
+#include <SDS011.h>
+#include "GasSensor.h"
+#include "Publisher.h"
+#include "Sample.h"
+#include "SampleBuffer.h"
+
+typedef struct sample_pipeline_config {
+    // SAMPLE_FORMAT_*. With SAMPLE_FORMAT_NONE samples are only put together and stamped, not sent.
+    uint8_t format;
+    const char *topic;
+    // Buffered samples sent per replay()
+    size_t replayBatch;
+} sample_pipeline_config_t;
+
+typedef struct sample_pipeline_stats {
+    uint32_t samples;
+    // Sent right away
+    uint32_t published;
+    uint32_t buffered;
+    uint32_t replayed;
+    uint32_t encodeFailures;
+    uint64_t bytes;
+} sample_pipeline_stats_t;
+
+class SamplePipeline {
+protected:
+    sample_pipeline_config_t _config;
+    Publisher *_publisher;
+    SampleBuffer *_buffer;
+
+    air_sample_t _sample = {};
+    uint32_t _seq = 0;
+    sample_pipeline_stats_t _stats = {};
+
+    // Returns false if the publisher could not take the sample
+    bool send(const air_sample_t *sample, bool replayed);
+
+public:
+    // `buffer` may be null, in which case samples that cannot be sent are lost
+    SamplePipeline(sample_pipeline_config_t config, Publisher *publisher, SampleBuffer *buffer)
+            : _config{config}, _publisher{publisher}, _buffer{buffer} {};
+
+    // Kept for the following samples until the next reading
+    void addPm(const sds011_pm_data_t *data);
+
+    void addGasOutput(const gas_sensor_output_t *output);
+
+    // Stamps the sample with the next sequence number, `nowUnix` (0 while the clock is not set) and `uptimeMs`, and
+    // publishes or buffers it
+    const air_sample_t *publish(uint32_t nowUnix, uint32_t uptimeMs);
+
+    // Sends up to replayBatch buffered samples if the publisher is connected, oldest first, so that live samples are
+    // not starved. Samples taken before the clock was set get their timestamp from `nowUnix`, if it is set.
+    size_t replay(uint32_t nowUnix, uint32_t uptimeMs);
+
+    const air_sample_t &sample() const { return _sample; }
+
+    // Sequence number of the next sample; carried across warm restarts
+    uint32_t seq() const { return _seq; }
+
+    void setSeq(uint32_t seq) { _seq = seq; }
+
+    const sample_pipeline_stats_t &stats() const { return _stats; }
+};
+
+
+#endif //AIR_SENSORS_SENDER_SAMPLEPIPELINE_H
@@ -0,0 +1,29 @@
+//
+// SampleBuffer spill stored as raw air_sample_t records in a file
+//
+
+#ifndef AIR_SENSORS_SENDER_SAMPLESPILLFILE_H
+#define AIR_SENSORS_SENDER_SAMPLESPILLFILE_H
+
+#include <FS.h>
+#include "SampleBuffer.h"
+
+class SampleSpillFile : public SampleSpill {
+protected:
+    fs::FS *_fs;
+    const char *_path;
+
+public:
+    SampleSpillFile(fs::FS *fs, const char *path) : _fs{fs}, _path{path} {};
+
+    size_t count() override;
+
+    bool append(const air_sample_t *samples, size_t n) override;
+
+    size_t read(size_t index, air_sample_t *samples, size_t n) override;
+
+    void clear() override;
+};
+
+
+#endif //AIR_SENSORS_SENDER_SAMPLESPILLFILE_H
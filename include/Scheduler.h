@@ -0,0 +1,105 @@
+//
+// Small cooperative scheduler. Tasks are either periodic or run when signalled, and each has a priority and a time
+// budget. Every pass runs the due tasks from high to low priority; once the pass has used up its budget, the normal
+// and low priority tasks still due are deferred to the next pass, so a slow task (e.g. a flash write) never delays
+// network servicing or BSEC sampling by more than one pass. A task deferred for a set number of passes in a row runs
+// regardless of the budget, so that high priority tasks using it all up on every pass cannot starve the others.
+//
+// Tasks are never preempted: the budget only decides what is deferred and counts overruns.
+//
+
+#ifndef AIR_SENSORS_SENDER_SCHEDULER_H
+#define AIR_SENSORS_SENDER_SCHEDULER_H
+
+#include <Arduino.h>
+#include <functional>
+#include "LatencyStats.h"
+
+#define SCHEDULER_INVALID_TASK 0xFF
+
+typedef enum scheduler_priority {
+    SCHEDULER_PRIORITY_LOW = 0,
+    SCHEDULER_PRIORITY_NORMAL,
+    // Never deferred
+    SCHEDULER_PRIORITY_HIGH,
+} scheduler_priority_t;
+
+typedef std::function<void()> scheduler_callback_t;
+
+typedef uint8_t scheduler_task_id_t;
+
+typedef struct scheduler_task_stats {
+    uint32_t runs;
+    // Runs that took longer than the task's budget
+    uint32_t overruns;
+    // Passes in which the task was due but deferred
+    uint32_t deferrals;
+    // Runs past the pass budget, after being deferred the maximum number of passes
+    uint32_t forcedRuns;
+} scheduler_task_stats_t;
+
+typedef struct scheduler_task {
+    const char *name;
+    scheduler_callback_t callback;
+    scheduler_priority_t priority;
+    uint32_t budgetUs;
+    // 0 runs the task on every pass
+    uint32_t periodMs;
+    bool periodic;
+    bool pending;
+    unsigned long nextRunMs;
+    // Passes deferred since the last run
+    uint8_t deferredPasses;
+    scheduler_task_stats_t stats;
+    // Run times since the last resetLatency()
+    LatencyStats latency;
+} scheduler_task_t;
+
+class Scheduler {
+protected:
+    scheduler_task_t *_tasks;
+    uint8_t _capacity;
+    uint8_t _count = 0;
+    uint32_t _passBudgetUs;
+    uint8_t _maxDeferrals;
+
+    scheduler_task_id_t add(const char *name, scheduler_priority_t priority, uint32_t budgetUs, uint32_t periodMs,
+                            bool periodic, scheduler_callback_t callback);
+
+    bool due(const scheduler_task_t *task, unsigned long now) const;
+
+    void runTask(scheduler_task_t *task);
+
+public:
+    // `storage` must hold `capacity` tasks. A pass stops running deferrable tasks after `passBudgetUs`, except those
+    // already deferred `maxDeferrals` passes in a row.
+    Scheduler(scheduler_task_t *storage, uint8_t capacity, uint32_t passBudgetUs, uint8_t maxDeferrals)
+            : _tasks{storage}, _capacity{capacity}, _passBudgetUs{passBudgetUs}, _maxDeferrals{maxDeferrals} {};
+
+    // Runs `callback` every `periodMs` (every pass if 0). Returns SCHEDULER_INVALID_TASK if there is no room left.
+    scheduler_task_id_t addPeriodic(const char *name, scheduler_priority_t priority, uint32_t budgetUs,
+                                    uint32_t periodMs, scheduler_callback_t callback) {
+        return add(name, priority, budgetUs, periodMs, true, callback);
+    }
+
+    // Runs `callback` once per signal(), on the next pass
+    scheduler_task_id_t addEvent(const char *name, scheduler_priority_t priority, uint32_t budgetUs,
+                                 scheduler_callback_t callback) {
+        return add(name, priority, budgetUs, 0, false, callback);
+    }
+
+    void signal(scheduler_task_id_t id);
+
+    // Runs one pass over the due tasks. Call from loop().
+    void run();
+
+    // Starts a new measurement window for every task's latency statistics
+    void resetLatency();
+
+    uint8_t count() const { return _count; }
+
+    const scheduler_task_t *task(scheduler_task_id_t id) const { return id < _count ? &_tasks[id] : nullptr; }
+};
+
+
+#endif //AIR_SENSORS_SENDER_SCHEDULER_H
@@ -0,0 +1,74 @@
+//
+// Serial port an SDS011 bus runs on. SoftwareSerial works on any pins but bit-bangs every received bit in an
+// interrupt, which competes with WiFi and with the I2C timing of the BME680 and drops bytes under WiFi load. UART0,
+// swapped to GPIO13 (RX) and GPIO15 (TX), receives in hardware into the core's interrupt-fed ring buffer instead; the
+// log then goes to UART1 (GPIO2, TX only).
+//
+// Both count RX buffer overflows, which otherwise show up only as lost frames.
+//
+
+#ifndef AIR_SENSORS_SENDER_SDSPORT_H
+#define AIR_SENSORS_SENDER_SDSPORT_H
+
+#include <Arduino.h>
+#include <SoftwareSerial.h>
+
+#define SDS_PORT_BAUD 9600
+
+// Pins of UART0 after Serial.swap()
+#define SDS_PORT_UART0_RX 13
+#define SDS_PORT_UART0_TX 15
+
+// Room for a few frames (10 bytes each) in case polling is held up, e.g. by a flash write
+#define SDS_PORT_RX_BUFFER_SIZE 256
+
+class SdsPort {
+protected:
+    uint32_t _overflows = 0;
+
+public:
+    virtual ~SdsPort() = default;
+
+    virtual Stream *stream() = 0;
+
+    virtual void begin() = 0;
+
+    virtual void end() = 0;
+
+    // Checks the overflow flag, which the driver keeps until read; call before reading the stream
+    virtual void poll() = 0;
+
+    // Times the RX buffer overflowed since boot, as seen by poll(). Each time loses one or more bytes.
+    uint32_t overflows() const { return _overflows; }
+};
+
+class SoftwareSdsPort : public SdsPort {
+protected:
+    SoftwareSerial _serial;
+
+public:
+    SoftwareSdsPort(uint8_t rxPin, uint8_t txPin) : _serial(rxPin, txPin) {};
+
+    Stream *stream() override { return &_serial; }
+
+    void begin() override;
+
+    void end() override;
+
+    void poll() override;
+};
+
+// There is only one, and it takes Serial away from the log
+class Uart0SdsPort : public SdsPort {
+public:
+    Stream *stream() override { return &Serial; }
+
+    void begin() override;
+
+    void end() override;
+
+    void poll() override;
+};
+
+
+#endif //AIR_SENSORS_SENDER_SDSPORT_H
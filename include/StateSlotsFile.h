@@ -0,0 +1,25 @@
+//
+// StateStore slots stored as one file each
+//
+
+#ifndef AIR_SENSORS_SENDER_STATESLOTSFILE_H
+#define AIR_SENSORS_SENDER_STATESLOTSFILE_H
+
+#include <FS.h>
+#include "StateStore.h"
+
+class StateSlotsFile : public StateSlots {
+protected:
+    fs::FS *_fs;
+    const char *_paths[STATE_STORE_SLOTS];
+
+public:
+    StateSlotsFile(fs::FS *fs, const char *pathA, const char *pathB) : _fs{fs}, _paths{pathA, pathB} {};
+
+    size_t read(uint8_t slot, size_t offset, uint8_t *buf, size_t size) override;
+
+    bool write(uint8_t slot, const state_header_t *header, const uint8_t *payload, size_t len) override;
+};
+
+
+#endif //AIR_SENSORS_SENDER_STATESLOTSFILE_H
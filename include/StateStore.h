@@ -0,0 +1,81 @@
+//
+// Double-buffered, CRC-protected storage for a small state blob (the BSEC calibration state). Every save goes to the
+// slot not holding the current state, behind a header with a format version, the payload length, a generation
+// counter and a CRC32. Loading picks the valid slot with the highest generation, so a write torn by a reset or power
+// loss only ever loses that write. Saves of a payload identical to the last one are skipped.
+//
+
+#ifndef AIR_SENSORS_SENDER_STATESTORE_H
+#define AIR_SENSORS_SENDER_STATESTORE_H
+
+#include <Arduino.h>
+
+#define STATE_STORE_MAGIC 0x54534241 // "ABST"
+#define STATE_STORE_SLOTS 2
+
+typedef struct __attribute__((packed)) state_header {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t length;
+    uint32_t generation;
+    // CRC32 of the fields above followed by the payload
+    uint32_t crc;
+} state_header_t;
+
+typedef enum state_store_result {
+    STATE_STORE_WRITTEN = 0,
+    STATE_STORE_UNCHANGED,
+    STATE_STORE_FAILED,
+} state_store_result_t;
+
+typedef struct state_store_stats {
+    // Generation of the current state, which is also the number of writes since the store was created
+    uint32_t generation;
+    uint32_t writes;
+    uint32_t skipped;
+    uint32_t failures;
+    // Slots found corrupted or from another format version when loading
+    uint32_t invalidSlots;
+} state_store_stats_t;
+
+// Where the slots live
+class StateSlots {
+public:
+    virtual ~StateSlots() = default;
+
+    // Returns the number of bytes read from `offset` into the slot, 0 if the slot is missing
+    virtual size_t read(uint8_t slot, size_t offset, uint8_t *buf, size_t size) = 0;
+
+    // Replaces the slot's contents with the header followed by the payload
+    virtual bool write(uint8_t slot, const state_header_t *header, const uint8_t *payload, size_t len) = 0;
+};
+
+class StateStore {
+protected:
+    StateSlots *_slots;
+    uint16_t _version;
+    state_store_stats_t _stats = {};
+    // CRC of the last payload loaded or written, to skip unchanged saves
+    uint32_t _payloadCrc = 0;
+    uint16_t _payloadLen = 0;
+    bool _havePayload = false;
+
+    static uint32_t headerCrc(const state_header_t *header, const uint8_t *payload);
+
+    bool readSlot(uint8_t slot, state_header_t *header, uint8_t *payload, size_t maxLen);
+
+public:
+    StateStore(StateSlots *slots, uint16_t version) : _slots{slots}, _version{version} {};
+
+    // Loads the newest valid state into `payload`. Returns false if there is none.
+    bool load(uint8_t *payload, size_t maxLen, size_t *len);
+
+    state_store_result_t save(const uint8_t *payload, size_t len);
+
+    const state_store_stats_t &stats() const { return _stats; }
+
+    static uint32_t crc32(uint32_t crc, const uint8_t *data, size_t len);
+};
+
+
+#endif //AIR_SENSORS_SENDER_STATESTORE_H
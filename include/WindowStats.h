@@ -0,0 +1,66 @@
+//
+// Statistics of one series over consecutive fixed windows (e.g. every clock hour): count, mean, min, max and the
+// median and 95th percentile, the latter estimated with P2Quantile. Windows are aligned to multiples of their length,
+// so with Unix time 1 h windows start on the hour and 24 h windows at midnight UTC, as air quality limits are defined.
+// Memory is constant; when a window is over its summary is kept until it is taken, while the next one accumulates.
+//
+
+#ifndef AIR_SENSORS_SENDER_WINDOWSTATS_H
+#define AIR_SENSORS_SENDER_WINDOWSTATS_H
+
+#include <Arduino.h>
+#include "P2Quantile.h"
+
+// Enough for format() with every value at its largest
+#define WINDOW_STATS_FORMAT_BUF_SIZE 176
+
+typedef struct window_summary {
+    // Start of the window, in the time base passed to add()
+    uint32_t startS;
+    uint32_t count;
+    float mean;
+    float min;
+    float max;
+    float p50;
+    float p95;
+} window_summary_t;
+
+class WindowStats {
+protected:
+    uint32_t _lengthS;
+    uint32_t _startS = 0;
+    uint32_t _count = 0;
+    // Summed in double: a 24 h window of 1 s readings would lose the decimals in a float
+    double _sum = 0;
+    float _min = 0;
+    float _max = 0;
+    P2Quantile _p50{0.5};
+    P2Quantile _p95{0.95};
+
+    window_summary_t _closed = {};
+    bool _haveClosed = false;
+
+    void roll(uint32_t nowS);
+
+public:
+    explicit WindowStats(uint32_t lengthS) : _lengthS{lengthS > 0 ? lengthS : 1} {};
+
+    // `nowS` must not go backwards. A value past the end of the current window closes it first.
+    void add(uint32_t nowS, float value);
+
+    // Summary of the window that ended by `nowS`, if it had any values and was not taken yet. Windows without values
+    // are skipped; a gap in readings shows up as missing windows rather than empty ones.
+    const window_summary_t *takeClosed(uint32_t nowS);
+
+    uint32_t lengthS() const { return _lengthS; }
+
+    // Values in the current window so far
+    uint32_t count() const { return _count; }
+
+    // Formats a summary as {"start","n","mean","min","max","p50","p95"}, values with `decimals` places. Returns the
+    // length written, or 0 if it did not fit.
+    static size_t format(const window_summary_t *summary, uint8_t decimals, char *buf, size_t size);
+};
+
+
+#endif //AIR_SENSORS_SENDER_WINDOWSTATS_H
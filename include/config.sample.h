@@ -19,6 +19,115 @@
 #define SDS_TX 14
 #define SDS_RX 12
 
+// Optional: several SDS011 units, each published on its own Homie node, as
+// {RX pin, TX pin, device ID, node ID, node name, working period in minutes (0 for continuous)}.
+// Units on the same pins share the serial port and must be told apart by device ID, as logged at boot ("sensor ID");
+// SDS011_ANY only works for a unit alone on its port. The first unit feeds the
+// combined sample. Failed units are reconfigured every 30 seconds. Online status and link health (received, 0/0 and
+// corrupted frames, skipped bytes, failed, timed out and retried commands) are published every
+// PARTICULATE_HEALTH_INTERVAL_MS.
+//#define SDS_SENSORS {{SDS_RX, SDS_TX, SDS011_ANY, "particulate", "Particulate sensor", 1}, \
+//                     {13, 15, SDS011_ANY, "particulate-2", "Particulate sensor 2", 1}}
+//#define PARTICULATE_HEALTH_INTERVAL_MS (60 * 1000)
+
+// Optional: sample in query mode instead of active reporting with a working period, at an interval that follows how
+// fast PM changes: down to PM_ADAPTIVE_MIN_INTERVAL_S while it moves by more than PM_ADAPTIVE_CHANGE_ABS µg/m³ or
+// PM_ADAPTIVE_CHANGE_REL of the last reading (whichever is larger) per interval, doubling up to
+// PM_ADAPTIVE_MAX_INTERVAL_S while it is stable. The unit sleeps between samples and runs for PM_ADAPTIVE_WARMUP_S
+// before each, which saves most of the fan and laser wear in stable air. The working periods in SDS_SENSORS are not
+// used, and the current interval and the on time are published per unit. Not available with LOW_POWER_MODE.
+//#define PM_ADAPTIVE_POLLING 1
+//#define PM_ADAPTIVE_MIN_INTERVAL_S 60
+//#define PM_ADAPTIVE_MAX_INTERVAL_S (15 * 60)
+//#define PM_ADAPTIVE_WARMUP_S 30
+//#define PM_ADAPTIVE_CHANGE_ABS 2.0
+//#define PM_ADAPTIVE_CHANGE_REL 0.1
+
+// Optional: run the unit wired to RX GPIO13 / TX GPIO15 (SDS_RX 13 and SDS_TX 15, or those pins in SDS_SENSORS) on the
+// hardware UART (UART0, swapped) instead of SoftwareSerial, which costs CPU time in interrupts and loses bytes under
+// WiFi load. The log then goes to GPIO2 (UART1, TX only) instead of the USB serial port. GPIO2 is also the built-in LED
+// of the ESP-12E, so the LED does not blink while connecting to WiFi in this mode. GPIO15 must be low at boot, so check
+// that the SDS011 does not pull it up. Receive buffer overflows are published per unit as serial-overflows either way.
+//#define SDS_HARDWARE_UART 1
+
+// Optional: PM statistics over fixed windows, in seconds, aligned to UTC (1 h windows start on the hour, 24 h windows
+// at midnight). When a window ends, each unit's node gets pm25-<length> and pm10-<length> (e.g. pm25-24h) as
+// {"start","n","mean","min","max","p50","p95"}, with start as Unix time and the percentiles estimated. Readings from
+// before the clock is set via NTP are not counted, and windows are not kept across restarts or LOW_POWER_MODE sleep.
+//#define PM_WINDOWS {60, 15 * 60, 60 * 60, 24 * 60 * 60}
+
+// Optional: BME680 properties are only re-published when they move by more than these deadbands, or at least once every
+// PUBLISH_HEARTBEAT_MS. Accuracy and status properties are published on every change.
+//#define PUBLISH_HEARTBEAT_MS (5 * 60 * 1000)
+//#define DEADBAND_TEMPERATURE 0.1      // °C
+//#define DEADBAND_PRESSURE 10          // Pa
+//#define DEADBAND_HUMIDITY 0.5         // %
+//#define DEADBAND_IAQ 1
+//#define DEADBAND_CO2_EQUIVALENT 10    // ppm
+//#define DEADBAND_RELATIVE_GAS 0.02    // fraction of the last value, gas resistance and breath VOC
+
+// Optional: decimal places of published values
+//#define PRECISION_TEMPERATURE 2
+//#define PRECISION_PRESSURE 0
+//#define PRECISION_HUMIDITY 2
+//#define PRECISION_GAS 2               // gas resistance and breath VOC
+//#define PRECISION_IAQ 1
+//#define PRECISION_CO2_EQUIVALENT 0
+//#define PRECISION_PM 1
+
+// Optional: also publish every sample (BME680 + SDS011 + timestamp + sequence number) as a single message on
+// SAMPLE_TOPIC, as SAMPLE_FORMAT_JSON or SAMPLE_FORMAT_CBOR. Set SAMPLE_PER_PROPERTY to 0 to publish only that
+// message instead of the per-property Homie topics.
+//#define SAMPLE_FORMAT SAMPLE_FORMAT_CBOR
+//#define SAMPLE_TOPIC "air-sensor/sample"
+//#define SAMPLE_PER_PROPERTY 1
+//#define NTP_SERVER "pool.ntp.org"
+
+// Optional, with SAMPLE_FORMAT set: combined samples produced while WiFi or MQTT is down are kept in a RAM ring of
+// SAMPLE_BUFFER_CAPACITY samples, spilled to flash (/samples.bin, up to SAMPLE_SPILL_MAX_RECORDS, 0 to disable) when
+// it fills up, and replayed SAMPLE_REPLAY_BATCH at a time every SAMPLE_REPLAY_INTERVAL_MS once the broker is back.
+//#define SAMPLE_BUFFER_CAPACITY 64
+//#define SAMPLE_SPILL_MAX_RECORDS 2048
+//#define SAMPLE_REPLAY_BATCH 5
+//#define SAMPLE_REPLAY_INTERVAL_MS 1000
+
+// Optional: time a loop() pass may take before normal and low priority tasks (SDS011 polling, health, sample replay,
+// BSEC state writes) are deferred to the next pass. Network servicing and BSEC always run, and a task deferred
+// SCHEDULER_MAX_DEFERRALS passes in a row runs on the next one regardless.
+//#define SCHEDULER_PASS_BUDGET_US 20000
+//#define SCHEDULER_MAX_DEFERRALS 10
+
+// Optional: how often the loop latency statistics (whole pass, each task, BSEC run and BME680 publishing) are published
+// on the diagnostics node, as {"n","min","mean","max","hist"} in µs. hist[0] counts runs under 1 µs and hist[i] runs
+// of 2^(i-1) to 2^i µs. Each publish starts a new window.
+//#define DIAGNOSTICS_INTERVAL_MS (60 * 1000)
+
+// Optional: battery operation. The ESP8266 deep sleeps between measurements, every 5 minutes (BSEC's ULP rate); it
+// wakes LOW_POWER_SDS_WARMUP_S earlier, with the radio off, to start the SDS011 fans, then wakes again to query the
+// units, put them back to sleep, take the BME680 sample and publish. A measurement wake ends once everything is sent
+// (plus LOW_POWER_PUBLISH_GRACE_MS), or after LOW_POWER_MAX_AWAKE_MS. The BSEC state is kept in RTC memory between
+// wakes and written to flash every LOW_POWER_FLASH_STATE_CYCLES. GPIO16 (D0) must be wired to RST. OTA and the
+// diagnostics node are only of use while awake. See `--low-power` in the host simulation for a current estimate.
+//#define LOW_POWER_MODE 1
+//#define LOW_POWER_SDS_WARMUP_S 30
+//#define LOW_POWER_MAX_AWAKE_MS (20 * 1000)
+//#define LOW_POWER_PUBLISH_GRACE_MS 500
+//#define LOW_POWER_FLASH_STATE_CYCLES 24
+
+// Optional: run BSEC at ULP (a BME680 sample every 5 minutes) instead of LP (every 3 s) while the air is stable: once
+// IAQ has stayed within BSEC_RATE_IAQ_BAND for BSEC_RATE_STABLE_S with an accuracy of at least
+// BSEC_RATE_MIN_ACCURACY, and back to LP as soon as it leaves the band. Between BSEC_RATE_ULP_FROM_HOUR and
+// BSEC_RATE_ULP_TO_HOUR (UTC, equal for never) ULP is used regardless. The "sample-rate-mode" property of the
+// air-quality node can be set to "lp" or "ulp" to override this, or back to "auto". The BSEC state is kept across
+// switches; a switch BSEC rejects is retried after BSEC_RATE_RETRY_S. Not available with LOW_POWER_MODE.
+//#define BSEC_ADAPTIVE_RATE 1
+//#define BSEC_RATE_IAQ_BAND 10.0
+//#define BSEC_RATE_STABLE_S (30 * 60)
+//#define BSEC_RATE_MIN_ACCURACY 2
+//#define BSEC_RATE_ULP_FROM_HOUR 0
+//#define BSEC_RATE_ULP_TO_HOUR 0
+//#define BSEC_RATE_RETRY_S (10 * 60)
+
 #define AIR_SENSORS_SENDER_CONFIG_H
 
 #endif //AIR_SENSORS_SENDER_CONFIG_H
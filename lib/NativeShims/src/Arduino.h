@@ -0,0 +1,38 @@
+//
+// Host stand-in for the Arduino core. Only what the firmware modules use is provided.
+//
+
+#ifndef NATIVE_SHIMS_ARDUINO_H
+#define NATIVE_SHIMS_ARDUINO_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <math.h>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+unsigned long millis();
+
+unsigned long micros();
+
+void delay(unsigned long ms);
+
+void delayMicroseconds(unsigned int us);
+
+void yield();
+
+#include "WString.h"
+#include "Print.h"
+#include "Stream.h"
+#include "HardwareSerial.h"
+#include "FakeClock.h"
+
+#endif //NATIVE_SHIMS_ARDUINO_H
@@ -0,0 +1,28 @@
+//
+// Simulated time for host builds
+//
+
+#include "Arduino.h"
+
+uint64_t FakeClock::_nowUs = 0;
+uint32_t FakeClock::_yieldStepUs = 100;
+
+unsigned long millis() {
+    return (unsigned long) FakeClock::nowMillis();
+}
+
+unsigned long micros() {
+    return (unsigned long) FakeClock::nowMicros();
+}
+
+void delay(unsigned long ms) {
+    FakeClock::advanceMillis(ms);
+}
+
+void delayMicroseconds(unsigned int us) {
+    FakeClock::advanceMicros(us);
+}
+
+void yield() {
+    FakeClock::advanceMicros(FakeClock::yieldStep());
+}
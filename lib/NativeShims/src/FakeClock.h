@@ -0,0 +1,34 @@
+//
+// Simulated time for host builds. millis()/micros() only move when the simulation advances the clock, or by a fixed
+// step on every yield()/delay(), so busy-wait loops in the firmware modules still terminate.
+//
+
+#ifndef NATIVE_SHIMS_FAKECLOCK_H
+#define NATIVE_SHIMS_FAKECLOCK_H
+
+#include <cstdint>
+
+class FakeClock {
+protected:
+    static uint64_t _nowUs;
+    static uint32_t _yieldStepUs;
+
+public:
+    static uint64_t nowMicros() { return _nowUs; }
+
+    static uint64_t nowMillis() { return _nowUs / 1000; }
+
+    static void advanceMicros(uint64_t us) { _nowUs += us; }
+
+    static void advanceMillis(uint64_t ms) { _nowUs += ms * 1000; }
+
+    // Time that passes on every yield(). Defaults to 100 µs.
+    static void setYieldStep(uint32_t us) { _yieldStepUs = us; }
+
+    static uint32_t yieldStep() { return _yieldStepUs; }
+
+    static void reset() { _nowUs = 0; }
+};
+
+
+#endif //NATIVE_SHIMS_FAKECLOCK_H
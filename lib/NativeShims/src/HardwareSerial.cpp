@@ -0,0 +1,21 @@
+//
+// Host stand-in for the Arduino HardwareSerial class
+//
+
+#include <cstdio>
+#include "HardwareSerial.h"
+
+HardwareSerial Serial;
+HardwareSerial Serial1;
+
+size_t HardwareSerial::write(uint8_t c) {
+    return fputc(c, stdout) == EOF ? 0 : 1;
+}
+
+size_t HardwareSerial::write(const uint8_t *buffer, size_t size) {
+    return fwrite(buffer, 1, size, stdout);
+}
+
+void HardwareSerial::flush() {
+    fflush(stdout);
+}
@@ -0,0 +1,41 @@
+//
+// Host stand-in for the Arduino HardwareSerial class. Output goes to stdout, input is always empty.
+//
+
+#ifndef NATIVE_SHIMS_HARDWARESERIAL_H
+#define NATIVE_SHIMS_HARDWARESERIAL_H
+
+#include "Stream.h"
+
+class HardwareSerial : public Stream {
+public:
+    void begin(unsigned long baud) { (void) baud; }
+
+    void end() {}
+
+    size_t setRxBufferSize(size_t size) { return size; }
+
+    void swap() {}
+
+    bool hasOverrun() { return false; }
+
+    int available() override { return 0; }
+
+    int read() override { return -1; }
+
+    int peek() override { return -1; }
+
+    size_t write(uint8_t c) override;
+
+    size_t write(const uint8_t *buffer, size_t size) override;
+
+    void flush() override;
+
+    using Print::write;
+};
+
+extern HardwareSerial Serial;
+extern HardwareSerial Serial1;
+
+
+#endif //NATIVE_SHIMS_HARDWARESERIAL_H
@@ -0,0 +1,79 @@
+//
+// Host stand-in for the LeifHomieLib node and property classes. Published values are recorded instead of being sent
+// to a broker.
+//
+
+#ifndef NATIVE_SHIMS_HOMIENODE_H
+#define NATIVE_SHIMS_HOMIENODE_H
+
+#include <functional>
+#include <memory>
+#include <vector>
+#include "Arduino.h"
+
+enum HomieDataType {
+    homieString,
+    homieInteger,
+    homieFloat,
+    homieBool,
+    homieEnum,
+    homieColor,
+};
+
+class HomieProperty;
+
+typedef std::function<void(HomieProperty *pSource)> HomiePropertyCallback;
+
+class HomieProperty {
+protected:
+    String _value;
+    String _unit;
+    bool _retained = false;
+    bool _settable = false;
+    uint32_t _publishCount = 0;
+    std::vector<HomiePropertyCallback> _callbacks;
+
+public:
+    String strID;
+    String strFriendlyName;
+    String strFormat;
+    HomieDataType datatype = homieString;
+
+    void SetRetained(bool retained) { _retained = retained; }
+
+    void SetSettable(bool settable) { _settable = settable; }
+
+    // Run when a value is set through the broker, which does not happen on the host
+    void AddCallback(HomiePropertyCallback callback) { _callbacks.push_back(callback); }
+
+    void SetUnit(const char *unit) { _unit = unit; }
+
+    void SetValue(const String &value) {
+        _value = value;
+        _publishCount++;
+    }
+
+    void SetBool(bool value) { SetValue(value ? "true" : "false"); }
+
+    const String &GetValue() const { return _value; }
+
+    uint32_t GetPublishCount() const { return _publishCount; }
+};
+
+class HomieNode {
+protected:
+    std::vector<std::unique_ptr<HomieProperty>> _properties;
+
+public:
+    String strID;
+    String strFriendlyName;
+    String strType;
+
+    HomieProperty *NewProperty() {
+        _properties.emplace_back(new HomieProperty());
+        return _properties.back().get();
+    }
+};
+
+
+#endif //NATIVE_SHIMS_HOMIENODE_H
@@ -0,0 +1,38 @@
+//
+// Host stand-in for the Arduino Print class
+//
+
+#include <cstdio>
+#include "Print.h"
+
+size_t Print::write(const uint8_t *buffer, size_t size) {
+    size_t n = 0;
+    while (size--) {
+        if (write(*buffer++) == 0) {
+            break;
+        }
+        n++;
+    }
+    return n;
+}
+
+size_t Print::print(long n, int base) {
+    if (base == 10 && n < 0) {
+        return print('-') + printNumber(-(unsigned long) n, 10);
+    }
+    return printNumber((unsigned long) n, base);
+}
+
+size_t Print::print(unsigned long n, int base) {
+    return printNumber(n, base);
+}
+
+size_t Print::printNumber(unsigned long n, uint8_t base) {
+    return print(String(n, base));
+}
+
+size_t Print::printFloat(double number, uint8_t digits) {
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%.*f", digits, number);
+    return write(buf);
+}
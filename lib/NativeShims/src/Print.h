@@ -0,0 +1,75 @@
+//
+// Host stand-in for the Arduino Print class
+//
+
+#ifndef NATIVE_SHIMS_PRINT_H
+#define NATIVE_SHIMS_PRINT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include "WString.h"
+
+class Print {
+protected:
+    size_t printNumber(unsigned long n, uint8_t base);
+
+    size_t printFloat(double number, uint8_t digits);
+
+public:
+    virtual ~Print() = default;
+
+    virtual size_t write(uint8_t) = 0;
+
+    virtual size_t write(const uint8_t *buffer, size_t size);
+
+    size_t write(const char *str) {
+        if (str == nullptr) {
+            return 0;
+        }
+        return write((const uint8_t *) str, strlen(str));
+    }
+
+    size_t write(const char *buffer, size_t size) { return write((const uint8_t *) buffer, size); }
+
+    virtual int availableForWrite() { return 0; }
+
+    virtual void flush() {}
+
+    size_t print(const __FlashStringHelper *str) { return write(reinterpret_cast<const char *>(str)); }
+
+    size_t print(const String &str) { return write((const uint8_t *) str.c_str(), str.length()); }
+
+    size_t print(const char *str) { return write(str); }
+
+    size_t print(char c) { return write((uint8_t) c); }
+
+    size_t print(unsigned char n, int base = 10) { return print((unsigned long) n, base); }
+
+    size_t print(int n, int base = 10) { return print((long) n, base); }
+
+    size_t print(unsigned int n, int base = 10) { return print((unsigned long) n, base); }
+
+    size_t print(long n, int base = 10);
+
+    size_t print(unsigned long n, int base = 10);
+
+    size_t print(double n, int digits = 2) { return printFloat(n, digits); }
+
+    size_t println() { return write("\r\n"); }
+
+    template<typename T>
+    size_t println(T value) {
+        size_t n = print(value);
+        return n + println();
+    }
+
+    template<typename T>
+    size_t println(T value, int format) {
+        size_t n = print(value, format);
+        return n + println();
+    }
+};
+
+
+#endif //NATIVE_SHIMS_PRINT_H
@@ -0,0 +1,31 @@
+//
+// Host stand-in for the Arduino Stream class
+//
+
+#ifndef NATIVE_SHIMS_STREAM_H
+#define NATIVE_SHIMS_STREAM_H
+
+#include "Print.h"
+
+class Stream : public Print {
+protected:
+    unsigned long _timeout = 1000;
+
+    int timedRead();
+
+public:
+    virtual int available() = 0;
+
+    virtual int read() = 0;
+
+    virtual int peek() = 0;
+
+    void setTimeout(unsigned long timeout) { _timeout = timeout; }
+
+    size_t readBytes(char *buffer, size_t length);
+
+    size_t readBytes(uint8_t *buffer, size_t length) { return readBytes((char *) buffer, length); }
+};
+
+
+#endif //NATIVE_SHIMS_STREAM_H
@@ -0,0 +1,91 @@
+//
+// Host stand-in for the Arduino String class
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "WString.h"
+
+static std::string formatInteger(unsigned long value, unsigned char base, bool negative) {
+    char buf[8 * sizeof(long) + 2];
+    char *ptr = buf + sizeof(buf) - 1;
+    *ptr = '\0';
+    if (base < 2) {
+        base = 10;
+    }
+    do {
+        unsigned long digit = value % base;
+        *--ptr = (char) (digit < 10 ? '0' + digit : 'a' + digit - 10);
+        value /= base;
+    } while (value > 0);
+    if (negative) {
+        *--ptr = '-';
+    }
+    return {ptr};
+}
+
+String::String(unsigned char value, unsigned char base) : _str{formatInteger(value, base, false)} {}
+
+String::String(unsigned int value, unsigned char base) : _str{formatInteger(value, base, false)} {}
+
+String::String(unsigned long value, unsigned char base) : _str{formatInteger(value, base, false)} {}
+
+String::String(int value, unsigned char base) : String((long) value, base) {}
+
+String::String(long value, unsigned char base) {
+    // Like the Arduino core, only base 10 gets a sign
+    if (base == 10 && value < 0) {
+        _str = formatInteger(-(unsigned long) value, base, true);
+    } else {
+        _str = formatInteger((unsigned long) value, base, false);
+    }
+}
+
+String::String(float value, unsigned char decimalPlaces) : String((double) value, decimalPlaces) {}
+
+String::String(double value, unsigned char decimalPlaces) {
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%.*f", decimalPlaces, value);
+    _str = buf;
+}
+
+void String::toCharArray(char *buf, unsigned int bufsize, unsigned int index) const {
+    if (bufsize == 0 || buf == nullptr) {
+        return;
+    }
+    if (index >= _str.length()) {
+        buf[0] = '\0';
+        return;
+    }
+    unsigned int n = _str.length() - index;
+    if (n > bufsize - 1) {
+        n = bufsize - 1;
+    }
+    memcpy(buf, _str.c_str() + index, n);
+    buf[n] = '\0';
+}
+
+String operator+(const String &lhs, const String &rhs) {
+    String ret(lhs);
+    ret += rhs;
+    return ret;
+}
+
+String operator+(const String &lhs, const char *rhs) {
+    String ret(lhs);
+    ret += rhs;
+    return ret;
+}
+
+String operator+(const char *lhs, const String &rhs) {
+    String ret(lhs);
+    ret += rhs;
+    return ret;
+}
+
+String operator+(const String &lhs, char rhs) {
+    String ret(lhs);
+    ret += rhs;
+    return ret;
+}
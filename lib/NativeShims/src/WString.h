@@ -0,0 +1,121 @@
+//
+// Host stand-in for the Arduino String class, backed by std::string
+//
+
+#ifndef NATIVE_SHIMS_WSTRING_H
+#define NATIVE_SHIMS_WSTRING_H
+
+#include <string>
+
+class __FlashStringHelper;
+
+#define F(string_literal) (reinterpret_cast<const __FlashStringHelper *>(string_literal))
+#define PSTR(s) (s)
+#define PROGMEM
+// Flash and RAM are the same address space on the host
+#define memcpy_P memcpy
+
+class String {
+protected:
+    std::string _str;
+
+public:
+    String() = default;
+
+    String(const char *cstr) : _str{cstr != nullptr ? cstr : ""} {}
+
+    String(const __FlashStringHelper *str) : String(reinterpret_cast<const char *>(str)) {}
+
+    String(const std::string &str) : _str{str} {}
+
+    explicit String(char c) : _str(1, c) {}
+
+    explicit String(unsigned char value, unsigned char base = 10);
+
+    explicit String(int value, unsigned char base = 10);
+
+    explicit String(unsigned int value, unsigned char base = 10);
+
+    explicit String(long value, unsigned char base = 10);
+
+    explicit String(unsigned long value, unsigned char base = 10);
+
+    explicit String(float value, unsigned char decimalPlaces = 2);
+
+    explicit String(double value, unsigned char decimalPlaces = 2);
+
+    unsigned int length() const { return _str.length(); }
+
+    const char *c_str() const { return _str.c_str(); }
+
+    bool reserve(unsigned int size) {
+        _str.reserve(size);
+        return true;
+    }
+
+    bool concat(const String &str) {
+        _str += str._str;
+        return true;
+    }
+
+    bool concat(const char *cstr) {
+        if (cstr != nullptr) {
+            _str += cstr;
+        }
+        return true;
+    }
+
+    bool concat(const char *cstr, unsigned int length) {
+        _str.append(cstr, length);
+        return true;
+    }
+
+    bool concat(char c) {
+        _str += c;
+        return true;
+    }
+
+    String &operator+=(const String &rhs) {
+        concat(rhs);
+        return *this;
+    }
+
+    String &operator+=(const char *cstr) {
+        concat(cstr);
+        return *this;
+    }
+
+    String &operator+=(char c) {
+        concat(c);
+        return *this;
+    }
+
+    bool operator==(const String &rhs) const { return _str == rhs._str; }
+
+    bool operator==(const char *cstr) const { return _str == cstr; }
+
+    bool operator!=(const String &rhs) const { return _str != rhs._str; }
+
+    char operator[](unsigned int index) const { return index < _str.length() ? _str[index] : 0; }
+
+    void toCharArray(char *buf, unsigned int bufsize, unsigned int index = 0) const;
+
+    void getBytes(unsigned char *buf, unsigned int bufsize, unsigned int index = 0) const {
+        toCharArray(reinterpret_cast<char *>(buf), bufsize, index);
+    }
+
+    float toFloat() const { return strtof(_str.c_str(), nullptr); }
+
+    long toInt() const { return strtol(_str.c_str(), nullptr, 10); }
+};
+
+String operator+(const String &lhs, const String &rhs);
+
+String operator+(const String &lhs, const char *rhs);
+
+String operator+(const char *lhs, const String &rhs);
+
+String operator+(const String &lhs, char rhs);
+
+
+#endif //NATIVE_SHIMS_WSTRING_H
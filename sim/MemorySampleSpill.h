@@ -0,0 +1,45 @@
+//
+// SampleBuffer spill in RAM for the host simulation, standing in for SampleSpillFile on SPIFFS. Counts writes, since
+// on the device each one is a flash write.
+//
+
+#ifndef AIR_SENSORS_SENDER_MEMORYSAMPLESPILL_H
+#define AIR_SENSORS_SENDER_MEMORYSAMPLESPILL_H
+
+#include <SampleBuffer.h>
+#include <algorithm>
+#include <vector>
+
+class MemorySampleSpill : public SampleSpill {
+protected:
+    std::vector<air_sample_t> _records;
+    uint32_t _writes = 0;
+
+public:
+    size_t count() override { return _records.size(); }
+
+    bool append(const air_sample_t *samples, size_t n) override {
+        _records.insert(_records.end(), samples, samples + n);
+        _writes++;
+        return true;
+    }
+
+    size_t read(size_t index, air_sample_t *samples, size_t n) override {
+        if (index >= _records.size()) {
+            return 0;
+        }
+        n = std::min(n, _records.size() - index);
+        std::copy(_records.begin() + index, _records.begin() + index + n, samples);
+        return n;
+    }
+
+    void clear() override {
+        _records.clear();
+        _writes++;
+    }
+
+    uint32_t writes() const { return _writes; }
+};
+
+
+#endif //AIR_SENSORS_SENDER_MEMORYSAMPLESPILL_H
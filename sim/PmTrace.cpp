@@ -0,0 +1,90 @@
+//
+// PM2.5/PM10 over time for the simulated SDS011
+//
+
+#include <cmath>
+#include <cstdio>
+#include "PmTrace.h"
+
+bool PmTrace::load(const char *path) {
+    FILE *file = fopen(path, "r");
+    if (file == nullptr) {
+        return false;
+    }
+    _points.clear();
+    char line[128];
+    while (fgets(line, sizeof(line), file) != nullptr) {
+        pm_trace_point_t point;
+        unsigned long seconds;
+        if (sscanf(line, "%lu,%f,%f", &seconds, &point.pm25, &point.pm10) != 3) {
+            continue;
+        }
+        point.seconds = (uint32_t) seconds;
+        if (!_points.empty() && point.seconds <= _points.back().seconds) {
+            continue;
+        }
+        _points.push_back(point);
+    }
+    fclose(file);
+    return _points.size() >= 2;
+}
+
+// Rises linearly over `riseS` from `startS`, then decays exponentially with time constant `decayS`
+static double event(double t, double startS, double riseS, double decayS, double peak) {
+    if (t < startS) {
+        return 0;
+    }
+    if (t < startS + riseS) {
+        return peak * (t - startS) / riseS;
+    }
+    return peak * exp(-(t - startS - riseS) / decayS);
+}
+
+void PmTrace::synthesize(uint32_t seed) {
+    _points.clear();
+    uint32_t rng = seed != 0 ? seed : 1;
+    for (uint32_t s = 0; s <= 24 * 3600; s += 10) {
+        rng ^= rng << 13;
+        rng ^= rng >> 17;
+        rng ^= rng << 5;
+        double noise = ((double) (rng % 1000) / 1000.0 - 0.5);
+
+        double t = s;
+        double pm25 = 6 + 2 * sin(2 * M_PI * t / 86400) + noise;
+        // Breakfast, an afternoon outdoor episode and dinner
+        pm25 += event(t, 7.5 * 3600, 5 * 60, 20 * 60, 60);
+        pm25 += event(t, 13 * 3600, 60 * 60, 90 * 60, 25);
+        pm25 += event(t, 19 * 3600, 10 * 60, 30 * 60, 120);
+        _points.push_back({s, (float) pm25, (float) (pm25 * 1.6 + 2)});
+    }
+}
+
+void PmTrace::sample(uint64_t nowMs, float *pm25, float *pm10) const {
+    if (_points.size() < 2) {
+        *pm25 = _points.empty() ? 0 : _points[0].pm25;
+        *pm10 = _points.empty() ? 0 : _points[0].pm10;
+        return;
+    }
+    double t = (double) (nowMs % ((uint64_t) durationS() * 1000)) / 1000.0;
+    // Points are evenly spaced in a synthetic trace and usually close to it in a recording, so start from a guess
+    size_t i = (size_t) (t / ((double) durationS() / (double) (_points.size() - 1)));
+    if (i >= _points.size() - 1) {
+        i = _points.size() - 2;
+    }
+    while (i > 0 && _points[i].seconds > t) {
+        i--;
+    }
+    while (i + 2 < _points.size() && _points[i + 1].seconds <= t) {
+        i++;
+    }
+    const pm_trace_point_t &a = _points[i];
+    const pm_trace_point_t &b = _points[i + 1];
+    double f = (t - a.seconds) / (double) (b.seconds - a.seconds);
+    if (f < 0) {
+        f = 0;
+    } else if (f > 1) {
+        f = 1;
+    }
+    *pm25 = (float) (a.pm25 + f * (b.pm25 - a.pm25));
+    *pm10 = (float) (a.pm10 + f * (b.pm10 - a.pm10));
+}
@@ -0,0 +1,36 @@
+//
+// PM2.5/PM10 over time for the simulated SDS011: either recorded, from a CSV file of "seconds,pm25,pm10" lines (other
+// lines, such as a header, are skipped), or a synthetic day of indoor air with cooking spikes and a slow outdoor
+// episode over a noisy baseline. Values between points are interpolated linearly; a recording repeats from its start
+// once it runs out.
+//
+
+#ifndef AIR_SENSORS_SENDER_PMTRACE_H
+#define AIR_SENSORS_SENDER_PMTRACE_H
+
+#include <Arduino.h>
+#include <vector>
+
+typedef struct pm_trace_point {
+    uint32_t seconds;
+    float pm25;
+    float pm10;
+} pm_trace_point_t;
+
+class PmTrace {
+protected:
+    std::vector<pm_trace_point_t> _points;
+
+public:
+    bool load(const char *path);
+
+    // One day, one point every 10 s
+    void synthesize(uint32_t seed);
+
+    void sample(uint64_t nowMs, float *pm25, float *pm10) const;
+
+    uint32_t durationS() const { return _points.empty() ? 0 : _points.back().seconds; }
+};
+
+
+#endif //AIR_SENSORS_SENDER_PMTRACE_H
@@ -0,0 +1,129 @@
+//
+// Publisher for the host simulation
+//
+
+#include "RecordingPublisher.h"
+#include <SampleEncoder.h>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+// Reads a CBOR unsigned integer or text string head, as written by SampleEncoder
+static bool cborHead(const uint8_t *payload, size_t len, size_t *pos, uint8_t *major, uint32_t *value) {
+    if (*pos >= len) {
+        return false;
+    }
+    uint8_t initial = payload[(*pos)++];
+    *major = initial >> 5;
+    uint8_t info = initial & 0x1F;
+    if (info < 24) {
+        *value = info;
+        return true;
+    }
+    size_t bytes = info == 24 ? 1 : info == 25 ? 2 : info == 26 ? 4 : 0;
+    if (bytes == 0 || *pos + bytes > len) {
+        return false;
+    }
+    *value = 0;
+    for (size_t i = 0; i < bytes; i++) {
+        *value = (*value << 8) | payload[(*pos)++];
+    }
+    return true;
+}
+
+bool RecordingPublisher::decode(const uint8_t *payload, size_t len, uint32_t *seq, uint32_t *uptimeMs) const {
+    if (_format == SAMPLE_FORMAT_JSON) {
+        std::string json(reinterpret_cast<const char *>(payload), len);
+        const char *seqAt = strstr(json.c_str(), "\"seq\":");
+        const char *upAt = strstr(json.c_str(), "\"up\":");
+        return seqAt != nullptr && upAt != nullptr && sscanf(seqAt, "\"seq\":%u", seq) == 1 &&
+               sscanf(upAt, "\"up\":%u", uptimeMs) == 1;
+    }
+
+    // "seq", "ts" if set, then "up" are the first entries of the map
+    size_t pos = 0;
+    uint8_t major;
+    uint32_t value;
+    if (!cborHead(payload, len, &pos, &major, &value)) {
+        return false;
+    }
+    bool haveSeq = false;
+    for (int entry = 0; entry < 3; entry++) {
+        if (!cborHead(payload, len, &pos, &major, &value) || major != 3 || pos + value > len) {
+            return false;
+        }
+        const char *key = reinterpret_cast<const char *>(payload + pos);
+        size_t keyLen = value;
+        pos += keyLen;
+        if (!cborHead(payload, len, &pos, &major, &value) || major != 0) {
+            return false;
+        }
+        if (keyLen == 3 && memcmp(key, "seq", 3) == 0) {
+            *seq = value;
+            haveSeq = true;
+        } else if (keyLen == 2 && memcmp(key, "up", 2) == 0) {
+            *uptimeMs = value;
+            return haveSeq;
+        }
+    }
+    return false;
+}
+
+bool RecordingPublisher::connected() {
+    if (_outageEveryMs == 0 || _outageMs == 0) {
+        return true;
+    }
+    // Each period starts with its outage, after the first one
+    uint64_t now = millis();
+    return now < _outageEveryMs || now % _outageEveryMs >= _outageMs;
+}
+
+bool RecordingPublisher::publish(const char *topic, const uint8_t *payload, size_t len, uint8_t qos, bool retain) {
+    (void) topic;
+    (void) retain;
+    if (!connected()) {
+        _stats.rejected++;
+        return false;
+    }
+    _stats.messages++;
+    _stats.bytes += len;
+    if (qos > 0) {
+        _stats.acknowledged++;
+    }
+
+    uint32_t seq;
+    uint32_t uptimeMs;
+    if (!decode(payload, len, &seq, &uptimeMs)) {
+        _stats.undecodable++;
+        return true;
+    }
+    if (seq >= _seen.size()) {
+        _seen.resize(seq + 1, false);
+    }
+    if (_seen[seq]) {
+        _stats.duplicates++;
+    }
+    _seen[seq] = true;
+
+    uint32_t latencyMs = millis() - uptimeMs;
+    _stats.latencySumMs += latencyMs;
+    _stats.latencyMaxMs = latencyMs > _stats.latencyMaxMs ? latencyMs : _stats.latencyMaxMs;
+    _stats.latencyP95.add((float) latencyMs);
+    return true;
+}
+
+uint32_t RecordingPublisher::received() const {
+    uint32_t count = 0;
+    for (bool seen : _seen) {
+        count += seen ? 1 : 0;
+    }
+    return count;
+}
+
+uint32_t RecordingPublisher::missing(uint32_t count) const {
+    uint32_t missing = 0;
+    for (uint32_t seq = 0; seq < count; seq++) {
+        missing += seq < _seen.size() && _seen[seq] ? 0 : 1;
+    }
+    return missing;
+}
@@ -0,0 +1,63 @@
+//
+// Publisher for the host simulation. Messages are not sent anywhere; the sequence number and uptime are read back out
+// of each sample payload (JSON or CBOR, see SampleEncoder.h) to check that every sample arrives, and how late. The
+// connection drops for outageMs every outageEveryMs of simulated time, to exercise buffering and replay.
+//
+
+#ifndef AIR_SENSORS_SENDER_RECORDINGPUBLISHER_H
+#define AIR_SENSORS_SENDER_RECORDINGPUBLISHER_H
+
+#include <Arduino.h>
+#include <P2Quantile.h>
+#include <Publisher.h>
+#include <vector>
+
+typedef struct recording_publisher_stats {
+    uint32_t messages = 0;
+    // QoS 1, i.e. replayed samples
+    uint32_t acknowledged = 0;
+    uint64_t bytes = 0;
+    uint32_t duplicates = 0;
+    uint32_t undecodable = 0;
+    uint32_t rejected = 0;
+    // From taking the sample to handing it to the client, in simulated time
+    uint64_t latencySumMs = 0;
+    uint32_t latencyMaxMs = 0;
+    P2Quantile latencyP95{0.95};
+} recording_publisher_stats_t;
+
+class RecordingPublisher : public Publisher {
+protected:
+    uint8_t _format;
+    uint32_t _outageEveryMs = 0;
+    uint32_t _outageMs = 0;
+    recording_publisher_stats_t _stats;
+    std::vector<bool> _seen;
+
+    bool decode(const uint8_t *payload, size_t len, uint32_t *seq, uint32_t *uptimeMs) const;
+
+public:
+    // `format` is the SAMPLE_FORMAT_* of the payloads
+    explicit RecordingPublisher(uint8_t format) : _format{format} {};
+
+    // No outages if either is 0
+    void setOutages(uint32_t everyMs, uint32_t durationMs) {
+        _outageEveryMs = everyMs;
+        _outageMs = durationMs;
+    }
+
+    bool connected() override;
+
+    bool publish(const char *topic, const uint8_t *payload, size_t len, uint8_t qos, bool retain) override;
+
+    const recording_publisher_stats_t &stats() const { return _stats; }
+
+    // Distinct sequence numbers received
+    uint32_t received() const;
+
+    // Sequence numbers below `count` never received
+    uint32_t missing(uint32_t count) const;
+};
+
+
+#endif //AIR_SENSORS_SENDER_RECORDINGPUBLISHER_H
@@ -0,0 +1,224 @@
+//
+// Stream that behaves like an SDS011 on the other end of the UART, driven by FakeClock
+//
+
+#include <cmath>
+#include "SimulatedSDS011.h"
+
+SimulatedSDS011::SimulatedSDS011(sim_sds011_config_t config) :
+        _config{config}, _nextReportMs{config.reportIntervalMs}, _rng{config.seed != 0 ? config.seed : 1} {
+    _pmSource = [](uint64_t nowMs, float *pm25, float *pm10) {
+        double t = (double) nowMs / 60000.0;
+        *pm25 = (float) (12.0 + 4.0 * sin(t / 7.0));
+        *pm10 = (float) (20.0 + 6.0 * sin(t / 5.0));
+    };
+}
+
+uint32_t SimulatedSDS011::nextRandom() {
+    // xorshift32, so that runs are reproducible for a given seed
+    _rng ^= _rng << 13;
+    _rng ^= _rng >> 17;
+    _rng ^= _rng << 5;
+    return _rng;
+}
+
+bool SimulatedSDS011::chance(float probability) {
+    if (probability <= 0) {
+        return false;
+    }
+    return (float) (nextRandom() % 1000000) < probability * 1000000.0f;
+}
+
+uint32_t SimulatedSDS011::reportPeriodMs() const {
+    if (_workingPeriod == 0) {
+        return _config.reportIntervalMs;
+    }
+    return _workingPeriod * 60 * 1000;
+}
+
+void SimulatedSDS011::update() {
+    uint64_t now = FakeClock::nowMillis();
+
+    if (_reportingMode == SDS011_REPORT_MODE_ACTIVE && _sleepMode == SDS011_SLEEP_MODE_WORK) {
+        while (_nextReportMs <= now) {
+            pending_frame pending{_nextReportMs, {}};
+            buildDataFrame(&pending.frame);
+            _pending.push_back(pending);
+            _nextReportMs += reportPeriodMs();
+        }
+    } else {
+        _nextReportMs = now + reportPeriodMs();
+    }
+
+    while (!_pending.empty() && _pending.front().dueMs <= now) {
+        deliver(&_pending.front().frame);
+        _pending.pop_front();
+    }
+}
+
+void SimulatedSDS011::deliver(const sds011_response_u *frame) {
+    if (chance(_config.noiseProbability)) {
+        uint8_t count = 1 + nextRandom() % (_config.maxNoiseBytes > 0 ? _config.maxNoiseBytes : 1);
+        for (uint8_t i = 0; i < count; i++) {
+            pushByte((uint8_t) nextRandom());
+        }
+        _stats.noiseBytes += count;
+    }
+
+    sds011_response_u out = *frame;
+    if (chance(_config.checksumErrorProbability)) {
+        out.common.checksum ^= (uint8_t) (1 + nextRandom() % 0xFF);
+        _stats.corruptedFrames++;
+    }
+    for (uint8_t byte : out.raw.bytes) {
+        pushByte(byte);
+    }
+
+    if (out.common.commandId == SDS011_RESP_ID_DATA) {
+        _stats.dataFrames++;
+    } else {
+        _stats.replyFrames++;
+    }
+}
+
+void SimulatedSDS011::pushByte(uint8_t byte) {
+    if (_rx.size() >= _config.rxBufferSize) {
+        _rx.pop_front();
+        _stats.droppedBytes++;
+    }
+    _rx.push_back(byte);
+}
+
+void SimulatedSDS011::finishFrame(sds011_response_u *frame) {
+    frame->common.head = SDS011_HEAD;
+    uint16_t accum = 0;
+    for (size_t i = 2; i < 8; i++) {
+        accum += frame->raw.bytes[i];
+    }
+    frame->common.checksum = accum & 0xFF;
+    frame->common.tail = SDS011_TAIL;
+}
+
+void SimulatedSDS011::buildDataFrame(sds011_response_u *frame) {
+    float pm25 = 0, pm10 = 0;
+    if (_pmSource) {
+        _pmSource(FakeClock::nowMillis(), &pm25, &pm10);
+    }
+    frame->query.commandId = SDS011_RESP_ID_DATA;
+    frame->query.pm25 = (uint16_t) lroundf(pm25 * 10);
+    frame->query.pm10 = (uint16_t) lroundf(pm10 * 10);
+    frame->query.deviceId = _config.deviceId;
+    finishFrame(frame);
+}
+
+void SimulatedSDS011::buildReplyFrame(sds011_response_u *frame, uint8_t command, uint8_t operation, uint8_t setting,
+                                      uint8_t reserved) {
+    frame->setting.commandId = SDS011_RESP_ID_REPLY;
+    frame->setting.command = command;
+    frame->setting.operation = operation;
+    frame->setting.setting = setting;
+    frame->setting.reserved = reserved;
+    frame->setting.deviceId = _config.deviceId;
+    finishFrame(frame);
+}
+
+void SimulatedSDS011::handleCommand(const sds011_command_u *cmd) {
+    _stats.commandsReceived++;
+
+    uint16_t target = cmd->setting.sensorID;
+    if (target != SDS011_ANY && target != _config.deviceId) {
+        return;
+    }
+    // A sleeping sensor only listens for the wake up command
+    if (_sleepMode == SDS011_SLEEP_MODE_SLEEP && cmd->setting.command != SDS011_CMD_SLEEP_WORK) {
+        return;
+    }
+
+    pending_frame pending{FakeClock::nowMillis() + _config.responseLatencyMs, {}};
+    bool set = cmd->setting.operation == SDS011_OPERATION_SET;
+
+    switch (cmd->setting.command) {
+        case SDS011_CMD_DATA_REPORTING:
+            if (set) {
+                _reportingMode = cmd->setting.setting;
+            }
+            buildReplyFrame(&pending.frame, SDS011_CMD_DATA_REPORTING, cmd->setting.operation, _reportingMode, 0);
+            break;
+        case SDS011_CMD_QUERY:
+            buildDataFrame(&pending.frame);
+            break;
+        case SDS011_CMD_DEV_ID:
+            _config.deviceId = cmd->set_dev_id.newDeviceIdBE;
+            buildReplyFrame(&pending.frame, SDS011_CMD_DEV_ID, 0, 0, 0);
+            break;
+        case SDS011_CMD_SLEEP_WORK:
+            if (set) {
+                _sleepMode = cmd->setting.setting;
+            }
+            buildReplyFrame(&pending.frame, SDS011_CMD_SLEEP_WORK, cmd->setting.operation, _sleepMode, 0);
+            break;
+        case SDS011_CMD_WORK_PERIOD:
+            if (set) {
+                _workingPeriod = cmd->setting.setting;
+            }
+            buildReplyFrame(&pending.frame, SDS011_CMD_WORK_PERIOD, cmd->setting.operation, _workingPeriod, 0);
+            break;
+        case SDS011_CMD_VERSION:
+            // Firmware 18-11-16, the version shipped on most units
+            buildReplyFrame(&pending.frame, SDS011_CMD_VERSION, 18, 11, 16);
+            break;
+        default:
+            _stats.invalidCommands++;
+            return;
+    }
+    _pending.push_back(pending);
+}
+
+size_t SimulatedSDS011::write(uint8_t byte) {
+    if (_cmdLen == 0 && byte != SDS011_HEAD) {
+        _stats.invalidCommands++;
+        return 1;
+    }
+    _cmdBuf[_cmdLen++] = byte;
+    if (_cmdLen < sizeof(_cmdBuf)) {
+        return 1;
+    }
+    _cmdLen = 0;
+
+    sds011_command_u cmd;
+    memcpy(cmd.raw.bytes, _cmdBuf, sizeof(cmd.raw.bytes));
+    uint16_t accum = 0;
+    for (size_t i = 2; i < 17; i++) {
+        accum += cmd.raw.bytes[i];
+    }
+    if (cmd.common.commandId != SDS011_CMD_ID || cmd.common.tail != SDS011_TAIL ||
+        cmd.common.checksum != (accum & 0xFF)) {
+        _stats.invalidCommands++;
+        return 1;
+    }
+    handleCommand(&cmd);
+    return 1;
+}
+
+int SimulatedSDS011::available() {
+    update();
+    return (int) _rx.size();
+}
+
+int SimulatedSDS011::read() {
+    update();
+    if (_rx.empty()) {
+        return -1;
+    }
+    uint8_t byte = _rx.front();
+    _rx.pop_front();
+    return byte;
+}
+
+int SimulatedSDS011::peek() {
+    update();
+    if (_rx.empty()) {
+        return -1;
+    }
+    return _rx.front();
+}
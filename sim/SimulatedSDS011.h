@@ -0,0 +1,115 @@
+//
+// Stream that behaves like an SDS011 on the other end of the UART, driven by FakeClock.
+//
+// Commands written to the stream are answered after a configurable latency. In active reporting mode a data frame is
+// emitted every reportIntervalMs (or every working period minutes, if one is set). Garbage bytes and frames with a
+// broken checksum can be injected with a given probability to exercise resynchronisation.
+//
+
+#ifndef AIR_SENSORS_SENDER_SIMULATEDSDS011_H
+#define AIR_SENSORS_SENDER_SIMULATEDSDS011_H
+
+#include <Arduino.h>
+#include <deque>
+#include <functional>
+#include <SDS011.h>
+
+typedef struct sim_sds011_config {
+    uint16_t deviceId = 0xA1B2;
+    uint32_t reportIntervalMs = 1000;
+    uint32_t responseLatencyMs = 20;
+    // Probabilities in [0, 1]
+    float noiseProbability = 0;
+    uint8_t maxNoiseBytes = 8;
+    float checksumErrorProbability = 0;
+    // Bytes the UART can buffer before the oldest ones are lost, like the SoftwareSerial RX buffer
+    size_t rxBufferSize = 64;
+    uint32_t seed = 1;
+} sim_sds011_config_t;
+
+typedef struct sim_sds011_stats {
+    uint32_t dataFrames = 0;
+    uint32_t replyFrames = 0;
+    uint32_t corruptedFrames = 0;
+    uint32_t noiseBytes = 0;
+    uint32_t droppedBytes = 0;
+    uint32_t commandsReceived = 0;
+    uint32_t invalidCommands = 0;
+} sim_sds011_stats_t;
+
+// Returns PM2.5 and PM10 in µg/m³ for the given simulated time
+typedef std::function<void(uint64_t nowMs, float *pm25, float *pm10)> sim_sds011_pm_source_t;
+
+class SimulatedSDS011 : public Stream {
+protected:
+    sim_sds011_config_t _config;
+    sim_sds011_stats_t _stats;
+    sim_sds011_pm_source_t _pmSource = nullptr;
+
+    // Device state, as set through commands
+    uint8_t _reportingMode = SDS011_REPORT_MODE_ACTIVE;
+    uint8_t _sleepMode = SDS011_SLEEP_MODE_WORK;
+    uint8_t _workingPeriod = 0;
+
+    uint8_t _cmdBuf[sizeof(sds011_command_raw_t)] = {0};
+    size_t _cmdLen = 0;
+
+    // Frames waiting for their scheduled delivery time
+    struct pending_frame {
+        uint64_t dueMs;
+        sds011_response_u frame;
+    };
+    std::deque<pending_frame> _pending;
+    std::deque<uint8_t> _rx;
+    uint64_t _nextReportMs;
+    uint32_t _rng;
+
+    uint32_t nextRandom();
+
+    bool chance(float probability);
+
+    void update();
+
+    void deliver(const sds011_response_u *frame);
+
+    void pushByte(uint8_t byte);
+
+    void handleCommand(const sds011_command_u *cmd);
+
+    void buildDataFrame(sds011_response_u *frame);
+
+    void buildReplyFrame(sds011_response_u *frame, uint8_t command, uint8_t operation, uint8_t setting,
+                         uint8_t reserved);
+
+    static void finishFrame(sds011_response_u *frame);
+
+    uint32_t reportPeriodMs() const;
+
+public:
+    explicit SimulatedSDS011(sim_sds011_config_t config = sim_sds011_config_t());
+
+    void setPmSource(sim_sds011_pm_source_t source) { _pmSource = source; }
+
+    const sim_sds011_stats_t &stats() const { return _stats; }
+
+    const sim_sds011_config_t &config() const { return _config; }
+
+    uint8_t reportingMode() const { return _reportingMode; }
+
+    uint8_t sleepMode() const { return _sleepMode; }
+
+    uint8_t workingPeriod() const { return _workingPeriod; }
+
+    int available() override;
+
+    int read() override;
+
+    int peek() override;
+
+    size_t write(uint8_t byte) override;
+
+    using Print::write;
+};
+
+
+#endif //AIR_SENSORS_SENDER_SIMULATEDSDS011_H
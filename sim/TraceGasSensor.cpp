@@ -0,0 +1,96 @@
+//
+// GasSensor replaying a trace for the host simulation
+//
+
+#include <cmath>
+#include <cstdio>
+#include "TraceGasSensor.h"
+
+bool TraceGasSensor::load(const char *path) {
+    FILE *file = fopen(path, "r");
+    if (file == nullptr) {
+        return false;
+    }
+    _points.clear();
+    char line[160];
+    while (fgets(line, sizeof(line), file) != nullptr) {
+        gas_trace_point_t point;
+        unsigned long seconds;
+        unsigned accuracy;
+        if (sscanf(line, "%lu,%f,%f,%f,%f,%f,%u", &seconds, &point.temperature, &point.humidity, &point.pressure,
+                   &point.gasResistance, &point.iaq, &accuracy) != 7) {
+            continue;
+        }
+        point.seconds = (uint32_t) seconds;
+        point.iaqAccuracy = (uint8_t) (accuracy > 3 ? 3 : accuracy);
+        if (!_points.empty() && point.seconds <= _points.back().seconds) {
+            continue;
+        }
+        _points.push_back(point);
+    }
+    fclose(file);
+    _index = 0;
+    return _points.size() >= 2;
+}
+
+void TraceGasSensor::synthesize(const PmTrace &pm) {
+    _points.clear();
+    uint32_t duration = pm.durationS() > 0 ? pm.durationS() : 24 * 3600;
+    for (uint32_t s = 0; s <= duration; s += 10) {
+        float pm25, pm10;
+        pm.sample((uint64_t) s * 1000, &pm25, &pm10);
+        double day = 2 * M_PI * s / 86400;
+        gas_trace_point_t point;
+        point.seconds = s;
+        point.temperature = (float) (21 - 1.5 * cos(day));
+        point.humidity = (float) (45 + 5 * cos(day));
+        point.pressure = 101325;
+        // Cooking shows in the VOCs as much as in the particles
+        point.iaq = fminf(25 + 1.5f * pm25, 500);
+        point.gasResistance = 200000 / (1 + point.iaq / 50);
+        // BSEC reaches full accuracy after a few hours of stable operation
+        point.iaqAccuracy = s < 3600 ? 1 : s < 4 * 3600 ? 2 : 3;
+        _points.push_back(point);
+    }
+    _index = 0;
+}
+
+const gas_trace_point_t &TraceGasSensor::at(uint64_t nowMs) {
+    uint32_t t = (uint32_t) ((nowMs / 1000) % ((uint64_t) durationS() + 1));
+    if (_index >= _points.size() || _points[_index].seconds > t) {
+        _index = 0;
+    }
+    while (_index + 1 < _points.size() && _points[_index + 1].seconds <= t) {
+        _index++;
+    }
+    return _points[_index];
+}
+
+bool TraceGasSensor::run(int64_t timeMs) {
+    int64_t nowMs = timeMs >= 0 ? timeMs : (int64_t) millis();
+    if (_points.empty() || nowMs < _nextMs) {
+        return false;
+    }
+    _nextMs = nowMs + _intervalMs;
+
+    const gas_trace_point_t &point = at((uint64_t) nowMs);
+    // The heater warms the sensor a little above the room
+    _output.rawTemperature = point.temperature + 1.5f;
+    _output.temperature = point.temperature;
+    _output.pressure = point.pressure;
+    _output.rawHumidity = point.humidity - 4;
+    _output.humidity = point.humidity;
+    _output.gasResistance = point.gasResistance;
+    _output.iaq = point.iaq;
+    _output.staticIaq = point.iaq;
+    _output.co2Equivalent = 500 + 5 * point.iaq;
+    _output.breathVocEquivalent = 0.5f + point.iaq / 50;
+    _output.iaqAccuracy = point.iaqAccuracy;
+    _output.staticIaqAccuracy = point.iaqAccuracy;
+    _output.co2Accuracy = point.iaqAccuracy;
+    _output.breathVocAccuracy = point.iaqAccuracy;
+    _output.runInDone = true;
+    _output.stabilizationDone = true;
+    _outputs++;
+    return true;
+}
@@ -0,0 +1,59 @@
+//
+// GasSensor for the host simulation: replays BSEC outputs from a CSV file of
+// "seconds,temperature,humidity,pressure,gas_resistance,iaq,iaq_accuracy" lines (°C, %, Pa, Ω; other lines, such as
+// a header, are skipped), or derives them from a PM trace, with IAQ following PM2.5 over a daily temperature and
+// humidity cycle. A new output is due every intervalMs, like BSEC at LP; each one holds the last point at or before
+// its time. A recording repeats from its start once it runs out.
+//
+// The outputs a trace does not have are filled in roughly the way BSEC relates them: static IAQ as IAQ, and CO2 and
+// breath VOC equivalents growing with it.
+//
+
+#ifndef AIR_SENSORS_SENDER_TRACEGASSENSOR_H
+#define AIR_SENSORS_SENDER_TRACEGASSENSOR_H
+
+#include <Arduino.h>
+#include <GasSensor.h>
+#include <vector>
+#include "PmTrace.h"
+
+typedef struct gas_trace_point {
+    uint32_t seconds;
+    float temperature;
+    float humidity;
+    float pressure;
+    float gasResistance;
+    float iaq;
+    uint8_t iaqAccuracy;
+} gas_trace_point_t;
+
+class TraceGasSensor : public GasSensor {
+protected:
+    uint32_t _intervalMs;
+    std::vector<gas_trace_point_t> _points;
+    size_t _index = 0;
+    int64_t _nextMs = 0;
+    gas_sensor_output_t _output = {};
+    uint32_t _outputs = 0;
+
+    const gas_trace_point_t &at(uint64_t nowMs);
+
+public:
+    explicit TraceGasSensor(uint32_t intervalMs) : _intervalMs{intervalMs} {};
+
+    bool load(const char *path);
+
+    // One point every 10 s over the length of `pm`
+    void synthesize(const PmTrace &pm);
+
+    bool run(int64_t timeMs) override;
+
+    const gas_sensor_output_t &output() const override { return _output; }
+
+    uint32_t outputs() const { return _outputs; }
+
+    uint32_t durationS() const { return _points.empty() ? 0 : _points.back().seconds; }
+};
+
+
+#endif //AIR_SENSORS_SENDER_TRACEGASSENSOR_H
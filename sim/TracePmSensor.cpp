@@ -0,0 +1,21 @@
+//
+// PmSensor replaying a trace for the host simulation
+//
+
+#include "TracePmSensor.h"
+
+void TracePmSensor::loop() {
+    uint64_t now = millis();
+    if (now < _nextMs) {
+        return;
+    }
+    _nextMs = now + _periodMs;
+
+    _trace->sample(now, &_lastReading.pm25, &_lastReading.pm10);
+    _lastReading.deviceId = _deviceId;
+    _haveReading = true;
+    _lastReadingMs = now;
+    if (_pmDataCallback) {
+        _pmDataCallback(&_lastReading);
+    }
+}
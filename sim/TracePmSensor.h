@@ -0,0 +1,39 @@
+//
+// PmSensor for the host simulation: reports the PM of a trace every periodMs, like an SDS011 with a working period,
+// without going through the serial protocol. Run the real ParticulateSensor against a SimulatedSDS011 for that.
+//
+
+#ifndef AIR_SENSORS_SENDER_TRACEPMSENSOR_H
+#define AIR_SENSORS_SENDER_TRACEPMSENSOR_H
+
+#include <Arduino.h>
+#include <PmSensor.h>
+#include "PmTrace.h"
+
+class TracePmSensor : public PmSensor {
+protected:
+    const PmTrace *_trace;
+    uint32_t _periodMs;
+    uint16_t _deviceId;
+    uint64_t _nextMs;
+    sds011_pm_data_t _lastReading = {};
+    bool _haveReading = false;
+    unsigned long _lastReadingMs = 0;
+    sds011_pm_data_callback_t _pmDataCallback = nullptr;
+
+public:
+    TracePmSensor(const PmTrace *trace, uint32_t periodMs, uint16_t deviceId)
+            : _trace{trace}, _periodMs{periodMs}, _deviceId{deviceId}, _nextMs{periodMs} {};
+
+    void loop() override;
+
+    void onPmData(sds011_pm_data_callback_t callback) override { _pmDataCallback = callback; }
+
+    const sds011_pm_data_t *lastReading() const override { return _haveReading ? &_lastReading : nullptr; }
+
+    // Like ParticulateSensor: reported within the last two periods
+    bool online(unsigned long now) const override { return _haveReading && now - _lastReadingMs < 2 * _periodMs; }
+};
+
+
+#endif //AIR_SENSORS_SENDER_TRACEPMSENSOR_H
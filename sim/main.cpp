@@ -0,0 +1,615 @@
+//
+// Host simulation runner: drives the SDS011 driver against simulated sensors on the fake clock, one per serial port,
+// and reports how many frames made it through and how long each loop took in wall-clock time.
+//
+// With --adaptive 1 it runs one unit in query mode with AdaptivePolling instead, on the PM of --trace (a CSV file of
+// "seconds,pm25,pm10", see PmTrace.h) or a synthetic day, and compares the sensor-on time and the error of the last
+// reading against the trace, second by second, with the firmware's default of working period 1 (30 s on per minute).
+//
+// With --low-power 1 it runs the deep sleep duty cycle of LowPowerCycle instead, and reports how long each wake takes
+// and the resulting average supply current. --wifi-ms is how long a measurement wake needs to connect and publish,
+// counted from the moment the ESP8266 wakes up.
+//
+// With --pipeline 1 it runs the sampling pipeline end to end instead: gas sensor and PM readings are merged into
+// combined samples by SamplePipeline, published through a Publisher that drops the connection for --outage-s every
+// --outage-every-s, buffered meanwhile in a SampleBuffer that spills to RAM, and replayed. The gas sensor replays
+// --gas-trace (see TraceGasSensor.h) or follows the PM trace; PM comes from the trace directly, or with --pm-serial 1
+// through the SDS011 driver and a simulated unit. It reports whether every sample arrived, how late, and the
+// wall-clock cost of each step.
+//
+// Usage: program [--seconds N] [--loop-ms N] [--noise P] [--checksum-errors P] [--seed N] [--sensors N]
+//                [--low-power 0|1] [--wifi-ms N] [--battery-mah N]
+//                [--adaptive 0|1] [--trace FILE] [--min-interval-s N] [--max-interval-s N]
+//                [--pipeline 0|1] [--gas-trace FILE] [--format json|cbor] [--outage-every-s N] [--outage-s N]
+//                [--pm-serial 0|1]
+//
+
+#include <Arduino.h>
+#include <HomieLogger.h>
+#include <SDS011.h>
+#include <ParticulateSensor.h>
+#include <LowPowerCycle.h>
+#include <AdaptivePolling.h>
+#include <P2Quantile.h>
+#include <SampleBuffer.h>
+#include <SampleEncoder.h>
+#include <SamplePipeline.h>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <vector>
+#include "SimulatedSDS011.h"
+#include "PmTrace.h"
+#include "MemorySampleSpill.h"
+#include "RecordingPublisher.h"
+#include "TraceGasSensor.h"
+#include "TracePmSensor.h"
+
+typedef struct sim_options {
+    uint32_t seconds = 3600;
+    uint32_t loopMs = 10;
+    float noise = 0.05;
+    float checksumErrors = 0.01;
+    uint32_t seed = 1;
+    uint32_t sensors = 1;
+    bool lowPower = false;
+    uint32_t wifiMs = 2500;
+    uint32_t batteryMah = 2500;
+    bool adaptive = false;
+    const char *trace = nullptr;
+    uint32_t minIntervalS = 60;
+    uint32_t maxIntervalS = 15 * 60;
+    bool pipeline = false;
+    const char *gasTrace = nullptr;
+    uint8_t format = SAMPLE_FORMAT_CBOR;
+    uint32_t outageEveryS = 3600;
+    uint32_t outageS = 300;
+    bool pmSerial = false;
+} sim_options_t;
+
+// Supply current of each part in mA, from the datasheets (ESP8266EX, SDS011 V1.3, BME680) where they give one. The
+// board's regulator and USB-serial chip are not included.
+#define SIM_CURRENT_ESP_DEEP_SLEEP_MA 0.02
+// CPU running, radio off
+#define SIM_CURRENT_ESP_AWAKE_MA 15.0
+// Average while associating, connecting to the broker and publishing; transmit peaks are around 170 mA
+#define SIM_CURRENT_ESP_RADIO_MA 80.0
+#define SIM_CURRENT_SDS_WORK_MA 70.0
+// Datasheet upper bound, with fan and laser off
+#define SIM_CURRENT_SDS_SLEEP_MA 4.0
+#define SIM_CURRENT_BME680_ULP_MA 0.09
+#define SIM_CURRENT_BME680_LP_MA 0.9
+
+// From the RTC timer firing to setup(): ROM bootloader and SDK start-up
+#define SIM_BOOT_MS 150
+
+static bool parseOptions(int argc, char **argv, sim_options_t *opts) {
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 >= argc) {
+            return false;
+        }
+        const char *value = argv[++i];
+        if (strcmp(argv[i - 1], "--seconds") == 0) {
+            opts->seconds = strtoul(value, nullptr, 10);
+        } else if (strcmp(argv[i - 1], "--loop-ms") == 0) {
+            opts->loopMs = strtoul(value, nullptr, 10);
+        } else if (strcmp(argv[i - 1], "--noise") == 0) {
+            opts->noise = strtof(value, nullptr);
+        } else if (strcmp(argv[i - 1], "--checksum-errors") == 0) {
+            opts->checksumErrors = strtof(value, nullptr);
+        } else if (strcmp(argv[i - 1], "--seed") == 0) {
+            opts->seed = strtoul(value, nullptr, 10);
+        } else if (strcmp(argv[i - 1], "--sensors") == 0) {
+            opts->sensors = strtoul(value, nullptr, 10);
+        } else if (strcmp(argv[i - 1], "--low-power") == 0) {
+            opts->lowPower = strtoul(value, nullptr, 10) != 0;
+        } else if (strcmp(argv[i - 1], "--wifi-ms") == 0) {
+            opts->wifiMs = strtoul(value, nullptr, 10);
+        } else if (strcmp(argv[i - 1], "--battery-mah") == 0) {
+            opts->batteryMah = strtoul(value, nullptr, 10);
+        } else if (strcmp(argv[i - 1], "--adaptive") == 0) {
+            opts->adaptive = strtoul(value, nullptr, 10) != 0;
+        } else if (strcmp(argv[i - 1], "--trace") == 0) {
+            opts->trace = value;
+        } else if (strcmp(argv[i - 1], "--min-interval-s") == 0) {
+            opts->minIntervalS = strtoul(value, nullptr, 10);
+        } else if (strcmp(argv[i - 1], "--max-interval-s") == 0) {
+            opts->maxIntervalS = strtoul(value, nullptr, 10);
+        } else if (strcmp(argv[i - 1], "--pipeline") == 0) {
+            opts->pipeline = strtoul(value, nullptr, 10) != 0;
+        } else if (strcmp(argv[i - 1], "--gas-trace") == 0) {
+            opts->gasTrace = value;
+        } else if (strcmp(argv[i - 1], "--format") == 0) {
+            if (strcmp(value, "json") == 0) {
+                opts->format = SAMPLE_FORMAT_JSON;
+            } else if (strcmp(value, "cbor") == 0) {
+                opts->format = SAMPLE_FORMAT_CBOR;
+            } else {
+                return false;
+            }
+        } else if (strcmp(argv[i - 1], "--outage-every-s") == 0) {
+            opts->outageEveryS = strtoul(value, nullptr, 10);
+        } else if (strcmp(argv[i - 1], "--outage-s") == 0) {
+            opts->outageS = strtoul(value, nullptr, 10);
+        } else if (strcmp(argv[i - 1], "--pm-serial") == 0) {
+            opts->pmSerial = strtoul(value, nullptr, 10) != 0;
+        } else {
+            return false;
+        }
+    }
+    return opts->loopMs > 0 && opts->sensors > 0;
+}
+
+typedef struct sim_wake_stats {
+    uint32_t wakes = 0;
+    uint64_t totalMs = 0;
+    uint64_t maxMs = 0;
+
+    void record(uint64_t ms) {
+        wakes++;
+        totalMs += ms;
+        if (ms > maxMs) {
+            maxMs = ms;
+        }
+    }
+
+    uint64_t meanMs() const { return wakes > 0 ? totalMs / wakes : 0; }
+} sim_wake_stats_t;
+
+// Deep sleep duty cycle, with the firmware's defaults: a measurement every 5 minutes (BSEC's ULP rate) after 30 s of
+// SDS011 warm-up. The simulated units keep running through the ESP8266's deep sleep; everything else is set up again
+// on every wake, like on the device.
+static int runLowPower(const sim_options_t &opts) {
+    const low_power_config_t config = {300 * 1000, 30 * 1000, 20 * 1000};
+
+    std::vector<std::unique_ptr<SimulatedSDS011>> devices;
+    for (uint32_t i = 0; i < opts.sensors; i++) {
+        sim_sds011_config_t deviceConfig;
+        deviceConfig.deviceId = 0xA1B2 + i;
+        deviceConfig.noiseProbability = opts.noise;
+        deviceConfig.checksumErrorProbability = opts.checksumErrors;
+        deviceConfig.seed = opts.seed + i;
+        devices.emplace_back(new SimulatedSDS011(deviceConfig));
+    }
+    // Everything but the ESP8266
+    auto peripheralsMa = [&devices]() {
+        double ma = SIM_CURRENT_BME680_ULP_MA;
+        for (const auto &device : devices) {
+            ma += device->sleepMode() == SDS011_SLEEP_MODE_WORK ? SIM_CURRENT_SDS_WORK_MA : SIM_CURRENT_SDS_SLEEP_MA;
+        }
+        return ma;
+    };
+
+    low_power_state_t state = {};
+    // A cold boot has the radio on
+    bool radio = true;
+    double chargeMaMs = 0;
+    uint32_t readings = 0;
+    sim_wake_stats_t warmupWakes;
+    sim_wake_stats_t measureWakes;
+    uint64_t endMs = (uint64_t) opts.seconds * 1000;
+
+    while (FakeClock::nowMillis() < endMs) {
+        uint64_t wakeStartMs = FakeClock::nowMillis();
+        double espMa = radio ? SIM_CURRENT_ESP_RADIO_MA : SIM_CURRENT_ESP_AWAKE_MA;
+        chargeMaMs += (espMa + peripheralsMa()) * SIM_BOOT_MS;
+        FakeClock::advanceMillis(SIM_BOOT_MS);
+
+        std::vector<std::unique_ptr<SDS011>> buses;
+        std::vector<std::unique_ptr<ParticulateSensor>> sensors;
+        std::vector<ParticulateSensor *> sensorPtrs;
+        for (uint32_t i = 0; i < opts.sensors; i++) {
+            buses.emplace_back(new SDS011(devices[i].get()));
+            sensors.emplace_back(new ParticulateSensor(buses.back().get(), devices[i]->config().deviceId, 0));
+            sensors.back()->onPmData([&readings](const sds011_pm_data_t *) { readings++; });
+            sensorPtrs.push_back(sensors.back().get());
+        }
+
+        bool sleeping = false;
+        uint32_t sleepMs = 0;
+        bool nextRadio = false;
+        LowPowerCycle cycle(config, sensorPtrs.data(), (uint8_t) sensorPtrs.size());
+        cycle.onReady([&opts, wakeStartMs]() { return FakeClock::nowMillis() - wakeStartMs >= opts.wifiMs; });
+        cycle.onSleep([&](uint32_t ms, bool r) {
+            sleeping = true;
+            sleepMs = ms;
+            nextRadio = r;
+        });
+        cycle.begin(&state);
+        low_power_phase_t phase = cycle.phase();
+
+        while (!sleeping) {
+            chargeMaMs += (espMa + peripheralsMa()) * opts.loopMs;
+            FakeClock::advanceMillis(opts.loopMs);
+            for (auto &bus : buses) {
+                bus->poll();
+            }
+            cycle.loop();
+        }
+
+        uint64_t awakeMs = FakeClock::nowMillis() - wakeStartMs;
+        (phase == LOW_POWER_PHASE_WARMUP ? warmupWakes : measureWakes).record(awakeMs);
+        state = cycle.state();
+        radio = nextRadio;
+
+        chargeMaMs += (SIM_CURRENT_ESP_DEEP_SLEEP_MA + peripheralsMa()) * sleepMs;
+        FakeClock::advanceMillis(sleepMs);
+    }
+
+    double elapsedMs = (double) FakeClock::nowMillis();
+    double averageMa = elapsedMs > 0 ? chargeMaMs / elapsedMs : 0;
+    double alwaysOnMa = SIM_CURRENT_ESP_RADIO_MA + opts.sensors * SIM_CURRENT_SDS_WORK_MA + SIM_CURRENT_BME680_LP_MA;
+    uint32_t expectedReadings = measureWakes.wakes * opts.sensors;
+
+    printf("simulated_seconds=%u sensors=%u wifi_ms=%u cycles=%u timeouts=%u configured=%d\n", opts.seconds,
+           opts.sensors, opts.wifiMs, state.cycles, state.timeouts, state.configured);
+    printf("warmup_wakes=%u warmup_wake_mean_ms=%llu warmup_wake_max_ms=%llu\n", warmupWakes.wakes,
+           (unsigned long long) warmupWakes.meanMs(), (unsigned long long) warmupWakes.maxMs);
+    printf("measure_wakes=%u measure_wake_mean_ms=%llu measure_wake_max_ms=%llu readings=%u/%u\n",
+           measureWakes.wakes, (unsigned long long) measureWakes.meanMs(), (unsigned long long) measureWakes.maxMs,
+           readings, expectedReadings);
+    printf("average_current_ma=%.2f always_on_current_ma=%.1f battery_mah=%u battery_days=%.1f\n", averageMa,
+           alwaysOnMa, opts.batteryMah, averageMa > 0 ? opts.batteryMah / averageMa / 24 : 0.0);
+
+    return state.timeouts == 0 && state.configured ? 0 : 1;
+}
+
+// Error of the last reading against the trace, sampled every second
+typedef struct sim_error_stats {
+    uint32_t count = 0;
+    double sum = 0;
+    float max = 0;
+    P2Quantile p95{0.95};
+
+    void add(float error) {
+        count++;
+        sum += error;
+        max = error > max ? error : max;
+        p95.add(error);
+    }
+
+    double mean() const { return count > 0 ? sum / count : 0; }
+} sim_error_stats_t;
+
+// Adaptive query-mode sampling against working period 1, with the firmware's defaults unless overridden
+static int runAdaptive(const sim_options_t &opts) {
+    const adaptive_polling_config_t config = {opts.minIntervalS * 1000, opts.maxIntervalS * 1000, 30 * 1000, 2.0, 0.1};
+    // SDS011 working period 1: the fan runs for 30 s, then the unit reports and sleeps for the rest of the minute
+    const uint32_t fixedPeriodS = 60;
+    const uint32_t fixedWorkS = 30;
+
+    PmTrace trace;
+    if (opts.trace != nullptr) {
+        if (!trace.load(opts.trace)) {
+            fprintf(stderr, "Cannot read a trace of at least two points from %s\n", opts.trace);
+            return 2;
+        }
+    } else {
+        trace.synthesize(opts.seed);
+    }
+
+    sim_sds011_config_t deviceConfig;
+    deviceConfig.noiseProbability = opts.noise;
+    deviceConfig.checksumErrorProbability = opts.checksumErrors;
+    deviceConfig.seed = opts.seed;
+    SimulatedSDS011 device(deviceConfig);
+    device.setPmSource([&trace](uint64_t nowMs, float *pm25, float *pm10) { trace.sample(nowMs, pm25, pm10); });
+
+    SDS011 bus(&device);
+    ParticulateSensor sensor(&bus, deviceConfig.deviceId, 0);
+    AdaptivePolling polling(config, &sensor);
+    bool haveReading = false;
+    float reading = 0;
+    float peakRead = 0;
+    sensor.onPmData([&](const sds011_pm_data_t *data) {
+        haveReading = true;
+        reading = data->pm25;
+        peakRead = data->pm25 > peakRead ? data->pm25 : peakRead;
+    });
+    // Reports of an unconfigured unit, before it is in query mode, are not readings the policy asked for
+    bus.onPmData([&sensor](const sds011_pm_data_t *data) { sensor.handlePmData(data); });
+
+    sim_error_stats_t adaptiveError;
+    sim_error_stats_t fixedError;
+    float peakTrue = 0;
+    float peakFixed = 0;
+    uint64_t endMs = (uint64_t) opts.seconds * 1000;
+    uint64_t nextSecondMs = 1000;
+    while (FakeClock::nowMillis() < endMs) {
+        FakeClock::advanceMillis(opts.loopMs);
+        bus.poll();
+        polling.loop();
+
+        for (; nextSecondMs <= FakeClock::nowMillis(); nextSecondMs += 1000) {
+            float pm25, pm10;
+            trace.sample(nextSecondMs, &pm25, &pm10);
+            peakTrue = pm25 > peakTrue ? pm25 : peakTrue;
+            if (haveReading) {
+                adaptiveError.add(fabsf(reading - pm25));
+            }
+
+            uint64_t s = nextSecondMs / 1000;
+            if (s >= fixedWorkS) {
+                float fixed, fixed10;
+                trace.sample((((s - fixedWorkS) / fixedPeriodS) * fixedPeriodS + fixedWorkS) * 1000, &fixed, &fixed10);
+                peakFixed = fixed > peakFixed ? fixed : peakFixed;
+                fixedError.add(fabsf(fixed - pm25));
+            }
+        }
+    }
+
+    double elapsedS = (double) FakeClock::nowMillis() / 1000;
+    double adaptiveOnPct = 100.0 * (double) polling.onTimeMs() / 1000 / elapsedS;
+    double fixedOnPct = 100.0 * fixedWorkS / fixedPeriodS;
+    // The laser is rated for about 8000 h of operation
+    auto lifeYears = [](double onPct) { return onPct > 0 ? 8000 / (onPct / 100) / (365.0 * 24) : 0.0; };
+
+    printf("simulated_seconds=%u trace=%s trace_seconds=%u min_interval_s=%u max_interval_s=%u\n", opts.seconds,
+           opts.trace != nullptr ? opts.trace : "synthetic", trace.durationS(), opts.minIntervalS, opts.maxIntervalS);
+    printf("samples=%u mean_interval_s=%.1f failures=%u\n", polling.samples(),
+           polling.samples() > 0 ? elapsedS / polling.samples() : 0.0, polling.failures());
+    printf("sensor_on_pct adaptive=%.1f fixed=%.1f saved_vs_fixed_pct=%.1f laser_life_years adaptive=%.1f fixed=%.1f\n",
+           adaptiveOnPct, fixedOnPct, 100.0 * (1 - adaptiveOnPct / fixedOnPct), lifeYears(adaptiveOnPct),
+           lifeYears(fixedOnPct));
+    printf("pm25_error adaptive mean=%.2f p95=%.2f max=%.2f fixed mean=%.2f p95=%.2f max=%.2f\n", adaptiveError.mean(),
+           adaptiveError.p95.value(), adaptiveError.max, fixedError.mean(), fixedError.p95.value(), fixedError.max);
+    printf("pm25_peak true=%.1f adaptive=%.1f fixed=%.1f\n", peakTrue, peakRead, peakFixed);
+
+    return polling.failures() == 0 && polling.samples() > 0 ? 0 : 1;
+}
+
+// Wall-clock time of one step, in ns
+typedef struct sim_step_stats {
+    uint64_t count = 0;
+    uint64_t totalNs = 0;
+    uint64_t maxNs = 0;
+
+    void record(uint64_t ns) {
+        count++;
+        totalNs += ns;
+        maxNs = ns > maxNs ? ns : maxNs;
+    }
+
+    uint64_t meanNs() const { return count > 0 ? totalNs / count : 0; }
+} sim_step_stats_t;
+
+static uint64_t wallNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// The sampling pipeline on fakes, with the firmware's defaults: BSEC at LP, a 64-sample RAM ring spilling up to 2048
+// samples, replay of 5 samples every second, and an SDS011 working period of one minute
+static int runPipeline(const sim_options_t &opts) {
+    const uint32_t gasIntervalMs = 3000;
+    const uint32_t pmPeriodMs = 60 * 1000;
+    const uint32_t replayIntervalMs = 1000;
+    // SNTP is taken to have set the clock right away
+    const uint32_t startUnix = 1700000000;
+
+    PmTrace pmTrace;
+    if (opts.trace != nullptr) {
+        if (!pmTrace.load(opts.trace)) {
+            fprintf(stderr, "Cannot read a trace of at least two points from %s\n", opts.trace);
+            return 2;
+        }
+    } else {
+        pmTrace.synthesize(opts.seed);
+    }
+    TraceGasSensor gasSensor(gasIntervalMs);
+    if (opts.gasTrace != nullptr) {
+        if (!gasSensor.load(opts.gasTrace)) {
+            fprintf(stderr, "Cannot read a gas trace of at least two points from %s\n", opts.gasTrace);
+            return 2;
+        }
+    } else {
+        gasSensor.synthesize(pmTrace);
+    }
+
+    // Either the trace directly, or through the serial protocol
+    std::unique_ptr<SimulatedSDS011> device;
+    std::unique_ptr<SDS011> bus;
+    std::unique_ptr<PmSensor> pmSensor;
+    if (opts.pmSerial) {
+        sim_sds011_config_t deviceConfig;
+        deviceConfig.noiseProbability = opts.noise;
+        deviceConfig.checksumErrorProbability = opts.checksumErrors;
+        deviceConfig.seed = opts.seed;
+        device.reset(new SimulatedSDS011(deviceConfig));
+        device->setPmSource([&pmTrace](uint64_t nowMs, float *pm25, float *pm10) {
+            pmTrace.sample(nowMs, pm25, pm10);
+        });
+        bus.reset(new SDS011(device.get()));
+        auto *sensor = new ParticulateSensor(bus.get(), deviceConfig.deviceId, pmPeriodMs / 60000);
+        bus->onPmData([sensor](const sds011_pm_data_t *data) { sensor->handlePmData(data); });
+        pmSensor.reset(sensor);
+    } else {
+        pmSensor.reset(new TracePmSensor(&pmTrace, pmPeriodMs, 0xA1B2));
+    }
+
+    RecordingPublisher publisher(opts.format);
+    publisher.setOutages(opts.outageEveryS * 1000, opts.outageS * 1000);
+    MemorySampleSpill spill;
+    std::vector<air_sample_t> ring(64);
+    SampleBuffer buffer(ring.data(), ring.size(), &spill, 2048);
+    buffer.begin();
+    SamplePipeline pipeline({opts.format, "air-sensor/sample", 5}, &publisher, &buffer);
+    uint32_t pmReadings = 0;
+    pmSensor->onPmData([&pipeline, &pmReadings](const sds011_pm_data_t *data) {
+        pipeline.addPm(data);
+        pmReadings++;
+    });
+
+    sim_step_stats_t loopStats;
+    sim_step_stats_t publishStats;
+    sim_step_stats_t replayStats;
+    uint64_t endMs = (uint64_t) opts.seconds * 1000;
+    uint64_t nextReplayMs = replayIntervalMs;
+    uint64_t wallStart = wallNs();
+    while (FakeClock::nowMillis() < endMs) {
+        FakeClock::advanceMillis(opts.loopMs);
+        uint32_t nowUnix = startUnix + (uint32_t) (FakeClock::nowMillis() / 1000);
+
+        uint64_t start = wallNs();
+        if (bus) {
+            bus->poll();
+        }
+        pmSensor->loop();
+        if (gasSensor.run(-1)) {
+            uint64_t publishStart = wallNs();
+            pipeline.addGasOutput(&gasSensor.output());
+            pipeline.publish(nowUnix, millis());
+            publishStats.record(wallNs() - publishStart);
+        }
+        if (FakeClock::nowMillis() >= nextReplayMs) {
+            nextReplayMs += replayIntervalMs;
+            uint64_t replayStart = wallNs();
+            if (pipeline.replay(nowUnix, millis()) > 0) {
+                replayStats.record(wallNs() - replayStart);
+            }
+        }
+        loopStats.record(wallNs() - start);
+    }
+    double wallS = (double) (wallNs() - wallStart) / 1e9;
+
+    const sample_pipeline_stats_t &stats = pipeline.stats();
+    const recording_publisher_stats_t &delivered = publisher.stats();
+    uint32_t missing = publisher.missing(stats.samples);
+    uint32_t unaccounted = missing - buffer.dropped() - (uint32_t) buffer.size() - stats.encodeFailures;
+    uint32_t latencyCount = delivered.messages - delivered.undecodable;
+
+    printf("simulated_seconds=%u format=%s pm_source=%s gas_trace=%s outage_every_s=%u outage_s=%u\n", opts.seconds,
+           opts.format == SAMPLE_FORMAT_JSON ? "json" : "cbor", opts.pmSerial ? "serial" : "trace",
+           opts.gasTrace != nullptr ? opts.gasTrace : "synthetic", opts.outageEveryS, opts.outageS);
+    printf("samples=%u pm_readings=%u published_live=%u buffered=%u replayed=%u dropped=%u still_buffered=%u "
+           "encode_failures=%u spill_writes=%u\n", stats.samples, pmReadings, stats.published, stats.buffered,
+           stats.replayed, buffer.dropped(), (uint32_t) buffer.size(), stats.encodeFailures, spill.writes());
+    printf("messages=%u bytes=%llu mean_bytes=%.1f received=%u missing=%u unaccounted=%u duplicates=%u "
+           "undecodable=%u\n", delivered.messages, (unsigned long long) delivered.bytes,
+           delivered.messages > 0 ? (double) delivered.bytes / delivered.messages : 0.0, publisher.received(),
+           missing, unaccounted, delivered.duplicates, delivered.undecodable);
+    printf("delivery_latency_ms mean=%.0f p95=%.0f max=%u\n",
+           latencyCount > 0 ? (double) delivered.latencySumMs / latencyCount : 0.0,
+           latencyCount > 0 ? delivered.latencyP95.value() : 0.0f, delivered.latencyMaxMs);
+    printf("publish_mean_ns=%llu publish_max_ns=%llu replay_mean_ns=%llu replay_max_ns=%llu loop_mean_ns=%llu "
+           "loop_max_ns=%llu\n", (unsigned long long) publishStats.meanNs(), (unsigned long long) publishStats.maxNs,
+           (unsigned long long) replayStats.meanNs(), (unsigned long long) replayStats.maxNs,
+           (unsigned long long) loopStats.meanNs(), (unsigned long long) loopStats.maxNs);
+    printf("wall_seconds=%.2f samples_per_wall_s=%.0f simulated_speedup=%.0f\n", wallS,
+           wallS > 0 ? stats.samples / wallS : 0.0, wallS > 0 ? opts.seconds / wallS : 0.0);
+
+    return unaccounted == 0 && delivered.duplicates == 0 && delivered.undecodable == 0 && stats.samples > 0 ? 0 : 1;
+}
+
+int main(int argc, char **argv) {
+    sim_options_t opts;
+    if (!parseOptions(argc, argv, &opts)) {
+        fprintf(stderr, "Usage: %s [--seconds N] [--loop-ms N] [--noise P] [--checksum-errors P] [--seed N] "
+                        "[--sensors N] [--low-power 0|1] [--wifi-ms N] [--battery-mah N] [--adaptive 0|1] "
+                        "[--trace FILE] [--min-interval-s N] [--max-interval-s N] [--pipeline 0|1] "
+                        "[--gas-trace FILE] [--format json|cbor] [--outage-every-s N] [--outage-s N] "
+                        "[--pm-serial 0|1]\n",
+                argv[0]);
+        return 2;
+    }
+
+    // Frame logging would dominate the measurement
+    HLogger.setSerial(nullptr);
+
+    if (opts.lowPower) {
+        return runLowPower(opts);
+    }
+    if (opts.adaptive) {
+        return runAdaptive(opts);
+    }
+    if (opts.pipeline) {
+        return runPipeline(opts);
+    }
+
+    // One simulated unit per port, each with its own device ID and noise
+    std::vector<std::unique_ptr<SimulatedSDS011>> devices;
+    std::vector<std::unique_ptr<SDS011>> buses;
+    std::vector<std::unique_ptr<ParticulateSensor>> sensors;
+    uint32_t framesReceived = 0;
+    for (uint32_t i = 0; i < opts.sensors; i++) {
+        sim_sds011_config_t config;
+        config.deviceId = 0xA1B2 + i;
+        config.noiseProbability = opts.noise;
+        config.checksumErrorProbability = opts.checksumErrors;
+        config.seed = opts.seed + i;
+        devices.emplace_back(new SimulatedSDS011(config));
+        buses.emplace_back(new SDS011(devices.back().get()));
+        // Continuous reporting, like the simulated device's default, so that every report is counted
+        sensors.emplace_back(new ParticulateSensor(buses.back().get(), config.deviceId, 0));
+
+        ParticulateSensor *sensor = sensors.back().get();
+        buses.back()->onPmData([sensor](const sds011_pm_data_t *data) {
+            if (sensor->accepts(data)) {
+                sensor->handlePmData(data);
+            }
+        });
+        sensor->onPmData([&framesReceived](const sds011_pm_data_t *) { framesReceived++; });
+    }
+
+    uint64_t iterations = (uint64_t) opts.seconds * 1000 / opts.loopMs;
+    uint64_t totalNs = 0;
+    uint64_t maxNs = 0;
+    for (uint64_t i = 0; i < iterations; i++) {
+        FakeClock::advanceMillis(opts.loopMs);
+
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t s = 0; s < opts.sensors; s++) {
+            buses[s]->poll();
+            sensors[s]->loop();
+        }
+        auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start).count();
+
+        totalNs += elapsed;
+        if ((uint64_t) elapsed > maxNs) {
+            maxNs = elapsed;
+        }
+    }
+
+    sim_sds011_stats_t stats;
+    sds011_link_stats_t link = {};
+    uint32_t configAttempts = 0;
+    uint32_t commandsFailed = 0;
+    bool allReady = true;
+    for (uint32_t s = 0; s < opts.sensors; s++) {
+        const sim_sds011_stats_t &deviceStats = devices[s]->stats();
+        stats.dataFrames += deviceStats.dataFrames;
+        stats.replyFrames += deviceStats.replyFrames;
+        stats.corruptedFrames += deviceStats.corruptedFrames;
+        stats.noiseBytes += deviceStats.noiseBytes;
+        stats.droppedBytes += deviceStats.droppedBytes;
+
+        const sds011_link_stats_t &busLink = buses[s]->linkStats();
+        link.frames += busLink.frames;
+        link.checksumFailures += busLink.checksumFailures;
+        link.resyncBytes += busLink.resyncBytes;
+        link.timeouts += busLink.timeouts;
+        link.retries += busLink.retries;
+
+        const particulate_health_t &health = sensors[s]->health();
+        commandsFailed += health.commandFailures;
+        configAttempts += health.configAttempts;
+        allReady = allReady && sensors[s]->state() == PARTICULATE_STATE_READY;
+    }
+    uint64_t bytesOnWire = (uint64_t) (stats.dataFrames + stats.replyFrames) * sizeof(sds011_response_raw_t) +
+                           stats.noiseBytes;
+
+    printf("simulated_seconds=%u loop_ms=%u iterations=%llu sensors=%u\n", opts.seconds, opts.loopMs,
+           (unsigned long long) iterations, opts.sensors);
+    printf("config_attempts=%u commands_failed=%u all_ready=%d\n", configAttempts, commandsFailed, allReady);
+    printf("data_frames_sent=%u data_frames_received=%u corrupted_frames=%u noise_bytes=%u dropped_bytes=%u\n",
+           stats.dataFrames, framesReceived, stats.corruptedFrames, stats.noiseBytes, stats.droppedBytes);
+    printf("link_frames=%u link_checksum_failures=%u link_resync_bytes=%u link_timeouts=%u link_retries=%u\n",
+           link.frames, link.checksumFailures, link.resyncBytes, link.timeouts, link.retries);
+    printf("loop_mean_ns=%llu loop_max_ns=%llu parser_throughput_bytes_per_s=%.0f\n",
+           (unsigned long long) (iterations > 0 ? totalNs / iterations : 0), (unsigned long long) maxNs,
+           totalNs > 0 ? (double) bytesOnWire * 1e9 / (double) totalNs : 0.0);
+
+    return allReady ? 0 : 1;
+}
@@ -0,0 +1,165 @@
+//
+// Query-mode SDS011 sampling at an interval that follows how fast PM changes
+//
+
+#include "AdaptivePolling.h"
+
+float AdaptiveInterval::change(float last, float value) const {
+    float allowed = _config.changeRel * last;
+    if (allowed < _config.changeAbs) {
+        allowed = _config.changeAbs;
+    }
+    return allowed > 0 ? fabsf(value - last) / allowed : 0;
+}
+
+uint32_t AdaptiveInterval::add(unsigned long nowMs, float pm25, float pm10) {
+    if (_haveLast) {
+        uint32_t elapsedMs = nowMs - _lastMs;
+        float c = change(_pm25, pm25);
+        float c10 = change(_pm10, pm10);
+        if (c10 > c) {
+            c = c10;
+        }
+
+        uint32_t next = _intervalMs < _config.maxIntervalMs / 2 ? 2 * _intervalMs : _config.maxIntervalMs;
+        // Time in which PM would move by the configured change at the rate it just did
+        if (c > 0 && (float) elapsedMs / c < (float) next) {
+            next = (uint32_t) ((float) elapsedMs / c);
+        }
+        _intervalMs = next > _config.minIntervalMs ? next : _config.minIntervalMs;
+    }
+
+    _pm25 = pm25;
+    _pm10 = pm10;
+    _lastMs = nowMs;
+    _haveLast = true;
+    return _intervalMs;
+}
+
+void AdaptivePolling::wait(uint32_t ms) {
+    _waitStartMs = millis();
+    _waitMs = ms;
+}
+
+void AdaptivePolling::queued(bool success) {
+    // Commands are counted as pending before they are sent, since one that cannot be sent completes right away
+    if (!success) {
+        commandResult(false);
+    }
+}
+
+void AdaptivePolling::commandResult(bool success) {
+    if (_pending > 0) {
+        _pending--;
+    }
+    if (!success) {
+        _commandsOk = false;
+    }
+}
+
+void AdaptivePolling::setWorking(bool working) {
+    if (working == _working) {
+        return;
+    }
+    if (working) {
+        _workSinceMs = millis();
+    } else {
+        _onTimeMs += millis() - _workSinceMs;
+    }
+    _working = working;
+}
+
+void AdaptivePolling::reading(const sds011_pm_data_t *data) {
+    _sensor->handlePmData(data);
+    // 0/0 is what a unit reports before its fan is up to speed, which says nothing about the air
+    if (data->pm25 == 0.0 && data->pm10 == 0.0) {
+        return;
+    }
+    _samples++;
+    _interval.add(millis(), data->pm25, data->pm10);
+}
+
+void AdaptivePolling::finishStep() {
+    if (!_commandsOk) {
+        _failures++;
+        // The unit may have been power cycled or unplugged; start over with the full wake up and configuration
+        _configured = false;
+        _step = ADAPTIVE_POLLING_STEP_WAKE;
+        wait(_config.minIntervalMs);
+        return;
+    }
+
+    switch (_step) {
+        case ADAPTIVE_POLLING_STEP_STARTING:
+            _configured = true;
+            setWorking(true);
+            _step = ADAPTIVE_POLLING_STEP_WARMUP;
+            wait(_config.warmupMs);
+            break;
+        case ADAPTIVE_POLLING_STEP_QUERYING:
+            if (_interval.sleeps()) {
+                _step = ADAPTIVE_POLLING_STEP_SLEEP;
+                wait(0);
+            } else {
+                _step = ADAPTIVE_POLLING_STEP_WARMUP;
+                wait(_interval.intervalMs());
+            }
+            break;
+        case ADAPTIVE_POLLING_STEP_STOPPING:
+            setWorking(false);
+            _step = ADAPTIVE_POLLING_STEP_WAKE;
+            wait(_interval.intervalMs() - _config.warmupMs);
+            break;
+        default:
+            break;
+    }
+}
+
+void AdaptivePolling::loop() {
+    if (_pending > 0) {
+        return;
+    }
+    if (_step == ADAPTIVE_POLLING_STEP_STARTING || _step == ADAPTIVE_POLLING_STEP_QUERYING ||
+        _step == ADAPTIVE_POLLING_STEP_STOPPING) {
+        finishStep();
+    }
+
+    // Units sharing a bus take turns, so their commands never overflow the bus' queue
+    SDS011 *bus = _sensor->bus();
+    if (millis() - _waitStartMs < _waitMs || bus->busy()) {
+        return;
+    }
+    uint16_t deviceId = _sensor->deviceId();
+    auto onResult = [this](bool success) { commandResult(success); };
+    _commandsOk = true;
+
+    switch (_step) {
+        case ADAPTIVE_POLLING_STEP_WAKE:
+            // A sleeping SDS011 ignores everything but the wake up command, so that goes first
+            _pending = _configured ? 1 : 3;
+            queued(bus->setSleepModeAsync(SDS011_SLEEP_MODE_WORK, deviceId, onResult));
+            if (!_configured) {
+                queued(bus->setWorkingPeriodAsync(0, deviceId, onResult));
+                queued(bus->setDataReportingAsync(SDS011_REPORT_MODE_QUERY, deviceId, onResult));
+            }
+            _step = ADAPTIVE_POLLING_STEP_STARTING;
+            break;
+        case ADAPTIVE_POLLING_STEP_WARMUP:
+            _pending = 1;
+            queued(bus->queryAsync(deviceId, [this](bool success, const sds011_pm_data_t *data) {
+                if (success) {
+                    reading(data);
+                }
+                commandResult(success);
+            }));
+            _step = ADAPTIVE_POLLING_STEP_QUERYING;
+            break;
+        case ADAPTIVE_POLLING_STEP_SLEEP:
+            _pending = 1;
+            queued(bus->setSleepModeAsync(SDS011_SLEEP_MODE_SLEEP, deviceId, onResult));
+            _step = ADAPTIVE_POLLING_STEP_STOPPING;
+            break;
+        default:
+            break;
+    }
+}
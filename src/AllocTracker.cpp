@@ -0,0 +1,119 @@
+//
+// Debug option counting heap allocations per loop() pass and by call site
+//
+
+#include "AllocTracker.h"
+
+#ifdef ALLOC_TRACKING
+
+extern "C" {
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+}
+
+static alloc_site_t sites[ALLOC_TRACKER_SITES];
+static uint8_t siteCount = 0;
+static alloc_tracker_stats_t stats = {};
+static uint32_t passAllocs = 0;
+
+static void record(void *address, size_t size) {
+    stats.allocs++;
+    stats.bytes += size;
+    passAllocs++;
+
+    for (uint8_t i = 0; i < siteCount; i++) {
+        if (sites[i].address == address) {
+            sites[i].count++;
+            sites[i].bytes += size;
+            return;
+        }
+    }
+    if (siteCount < ALLOC_TRACKER_SITES) {
+        sites[siteCount++] = {address, 1, (uint32_t) size};
+    }
+}
+
+extern "C" {
+void *__wrap_malloc(size_t size) {
+    record(__builtin_return_address(0), size);
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t nmemb, size_t size) {
+    record(__builtin_return_address(0), nmemb * size);
+    return __real_calloc(nmemb, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+    record(__builtin_return_address(0), size);
+    return __real_realloc(ptr, size);
+}
+}
+
+void allocTrackerEndPass() {
+    stats.passes++;
+    if (passAllocs > 0) {
+        stats.passesWithAllocs++;
+    }
+    if (passAllocs > stats.maxPerPass) {
+        stats.maxPerPass = passAllocs;
+    }
+    passAllocs = 0;
+}
+
+const alloc_tracker_stats_t *allocTrackerStats() {
+    return &stats;
+}
+
+uint8_t allocTrackerTopSites(alloc_site_t *out, uint8_t max) {
+    uint8_t n = siteCount < max ? siteCount : max;
+    bool taken[ALLOC_TRACKER_SITES] = {false};
+    for (uint8_t i = 0; i < n; i++) {
+        int best = -1;
+        for (uint8_t j = 0; j < siteCount; j++) {
+            if (!taken[j] && (best < 0 || sites[j].count > sites[best].count)) {
+                best = j;
+            }
+        }
+        taken[best] = true;
+        out[i] = sites[best];
+    }
+    return n;
+}
+
+void allocTrackerLog(Print *out, uint8_t max) {
+    // Copy first: printing may allocate, which would change the table while it is being read
+    alloc_site_t top[ALLOC_TRACKER_SITES];
+    uint8_t n = allocTrackerTopSites(top, max < ALLOC_TRACKER_SITES ? max : ALLOC_TRACKER_SITES);
+    alloc_tracker_stats_t snapshot = stats;
+
+    out->print(F("Allocations: "));
+    out->print(snapshot.allocs);
+    out->print(F(" ("));
+    out->print(snapshot.bytes);
+    out->print(F(" bytes) in "));
+    out->print(snapshot.passesWithAllocs);
+    out->print('/');
+    out->print(snapshot.passes);
+    out->print(F(" passes, max "));
+    out->print(snapshot.maxPerPass);
+    out->println(F(" per pass"));
+    for (uint8_t i = 0; i < n; i++) {
+        out->print(F("  0x"));
+        out->print((uint32_t) (uintptr_t) top[i].address, HEX);
+        out->print(F(": "));
+        out->print(top[i].count);
+        out->print(F(" allocs, "));
+        out->print(top[i].bytes);
+        out->println(F(" bytes"));
+    }
+}
+
+void allocTrackerReset() {
+    siteCount = 0;
+    stats = {};
+    passAllocs = 0;
+}
+
+#endif //ALLOC_TRACKING
@@ -0,0 +1,28 @@
+//
+// GasSensor backed by the BSEC library on the device
+//
+
+#include "BsecGasSensor.h"
+
+bool BsecGasSensor::run(int64_t timeMs) {
+    if (!_bsec->run(timeMs)) {
+        return false;
+    }
+    _output.rawTemperature = _bsec->rawTemperature;
+    _output.temperature = _bsec->temperature;
+    _output.pressure = _bsec->pressure;
+    _output.rawHumidity = _bsec->rawHumidity;
+    _output.humidity = _bsec->humidity;
+    _output.gasResistance = _bsec->gasResistance;
+    _output.iaq = _bsec->iaq;
+    _output.staticIaq = _bsec->staticIaq;
+    _output.co2Equivalent = _bsec->co2Equivalent;
+    _output.breathVocEquivalent = _bsec->breathVocEquivalent;
+    _output.iaqAccuracy = _bsec->iaqAccuracy;
+    _output.staticIaqAccuracy = _bsec->staticIaqAccuracy;
+    _output.co2Accuracy = _bsec->co2Accuracy;
+    _output.breathVocAccuracy = _bsec->breathVocAccuracy;
+    _output.runInDone = _bsec->runInStatus != 0;
+    _output.stabilizationDone = _bsec->stabStatus != 0;
+    return true;
+}
@@ -0,0 +1,109 @@
+//
+// Chooses the BSEC sample rate
+//
+
+#include "BsecRatePolicy.h"
+#include <string.h>
+
+bool BsecRatePolicy::ulpHour(int hour) const {
+    if (hour < 0 || _config.ulpFromHour == _config.ulpToHour) {
+        return false;
+    }
+    if (_config.ulpFromHour < _config.ulpToHour) {
+        return hour >= _config.ulpFromHour && hour < _config.ulpToHour;
+    }
+    return hour >= _config.ulpFromHour || hour < _config.ulpToHour;
+}
+
+void BsecRatePolicy::add(unsigned long nowMs, float iaq, uint8_t accuracy) {
+    // Stability only counts from the first calibrated output
+    bool wasCalibrated = _calibrated;
+    _calibrated = accuracy >= _config.minAccuracy;
+    if (!_calibrated || !wasCalibrated || !_haveAnchor || fabsf(iaq - _anchorIaq) > _config.iaqBand) {
+        _anchorIaq = iaq;
+        _stableSinceMs = nowMs;
+        _haveAnchor = true;
+    }
+}
+
+bsec_rate_t BsecRatePolicy::decide(unsigned long nowMs, int hour) {
+    bsec_rate_t rate;
+    if (_mode != BSEC_RATE_MODE_AUTO) {
+        rate = _mode == BSEC_RATE_MODE_ULP ? BSEC_RATE_ULP : BSEC_RATE_LP;
+        _reason = BSEC_RATE_REASON_OVERRIDE;
+    } else if (ulpHour(hour)) {
+        rate = BSEC_RATE_ULP;
+        _reason = BSEC_RATE_REASON_SCHEDULE;
+    } else if (!_calibrated) {
+        rate = BSEC_RATE_LP;
+        _reason = BSEC_RATE_REASON_CALIBRATING;
+    } else if (_haveAnchor && nowMs - _stableSinceMs >= _config.stableMs) {
+        rate = BSEC_RATE_ULP;
+        _reason = BSEC_RATE_REASON_STABLE;
+    } else {
+        rate = BSEC_RATE_LP;
+        _reason = BSEC_RATE_REASON_CHANGING;
+    }
+
+    if (rate != _rate && _failed && nowMs - _failedAtMs < _config.retryMs) {
+        _reason = BSEC_RATE_REASON_RETRY;
+        return _rate;
+    }
+    return rate;
+}
+
+void BsecRatePolicy::applied(bsec_rate_t rate) {
+    if (rate != _rate) {
+        _switches++;
+    }
+    _rate = rate;
+    _failed = false;
+}
+
+void BsecRatePolicy::failed(unsigned long nowMs) {
+    _failed = true;
+    _failedAtMs = nowMs;
+}
+
+const char *BsecRatePolicy::rateName(bsec_rate_t rate) {
+    return rate == BSEC_RATE_ULP ? "ulp" : "lp";
+}
+
+const char *BsecRatePolicy::modeName(bsec_rate_mode_t mode) {
+    switch (mode) {
+        case BSEC_RATE_MODE_LP:
+            return "lp";
+        case BSEC_RATE_MODE_ULP:
+            return "ulp";
+        default:
+            return "auto";
+    }
+}
+
+const char *BsecRatePolicy::reasonName(bsec_rate_reason_t reason) {
+    switch (reason) {
+        case BSEC_RATE_REASON_CHANGING:
+            return "changing";
+        case BSEC_RATE_REASON_CALIBRATING:
+            return "calibrating";
+        case BSEC_RATE_REASON_STABLE:
+            return "stable";
+        case BSEC_RATE_REASON_SCHEDULE:
+            return "schedule";
+        case BSEC_RATE_REASON_OVERRIDE:
+            return "override";
+        default:
+            return "retry";
+    }
+}
+
+bool BsecRatePolicy::parseMode(const char *name, bsec_rate_mode_t *mode) {
+    const bsec_rate_mode_t modes[] = {BSEC_RATE_MODE_AUTO, BSEC_RATE_MODE_LP, BSEC_RATE_MODE_ULP};
+    for (bsec_rate_mode_t candidate : modes) {
+        if (strcmp(name, modeName(candidate)) == 0) {
+            *mode = candidate;
+            return true;
+        }
+    }
+    return false;
+}
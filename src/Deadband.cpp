@@ -0,0 +1,37 @@
+//
+// Publish-on-change filter for a single measurement
+//
+
+#include "Deadband.h"
+
+bool Deadband::update(float value, unsigned long now) {
+    if (_primed) {
+        float threshold = _config.absolute;
+        float relative = _config.relative * fabsf(_last);
+        if (relative > threshold) {
+            threshold = relative;
+        }
+        bool changed = fabsf(value - _last) > threshold;
+        bool heartbeat = _config.heartbeatMs > 0 && now - _lastPass >= _config.heartbeatMs;
+        if (!changed && !heartbeat) {
+            return false;
+        }
+    }
+
+    _last = value;
+    _lastPass = now;
+    _primed = true;
+    return true;
+}
+
+bool Deadband::updateExact(uint32_t value, unsigned long now) {
+    bool heartbeat = _config.heartbeatMs > 0 && now - _lastPass >= _config.heartbeatMs;
+    if (_primed && value == _lastExact && !heartbeat) {
+        return false;
+    }
+
+    _lastExact = value;
+    _lastPass = now;
+    _primed = true;
+    return true;
+}
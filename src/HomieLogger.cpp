@@ -2,7 +2,89 @@
 // Created by depau on 5/5/21.
 //
 
+#include <Arduino.h>
 #include "../include/HomieLogger.h"
 
 
 HomieLogger HLogger(&Serial, nullptr);
+
+size_t HomieLogger::write(const uint8_t *buffer, size_t size) {
+    if (_serial != nullptr) {
+        _serial->write(buffer, size);
+    }
+
+    size_t space = sizeof(_ring) - _ringLen;
+    size_t n = size < space ? size : space;
+    size_t tail = (_ringHead + _ringLen) % sizeof(_ring);
+    size_t first = n < sizeof(_ring) - tail ? n : sizeof(_ring) - tail;
+
+    memcpy(_ring + tail, buffer, first);
+    memcpy(_ring, buffer + first, n - first);
+    _ringLen += n;
+
+    if (n < size) {
+        _dropped += size - n;
+        _droppedTotal += size - n;
+    }
+    return size;
+}
+
+void HomieLogger::loop() {
+    if (_homieProp == nullptr || _ringLen == 0) {
+        return;
+    }
+    unsigned long sinceLast = millis() - _lastPublish;
+    if (sinceLast >= _flushIntervalMs || (_ringLen >= _flushThreshold && sinceLast >= HOMIE_LOGGER_MIN_INTERVAL_MS)) {
+        publish(false);
+    }
+}
+
+void HomieLogger::flush() {
+    if (_serial != nullptr) {
+        _serial->flush();
+    }
+    if (_homieProp == nullptr) {
+        return;
+    }
+    while (_ringLen > 0 || _dropped > 0) {
+        publish(true);
+    }
+}
+
+void HomieLogger::publish(bool partial) {
+    size_t n = _ringLen < HOMIE_LOGGER_MAX_PUBLISH ? _ringLen : HOMIE_LOGGER_MAX_PUBLISH;
+    size_t cut = n;
+    while (cut > 0 && ringAt(cut - 1) != '\n') {
+        cut--;
+    }
+    if (cut == 0) {
+        // A line longer than a whole message has to be split, anything shorter waits to be completed
+        if (!partial && n < HOMIE_LOGGER_MAX_PUBLISH) {
+            return;
+        }
+        cut = n;
+    }
+
+    for (size_t i = 0; i < cut; i++) {
+        _publishBuf[i] = ringAt(i);
+    }
+    _ringHead = (_ringHead + cut) % sizeof(_ring);
+    _ringLen -= cut;
+
+    if (_dropped > 0) {
+        int len = snprintf(_publishBuf + cut, sizeof(_publishBuf) - cut, "[log: %u bytes dropped]\r\n",
+                           (unsigned) _dropped);
+        if (len > 0 && (size_t) len < sizeof(_publishBuf) - cut) {
+            cut += len;
+            _dropped = 0;
+        } else if (cut == 0) {
+            _dropped = 0;
+        }
+    }
+    _publishBuf[cut] = '\0';
+
+    _lastPublish = millis();
+    if (cut > 0) {
+        _homieProp->SetValue(String(_publishBuf));
+    }
+}
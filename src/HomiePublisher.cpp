@@ -0,0 +1,19 @@
+//
+// Publisher backed by the Homie device's MQTT client
+//
+
+#include "HomiePublisher.h"
+
+bool HomiePublisher::connected() {
+    return _homie->IsConnected();
+}
+
+bool HomiePublisher::publish(const char *topic, const uint8_t *payload, size_t len, uint8_t qos, bool retain) {
+    // CBOR payloads contain NUL bytes, so they can't go through String(const char *)
+    String message;
+    message.reserve(len);
+    for (size_t i = 0; i < len; i++) {
+        message += (char) payload[i];
+    }
+    return _homie->PublishDirect(topic, qos, retain, message) != 0;
+}
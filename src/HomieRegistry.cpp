@@ -0,0 +1,108 @@
+//
+// Table-driven Homie properties
+//
+
+#include "HomieRegistry.h"
+#include "NumberFormat.h"
+
+void HomieRegistry::readRow(size_t index, homie_property_desc_t *row) const {
+    // Flash is only readable in aligned 32-bit words, which memcpy_P takes care of
+    memcpy_P(row, &_table[index], sizeof(*row));
+}
+
+void HomieRegistry::build(HomieNode *node, uint32_t heartbeatMs) {
+    homie_property_desc_t row;
+    for (size_t i = 0; i < _count; i++) {
+        readRow(i, &row);
+        HomieProperty *prop = node->NewProperty();
+        prop->SetRetained(true);
+        prop->SetSettable(false);
+        prop->strID = row.id;
+        prop->strFriendlyName = row.name;
+        prop->datatype = row.datatype;
+        if (row.unit[0] != '\0') {
+            prop->SetUnit(row.unit);
+        }
+        if (row.format[0] != '\0') {
+            prop->strFormat = row.format;
+        }
+        _props[i] = prop;
+
+        if (_deadbands != nullptr) {
+            _deadbands[i] = Deadband({row.absolute, row.relative, heartbeatMs});
+        }
+    }
+}
+
+void HomieRegistry::setValue(size_t index, const homie_property_desc_t *row, float value) {
+    char buf[NUMBER_FORMAT_BUF_SIZE];
+    switch (row->datatype) {
+        case homieFloat:
+            formatFixed(buf, sizeof(buf), value, row->decimals);
+            _props[index]->SetValue(buf);
+            break;
+        case homieBool:
+            _props[index]->SetBool(value != 0);
+            break;
+        default:
+            // Integer rows should not get here, see publishUint(); at least there is no overflow
+            formatFixed(buf, sizeof(buf), value, 0);
+            _props[index]->SetValue(buf);
+            break;
+    }
+}
+
+void HomieRegistry::setInteger(size_t index, const homie_property_desc_t *row, uint32_t value) {
+    if (row->datatype == homieBool) {
+        _props[index]->SetBool(value != 0);
+        return;
+    }
+    char buf[NUMBER_FORMAT_BUF_SIZE];
+    formatUint(buf, sizeof(buf), value);
+    _props[index]->SetValue(buf);
+}
+
+void HomieRegistry::publish(unsigned long now, bool force) {
+    homie_property_desc_t row;
+    for (size_t i = 0; i < _count; i++) {
+        readRow(i, &row);
+        if (row.integerValue != nullptr) {
+            uint32_t value = row.integerValue();
+            if (force || _deadbands == nullptr || _deadbands[i].updateExact(value, now)) {
+                setInteger(i, &row, value);
+            }
+        } else if (row.value != nullptr) {
+            float value = row.value();
+            if (force || _deadbands == nullptr || _deadbands[i].update(value, now)) {
+                setValue(i, &row, value);
+            }
+        }
+    }
+}
+
+void HomieRegistry::publishValue(size_t index, float value) {
+    if (index >= _count) {
+        return;
+    }
+    homie_property_desc_t row;
+    readRow(index, &row);
+    setValue(index, &row, value);
+}
+
+void HomieRegistry::publishUint(size_t index, uint32_t value) {
+    if (index >= _count) {
+        return;
+    }
+    homie_property_desc_t row;
+    readRow(index, &row);
+    setInteger(index, &row, value);
+}
+
+void HomieRegistry::publishInt(size_t index, int32_t value) {
+    if (index >= _count) {
+        return;
+    }
+    char buf[NUMBER_FORMAT_BUF_SIZE];
+    formatInt(buf, sizeof(buf), value);
+    _props[index]->SetValue(buf);
+}
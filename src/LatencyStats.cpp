@@ -0,0 +1,64 @@
+//
+// Latency statistics for one stage of the main loop
+//
+
+#include "LatencyStats.h"
+#include <stdio.h>
+
+uint8_t LatencyStats::bucketFor(uint32_t us) {
+    uint8_t index = 0;
+    while (us > 0 && index < LATENCY_BUCKETS - 1) {
+        us >>= 1;
+        index++;
+    }
+    return index;
+}
+
+void LatencyStats::record(uint32_t us) {
+    _count++;
+    _sumUs += us;
+    if (us < _minUs) {
+        _minUs = us;
+    }
+    if (us > _maxUs) {
+        _maxUs = us;
+    }
+    _buckets[bucketFor(us)]++;
+}
+
+void LatencyStats::reset() {
+    _count = 0;
+    _minUs = UINT32_MAX;
+    _maxUs = 0;
+    _sumUs = 0;
+    memset(_buckets, 0, sizeof(_buckets));
+}
+
+size_t LatencyStats::format(char *buf, size_t size) const {
+    int len = snprintf(buf, size, "{\"n\":%lu,\"min\":%lu,\"mean\":%lu,\"max\":%lu,\"hist\":[",
+                       (unsigned long) _count, (unsigned long) minUs(), (unsigned long) meanUs(),
+                       (unsigned long) _maxUs);
+    if (len < 0 || (size_t) len >= size) {
+        return 0;
+    }
+
+    uint8_t used = LATENCY_BUCKETS;
+    while (used > 0 && _buckets[used - 1] == 0) {
+        used--;
+    }
+    for (uint8_t i = 0; i < used; i++) {
+        int n = snprintf(buf + len, size - len, i > 0 ? ",%lu" : "%lu", (unsigned long) _buckets[i]);
+        if (n < 0 || (size_t) (len + n) >= size) {
+            return 0;
+        }
+        len += n;
+    }
+
+    if ((size_t) len + 2 >= size) {
+        return 0;
+    }
+    buf[len++] = ']';
+    buf[len++] = '}';
+    buf[len] = '\0';
+    return len;
+}
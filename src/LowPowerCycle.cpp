@@ -0,0 +1,128 @@
+//
+// Duty-cycled operation with deep sleep between measurements
+//
+
+#include "LowPowerCycle.h"
+
+void LowPowerCycle::begin(const low_power_state_t *state) {
+    _state = *state;
+    _wakeMs = millis();
+    _step = LOW_POWER_STEP_COMMANDS;
+    _nextUnit = 0;
+    _pending = 0;
+    _commandsOk = true;
+
+    // Cold boot, or woken up too late for the planned measurement: give the fans their full warm-up
+    if (_state.phase == LOW_POWER_PHASE_WARMUP && _state.nextMeasureMs < _state.clockMs + _config.warmupMs) {
+        _state.nextMeasureMs = _state.clockMs + _config.warmupMs;
+    }
+}
+
+void LowPowerCycle::queued(bool success) {
+    if (success) {
+        _pending++;
+    } else {
+        _commandsOk = false;
+    }
+}
+
+void LowPowerCycle::commandResult(bool success) {
+    if (_pending > 0) {
+        _pending--;
+    }
+    if (!success) {
+        _commandsOk = false;
+    }
+}
+
+void LowPowerCycle::sendCommands(ParticulateSensor *sensor) {
+    SDS011 *bus = sensor->bus();
+    uint16_t deviceId = sensor->deviceId();
+    auto onResult = [this](bool success) { commandResult(success); };
+
+    if (_state.phase == LOW_POWER_PHASE_WARMUP) {
+        // A sleeping SDS011 ignores everything but the wake up command, so that goes first. The other two settings
+        // are kept by the SDS011 across power cycles and only sent until they took once.
+        queued(bus->setSleepModeAsync(SDS011_SLEEP_MODE_WORK, deviceId, onResult));
+        if (!_state.configured) {
+            queued(bus->setWorkingPeriodAsync(0, deviceId, onResult));
+            queued(bus->setDataReportingAsync(SDS011_REPORT_MODE_QUERY, deviceId, onResult));
+        }
+        return;
+    }
+
+    queued(bus->queryAsync(deviceId, [this, sensor](bool success, const sds011_pm_data_t *data) {
+        if (success) {
+            sensor->handlePmData(data);
+        }
+        commandResult(success);
+    }));
+    queued(bus->setSleepModeAsync(SDS011_SLEEP_MODE_SLEEP, deviceId, onResult));
+}
+
+void LowPowerCycle::loop() {
+    if (_step == LOW_POWER_STEP_SLEEPING) {
+        return;
+    }
+
+    if (_step == LOW_POWER_STEP_COMMANDS) {
+        if (_nextUnit < _sensorCount && !_sensors[_nextUnit]->bus()->busy()) {
+            sendCommands(_sensors[_nextUnit++]);
+        }
+        if (_nextUnit >= _sensorCount && _pending == 0) {
+            _step = LOW_POWER_STEP_WAITING;
+        }
+    }
+
+    if (_step == LOW_POWER_STEP_WAITING &&
+        (_state.phase == LOW_POWER_PHASE_WARMUP || !_readyCallback || _readyCallback())) {
+        sleep(false);
+    } else if (awakeMs() >= _config.maxAwakeMs) {
+        sleep(true);
+    }
+}
+
+void LowPowerCycle::sleep(bool timedOut) {
+    uint64_t now = clockMs();
+    _step = LOW_POWER_STEP_SLEEPING;
+    if (timedOut) {
+        _state.timeouts++;
+    }
+    // Unanswered commands count as failed; the settings are sent again on the next warm-up
+    bool commandsOk = _commandsOk && _pending == 0 && _nextUnit >= _sensorCount;
+
+    uint64_t wakeAtMs;
+    bool radio;
+    if (_state.phase == LOW_POWER_PHASE_WARMUP) {
+        _state.configured = commandsOk;
+        _state.phase = LOW_POWER_PHASE_MEASURE;
+        wakeAtMs = _state.nextMeasureMs;
+        radio = true;
+    } else {
+        if (!commandsOk) {
+            _state.configured = false;
+        }
+        _state.cycles++;
+        _state.phase = LOW_POWER_PHASE_WARMUP;
+        // Cycles missed by a long wake are skipped rather than caught up with
+        do {
+            _state.nextMeasureMs += _config.cycleMs;
+        } while (_state.nextMeasureMs < now + _config.warmupMs);
+        wakeAtMs = _state.nextMeasureMs - _config.warmupMs;
+        radio = false;
+    }
+
+    uint32_t sleepMs = wakeAtMs > now + LOW_POWER_MIN_SLEEP_MS ? (uint32_t) (wakeAtMs - now) : LOW_POWER_MIN_SLEEP_MS;
+    _state.clockMs = now + sleepMs;
+    if (_sleepCallback) {
+        _sleepCallback(sleepMs, radio);
+    }
+}
+
+low_power_state_t LowPowerCycle::state() const {
+    low_power_state_t state = _state;
+    if (_step != LOW_POWER_STEP_SLEEPING) {
+        state.clockMs = clockMs();
+    }
+    return state;
+}
@@ -0,0 +1,91 @@
+//
+// Allocation-free number formatting for published values
+//
+
+#include "NumberFormat.h"
+
+static const uint32_t pow10Table[] = {1, 10, 100, 1000, 10000, 100000, 1000000};
+
+// Writes the digits of `value` backwards, ending right before `end`. Returns the first digit.
+static char *writeDigits(char *end, uint64_t value) {
+    do {
+        *--end = (char) ('0' + value % 10);
+        value /= 10;
+    } while (value > 0);
+    return end;
+}
+
+static size_t copyOut(char *buf, size_t size, const char *src, size_t len) {
+    if (len + 1 > size) {
+        if (size > 0) {
+            buf[0] = '\0';
+        }
+        return 0;
+    }
+    memcpy(buf, src, len);
+    buf[len] = '\0';
+    return len;
+}
+
+size_t formatInt(char *buf, size_t size, int32_t value) {
+    char tmp[12];
+    char *end = tmp + sizeof(tmp);
+    uint32_t magnitude = value < 0 ? (uint32_t) 0 - (uint32_t) value : (uint32_t) value;
+    char *start = writeDigits(end, magnitude);
+    if (value < 0) {
+        *--start = '-';
+    }
+    return copyOut(buf, size, start, end - start);
+}
+
+size_t formatUint(char *buf, size_t size, uint32_t value) {
+    char tmp[10];
+    char *end = tmp + sizeof(tmp);
+    char *start = writeDigits(end, value);
+    return copyOut(buf, size, start, end - start);
+}
+
+size_t formatFixed(char *buf, size_t size, float value, uint8_t decimals) {
+    if (isnan(value)) {
+        return copyOut(buf, size, "nan", 3);
+    }
+    if (isinf(value)) {
+        return value < 0 ? copyOut(buf, size, "-inf", 4) : copyOut(buf, size, "inf", 3);
+    }
+    if (decimals > 6) {
+        decimals = 6;
+    }
+
+    bool negative = value < 0;
+    // A float has a 24 bit mantissa, so scaling by up to 10^6 is exact in a double and the rounding below matches
+    // printf's round-half-to-even.
+    double scaled = fabs((double) value) * pow10Table[decimals];
+    if (scaled >= 1e15) {
+        // Same overflow marker as the Arduino core
+        return copyOut(buf, size, "ovf", 3);
+    }
+    uint64_t fixed = (uint64_t) scaled;
+    double remainder = scaled - (double) fixed;
+    if (remainder > 0.5 || (remainder == 0.5 && (fixed & 1))) {
+        fixed++;
+    }
+    uint64_t intPart = fixed / pow10Table[decimals];
+    uint64_t fracPart = fixed % pow10Table[decimals];
+
+    char tmp[NUMBER_FORMAT_BUF_SIZE + 4];
+    char *end = tmp + sizeof(tmp);
+    char *start = end;
+    if (decimals > 0) {
+        for (uint8_t i = 0; i < decimals; i++) {
+            *--start = (char) ('0' + fracPart % 10);
+            fracPart /= 10;
+        }
+        *--start = '.';
+    }
+    start = writeDigits(start, intPart);
+    // Like the Arduino core, values that round to zero keep their sign
+    if (negative) {
+        *--start = '-';
+    }
+    return copyOut(buf, size, start, end - start);
+}
@@ -0,0 +1,118 @@
+//
+// Streaming quantile estimate with the P² algorithm
+//
+
+#include "P2Quantile.h"
+
+// How far each marker's desired position moves per value: the minimum stays, the maximum moves by one
+float P2Quantile::increment(uint8_t marker) const {
+    switch (marker) {
+        case 1:
+            return _p / 2;
+        case 2:
+            return _p;
+        case 3:
+            return (1 + _p) / 2;
+        case 4:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+float P2Quantile::parabolic(uint8_t i, int8_t d) const {
+    float n = (float) _positions[i];
+    float nPrev = (float) _positions[i - 1];
+    float nNext = (float) _positions[i + 1];
+    return _heights[i] + d / (nNext - nPrev) *
+                         ((n - nPrev + d) * (_heights[i + 1] - _heights[i]) / (nNext - n) +
+                          (nNext - n - d) * (_heights[i] - _heights[i - 1]) / (n - nPrev));
+}
+
+float P2Quantile::linear(uint8_t i, int8_t d) const {
+    return _heights[i] + d * (_heights[i + d] - _heights[i]) / (float) (_positions[i + d] - _positions[i]);
+}
+
+void P2Quantile::add(float value) {
+    if (_count < P2_QUANTILE_MARKERS) {
+        _heights[_count++] = value;
+        if (_count < P2_QUANTILE_MARKERS) {
+            return;
+        }
+        // Five values: sort them into the initial markers
+        for (uint8_t i = 1; i < P2_QUANTILE_MARKERS; i++) {
+            for (uint8_t j = i; j > 0 && _heights[j - 1] > _heights[j]; j--) {
+                float swap = _heights[j];
+                _heights[j] = _heights[j - 1];
+                _heights[j - 1] = swap;
+            }
+        }
+        for (uint8_t i = 0; i < P2_QUANTILE_MARKERS; i++) {
+            _positions[i] = i;
+            _desired[i] = 4 * increment(i);
+        }
+        return;
+    }
+
+    // Cell the value falls into, stretching the extremes if needed
+    uint8_t cell;
+    if (value < _heights[0]) {
+        _heights[0] = value;
+        cell = 0;
+    } else if (value >= _heights[4]) {
+        _heights[4] = value;
+        cell = 3;
+    } else {
+        cell = 0;
+        while (cell < 3 && value >= _heights[cell + 1]) {
+            cell++;
+        }
+    }
+    for (uint8_t i = cell + 1; i < P2_QUANTILE_MARKERS; i++) {
+        _positions[i]++;
+    }
+    for (uint8_t i = 0; i < P2_QUANTILE_MARKERS; i++) {
+        _desired[i] += increment(i);
+    }
+    _count++;
+
+    // Move the middle markers towards their desired positions, by at most one step each
+    for (uint8_t i = 1; i < P2_QUANTILE_MARKERS - 1; i++) {
+        float delta = _desired[i] - (float) _positions[i];
+        if ((delta >= 1 && _positions[i + 1] - _positions[i] > 1) ||
+            (delta <= -1 && _positions[i - 1] - _positions[i] < -1)) {
+            int8_t d = delta > 0 ? 1 : -1;
+            float height = parabolic(i, d);
+            if (_heights[i - 1] < height && height < _heights[i + 1]) {
+                _heights[i] = height;
+            } else {
+                _heights[i] = linear(i, d);
+            }
+            _positions[i] += d;
+        }
+    }
+}
+
+float P2Quantile::value() const {
+    if (_count == 0) {
+        return NAN;
+    }
+    if (_count >= P2_QUANTILE_MARKERS) {
+        return _heights[2];
+    }
+
+    // Too few values for the markers: nearest rank on a sorted copy
+    float sorted[P2_QUANTILE_MARKERS];
+    for (uint8_t i = 0; i < _count; i++) {
+        uint8_t j = i;
+        for (; j > 0 && sorted[j - 1] > _heights[i]; j--) {
+            sorted[j] = sorted[j - 1];
+        }
+        sorted[j] = _heights[i];
+    }
+    return sorted[(uint8_t) lroundf(_p * (float) (_count - 1))];
+}
+
+void P2Quantile::reset() {
+    _count = 0;
+}
@@ -0,0 +1,135 @@
+//
+// One SDS011 unit on a serial bus
+//
+
+#include "ParticulateSensor.h"
+
+// Commands sent by configure(), each of which reports back through configResult()
+#define PARTICULATE_CONFIG_COMMANDS 4
+
+void ParticulateSensor::configure() {
+    _state = PARTICULATE_STATE_CONFIGURING;
+    _configPending = PARTICULATE_CONFIG_COMMANDS;
+    _configOk = true;
+    _configStartedMs = millis();
+    uint32_t attempt = ++_health.configAttempts;
+
+    auto onResult = [this, attempt](bool success) { configResult(attempt, success); };
+
+    if (!_sds->getInfoAsync(_deviceId, [this, attempt](bool success, const sds011_dev_info_t *devInfo) {
+        if (success && attempt == _health.configAttempts) {
+            _info = *devInfo;
+        }
+        configResult(attempt, success);
+    })) {
+        configResult(attempt, false);
+    }
+    if (!_sds->setWorkingPeriodAsync(_workingPeriod, _deviceId, onResult)) {
+        configResult(attempt, false);
+    }
+    if (!_sds->setDataReportingAsync(SDS011_REPORT_MODE_ACTIVE, _deviceId, onResult)) {
+        configResult(attempt, false);
+    }
+    if (!_sds->setSleepModeAsync(SDS011_SLEEP_MODE_WORK, _deviceId, onResult)) {
+        configResult(attempt, false);
+    }
+}
+
+void ParticulateSensor::configResult(uint32_t attempt, bool success) {
+    if (attempt != _health.configAttempts || _state != PARTICULATE_STATE_CONFIGURING) {
+        return;
+    }
+    if (!success) {
+        _health.commandFailures++;
+        _configOk = false;
+    }
+    if (--_configPending > 0) {
+        return;
+    }
+
+    if (_configOk) {
+        _state = PARTICULATE_STATE_READY;
+        if (_readyCallback) {
+            _readyCallback(&_info);
+        }
+    } else {
+        _state = PARTICULATE_STATE_FAILED;
+        if (_failedCallback) {
+            _failedCallback();
+        }
+    }
+}
+
+void ParticulateSensor::handlePmData(const sds011_pm_data_t *data) {
+    _health.frames++;
+    _health.lastFrameMs = millis();
+    _assumed = false;
+
+    if (data->pm10 == 0.0 && data->pm25 == 0.0) {
+        _health.zeroFrames++;
+        return;
+    }
+    _lastReading = *data;
+    _haveReading = true;
+    if (_pmDataCallback) {
+        _pmDataCallback(data);
+    }
+}
+
+void ParticulateSensor::loop() {
+    // Units sharing a bus are configured one after the other, so their commands never overflow the bus' queue
+    if (_sds->busy()) {
+        return;
+    }
+    switch (_state) {
+        case PARTICULATE_STATE_IDLE:
+            configure();
+            break;
+        case PARTICULATE_STATE_FAILED:
+            if (millis() - _configStartedMs >= PARTICULATE_RETRY_INTERVAL_MS) {
+                configure();
+            }
+            break;
+        case PARTICULATE_STATE_READY:
+            if (_assumed && millis() - _assumedSinceMs >= 2 * periodMs()) {
+                _assumed = false;
+                configure();
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+bool ParticulateSensor::query() {
+    bool queued = _sds->queryAsync(_deviceId, [this](bool success, const sds011_pm_data_t *data) {
+        if (success) {
+            handlePmData(data);
+        } else {
+            _health.commandFailures++;
+        }
+    });
+    if (!queued) {
+        _health.commandFailures++;
+    }
+    return queued;
+}
+
+void ParticulateSensor::assumeConfigured() {
+    if (_state == PARTICULATE_STATE_IDLE) {
+        _state = PARTICULATE_STATE_READY;
+        _assumed = true;
+        _assumedSinceMs = millis();
+    }
+}
+
+uint32_t ParticulateSensor::periodMs() const {
+    return (_workingPeriod > 0 ? _workingPeriod : 1) * 60UL * 1000;
+}
+
+bool ParticulateSensor::online(unsigned long now) const {
+    if (_health.frames == 0) {
+        return false;
+    }
+    return now - _health.lastFrameMs < 2 * periodMs();
+}
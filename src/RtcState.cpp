@@ -0,0 +1,24 @@
+//
+// Runtime state kept in the ESP8266 RTC user memory
+//
+
+#include "RtcState.h"
+#include <stddef.h>
+#include "StateStore.h"
+
+static uint32_t rtcStateCrc(const rtc_state_t *state) {
+    return StateStore::crc32(0, reinterpret_cast<const uint8_t *>(state), offsetof(rtc_state_t, crc));
+}
+
+bool rtcStateLoad(rtc_state_t *state) {
+    if (!ESP.rtcUserMemoryRead(RTC_STATE_OFFSET, reinterpret_cast<uint32_t *>(state), sizeof(*state))) {
+        return false;
+    }
+    return state->magic == RTC_STATE_MAGIC && state->crc == rtcStateCrc(state);
+}
+
+bool rtcStateSave(rtc_state_t *state) {
+    state->magic = RTC_STATE_MAGIC;
+    state->crc = rtcStateCrc(state);
+    return ESP.rtcUserMemoryWrite(RTC_STATE_OFFSET, reinterpret_cast<uint32_t *>(state), sizeof(*state));
+}
@@ -36,7 +36,7 @@ bool SDS011::getSleepMode(uint16_t sensorID, uint8_t *sleepMode) {
 
 bool SDS011::setWorkingPeriod(uint8_t workPeriod, uint16_t sensorID) {
     if (workPeriod > 30) {
-        HLogger.println("Invalid SDS011 working period! Must be from 0 to 30");
+        logError(F("Invalid SDS011 working period! Must be from 0 to 30"));
         return false;
     }
     sds011_response_u resp;
@@ -53,43 +53,67 @@ bool SDS011::getWorkingPeriod(uint16_t sensorID, uint8_t *workingPeriod) {
 }
 
 
+bool SDS011::setDataReportingAsync(sds011_reporting_mode_t mode, uint16_t sensorID,
+                                   sds011_result_callback_t callback) {
+    return getSetSettingAsync(sensorID, SDS011_OPERATION_SET, SDS011_CMD_DATA_REPORTING, mode, callback);
+}
+
+bool SDS011::setSleepModeAsync(sds011_sleep_mode_t mode, uint16_t sensorID, sds011_result_callback_t callback) {
+    return getSetSettingAsync(sensorID, SDS011_OPERATION_SET, SDS011_CMD_SLEEP_WORK, mode, callback);
+}
+
+bool SDS011::setWorkingPeriodAsync(uint8_t workPeriod, uint16_t sensorID, sds011_result_callback_t callback) {
+    if (workPeriod > 30) {
+        logError(F("Invalid SDS011 working period! Must be from 0 to 30"));
+        return false;
+    }
+    return getSetSettingAsync(sensorID, SDS011_OPERATION_SET, SDS011_CMD_WORK_PERIOD, workPeriod, callback);
+}
+
+
+void SDS011::buildSetting(sds011_command_u *cmd, uint16_t sensorID, sds011_operation_t operation,
+                          sds011_command_t setting, uint8_t value) {
+    cmd->setting.sensorID = sensorID;
+    cmd->setting.operation = operation;
+    cmd->setting.command = setting;
+    cmd->setting.setting = value;
+    fillBoilerplate(cmd);
+}
+
 bool SDS011::getSetSetting(uint16_t sensorID, sds011_operation_t operation, sds011_command_t setting, uint8_t value,
                            sds011_response_u *response) {
     sds011_command_u cmd = {{0}};
-    cmd.setting.sensorID = sensorID;
-    cmd.setting.operation = operation;
-    cmd.setting.command = setting;
-    cmd.setting.setting = value;
-    fillBoilerplate(&cmd);
-    if (!sendCommand(&cmd)) {
-        return false;
-    }
-    if (!readResponse(response, _timeout)) {
+    buildSetting(&cmd, sensorID, operation, setting, value);
+    if (!execute(&cmd, response)) {
         return false;
     }
-    if (!checkChecksumResp(response)) {
+    if (operation == SDS011_OPERATION_SET && response->setting.setting != value) {
         return false;
     }
-    if (cmd.setting.setting != response->setting.setting) {
+    return true;
+}
+
+bool SDS011::getSetSettingAsync(uint16_t sensorID, sds011_operation_t operation, sds011_command_t setting,
+                                uint8_t value, sds011_result_callback_t callback) {
+    sds011_command_u cmd = {{0}};
+    buildSetting(&cmd, sensorID, operation, setting, value);
+    sds011_pending_command_t *pending = enqueue(&cmd, SDS011_COMPLETION_RESULT);
+    if (pending == nullptr) {
         return false;
     }
+    pending->onResult = std::move(callback);
+    serviceQueue();
     return true;
 }
 
-
 bool SDS011::getInfo(uint16_t sensorID, sds011_dev_info_t *devInfo) {
     sds011_command_u cmd = {{0}};
     cmd.setting.command = SDS011_CMD_VERSION;
     cmd.setting.sensorID = sensorID;
     fillBoilerplate(&cmd);
-    if (!sendCommand(&cmd)) {
-        return false;
-    }
+
     sds011_response_u resp;
-    if (!readResponse(&resp, _timeout)) {
-        return false;
-    }
-    if (!checkChecksumResp(&resp)) {
+    if (!execute(&cmd, &resp)) {
         return false;
     }
     devInfo->deviceId = resp.common.deviceId;
@@ -99,16 +123,48 @@ bool SDS011::getInfo(uint16_t sensorID, sds011_dev_info_t *devInfo) {
     return true;
 }
 
+bool SDS011::getInfoAsync(uint16_t sensorID, sds011_info_callback_t callback) {
+    sds011_command_u cmd = {{0}};
+    cmd.setting.command = SDS011_CMD_VERSION;
+    cmd.setting.sensorID = sensorID;
+    fillBoilerplate(&cmd);
+
+    sds011_pending_command_t *pending = enqueue(&cmd, SDS011_COMPLETION_INFO);
+    if (pending == nullptr) {
+        return false;
+    }
+    pending->onInfo = std::move(callback);
+    serviceQueue();
+    return true;
+}
+
 bool SDS011::query(uint16_t sensorID, sds011_pm_data_t *data) {
     sds011_command_u cmd = {{0}};
     cmd.setting.command = SDS011_CMD_QUERY;
     cmd.setting.sensorID = sensorID;
     fillBoilerplate(&cmd);
 
-    if (!sendCommand(&cmd)) {
+    sds011_response_u resp;
+    if (!execute(&cmd, &resp)) {
+        return false;
+    }
+    decodePmData(&resp, data);
+    return true;
+}
+
+bool SDS011::queryAsync(uint16_t sensorID, sds011_query_callback_t callback) {
+    sds011_command_u cmd = {{0}};
+    cmd.setting.command = SDS011_CMD_QUERY;
+    cmd.setting.sensorID = sensorID;
+    fillBoilerplate(&cmd);
+
+    sds011_pending_command_t *pending = enqueue(&cmd, SDS011_COMPLETION_QUERY);
+    if (pending == nullptr) {
         return false;
     }
-    return readPmData(data, _timeout);
+    pending->onQuery = std::move(callback);
+    serviceQueue();
+    return true;
 }
 
 bool SDS011::read(sds011_pm_data_t *data) {
@@ -121,21 +177,168 @@ bool SDS011::readPmData(sds011_pm_data_t *data, uint32_t timeout) {
     if (!readResponse(&resp, timeout)) {
         return false;
     }
-    if (!checkChecksumResp(&resp)) {
+    if (resp.common.commandId != SDS011_RESP_ID_DATA) {
         return false;
     }
-    data->pm25 = ((float) resp.query.pm25) / 10;
-    data->pm10 = ((float) resp.query.pm10) / 10;
-    data->deviceId = resp.common.deviceId;
+    decodePmData(&resp, data);
     return true;
 }
 
+void SDS011::decodePmData(const sds011_response_u *response, sds011_pm_data_t *data) {
+    data->pm25 = ((float) response->query.pm25) / 10;
+    data->pm10 = ((float) response->query.pm10) / 10;
+    data->deviceId = response->common.deviceId;
+}
+
+
+sds011_pending_command_t *SDS011::enqueue(sds011_command_u *cmd, sds011_completion_t completion) {
+    if (_queueLen >= SDS011_QUEUE_SIZE) {
+        logError(F("SDS011: command queue full"));
+        return nullptr;
+    }
+    sds011_pending_command_t *pending = &_queue[(_queueHead + _queueLen) % SDS011_QUEUE_SIZE];
+    pending->cmd = *cmd;
+    pending->timeout = _timeout;
+    pending->retriesLeft = _retries;
+    pending->completion = completion;
+    pending->wait = nullptr;
+    _queueLen++;
+    return pending;
+}
+
+bool SDS011::execute(sds011_command_u *cmd, sds011_response_u *response) {
+    sds011_wait_t wait = {false, false, response};
+    sds011_pending_command_t *pending = enqueue(cmd, SDS011_COMPLETION_WAIT);
+    if (pending == nullptr) {
+        return false;
+    }
+    pending->wait = &wait;
+    serviceQueue();
+
+    // Every queued command times out on its own, so this always terminates
+    while (!wait.done) {
+        poll();
+        yield();
+    }
+    return wait.success;
+}
+
+bool SDS011::matchesCommand(const sds011_command_u *cmd, const sds011_response_u *response) {
+    uint16_t sensorID = cmd->setting.sensorID;
+    if (sensorID != SDS011_ANY && sensorID != response->common.deviceId) {
+        return false;
+    }
+    if (cmd->setting.command == SDS011_CMD_QUERY) {
+        return response->common.commandId == SDS011_RESP_ID_DATA;
+    }
+    return response->common.commandId == SDS011_RESP_ID_REPLY && response->setting.command == cmd->setting.command;
+}
+
+void SDS011::dispatchFrame(const sds011_response_u *response) {
+    if (_inFlight && matchesCommand(&_queue[_queueHead].cmd, response)) {
+        completeHead(true, response);
+        return;
+    }
+
+    if (_frameCallback != nullptr) {
+        _frameCallback(response);
+    }
+    if (_pmDataCallback != nullptr && response->common.commandId == SDS011_RESP_ID_DATA) {
+        sds011_pm_data_t data;
+        decodePmData(response, &data);
+        _pmDataCallback(&data);
+    }
+}
+
+void SDS011::completeHead(bool success, const sds011_response_u *response) {
+    sds011_pending_command_t *head = &_queue[_queueHead];
+    sds011_completion_t completion = head->completion;
+    if (success && completion == SDS011_COMPLETION_RESULT && head->cmd.setting.operation == SDS011_OPERATION_SET &&
+        response->setting.setting != head->cmd.setting.setting) {
+        // The unit did not take the setting
+        success = false;
+    }
+
+    // Pop before running the callback, which may queue further commands into this slot
+    sds011_result_callback_t onResult = std::move(head->onResult);
+    sds011_info_callback_t onInfo = std::move(head->onInfo);
+    sds011_query_callback_t onQuery = std::move(head->onQuery);
+    sds011_wait_t *wait = head->wait;
+    head->onResult = nullptr;
+    head->onInfo = nullptr;
+    head->onQuery = nullptr;
+    _queueHead = (_queueHead + 1) % SDS011_QUEUE_SIZE;
+    _queueLen--;
+    _inFlight = false;
+
+    switch (completion) {
+        case SDS011_COMPLETION_RESULT:
+            if (onResult) {
+                onResult(success);
+            }
+            break;
+        case SDS011_COMPLETION_INFO:
+            if (onInfo) {
+                sds011_dev_info_t devInfo;
+                if (success) {
+                    devInfo.deviceId = response->common.deviceId;
+                    devInfo.year = response->version.year;
+                    devInfo.month = response->version.month;
+                    devInfo.day = response->version.day;
+                }
+                onInfo(success, success ? &devInfo : nullptr);
+            }
+            break;
+        case SDS011_COMPLETION_QUERY:
+            if (onQuery) {
+                sds011_pm_data_t data;
+                if (success) {
+                    decodePmData(response, &data);
+                }
+                onQuery(success, success ? &data : nullptr);
+            }
+            break;
+        case SDS011_COMPLETION_WAIT:
+            wait->done = true;
+            wait->success = success;
+            if (success) {
+                *wait->response = *response;
+            }
+            break;
+    }
+}
+
+void SDS011::serviceQueue() {
+    sds011_pending_command_t *head = &_queue[_queueHead];
+    if (_inFlight && millis() - _inFlightSince >= head->timeout) {
+        _linkStats.timeouts++;
+        if (head->retriesLeft > 0) {
+            // Sent again below
+            head->retriesLeft--;
+            _linkStats.retries++;
+            _inFlight = false;
+        } else {
+            logError(F("SDS011: command timed out"));
+            completeHead(false, nullptr);
+        }
+    }
+
+    if (!_inFlight && _queueLen > 0) {
+        if (!sendCommand(&_queue[_queueHead].cmd)) {
+            completeHead(false, nullptr);
+            return;
+        }
+        _inFlight = true;
+        _inFlightSince = millis();
+    }
+}
+
 
 void SDS011::fillBoilerplate(sds011_command_u *cmd) {
-    cmd->common.head = 0xAA;
-    cmd->common.commandId = 0xB4;
+    cmd->common.head = SDS011_HEAD;
+    cmd->common.commandId = SDS011_CMD_ID;
     cmd->common.checksum = genChecksum(cmd->raw.bytes + 2, 15);
-    cmd->common.tail = 0xAB;
+    cmd->common.tail = SDS011_TAIL;
 }
 
 bool SDS011::sendCommand(sds011_command_u *cmd) {
@@ -147,16 +350,12 @@ bool SDS011::sendCommand(sds011_command_u *cmd) {
             yield();
             continue;
         }
-        String msg = String(F("SDS011: send "));
-        for (unsigned char byte : cmd->raw.bytes) {
-            msg += String(byte, HEX) + " ";
-        }
-        HLogger.println(msg);
+        traceFrame("SDS011: send ", cmd->raw.bytes, sizeof(cmd->raw.bytes));
         return true;
 
     } while (millis() < start + _timeout);
 
-    HLogger.println("SDS011: Failed to send command");
+    logError(F("SDS011: Failed to send command"));
     return false;
 }
 
@@ -164,37 +363,141 @@ bool SDS011::readResponse(sds011_response_u *response, uint32_t timeout) {
     unsigned long start = millis();
 
     do {
-        if (!seekRespStart()) {
-            yield();
-            continue;
+        if (pollFrame(response)) {
+            return true;
         }
-        if (_serial->available() < 10) {
-            yield();
+        yield();
+    } while (millis() - start < timeout);
+    return false;
+}
+
+uint8_t SDS011::poll() {
+    sds011_response_u resp;
+    uint8_t frames = 0;
+
+    while (pollFrame(&resp)) {
+        frames++;
+        dispatchFrame(&resp);
+    }
+    serviceQueue();
+    return frames;
+}
+
+bool SDS011::pollFrame(sds011_response_u *response) {
+    // Only consumes what is already buffered and stops right after a frame is completed, so bytes belonging to the
+    // next frame are left to the next call.
+    while (_serial->available() > 0) {
+        int byte = _serial->read();
+        if (byte < 0) {
+            break;
+        }
+        _rxSinceFrame++;
+        if (!parseByte((uint8_t) byte)) {
             continue;
         }
 
-        _serial->readBytes(response->raw.bytes, 10);
-        String msg = String(F("SDS011: recv "));
-        for (unsigned char byte : response->raw.bytes) {
-            msg += String(byte, HEX) + " ";
-        }
-        HLogger.println(msg);
+        _linkStats.frames++;
+        _linkStats.resyncBytes += _rxSinceFrame - sizeof(response->raw.bytes);
+        _rxSinceFrame = 0;
+        *response = _rxFrame;
+        traceFrame("SDS011: recv ", response->raw.bytes, sizeof(response->raw.bytes));
         return true;
-
-    } while (millis() < start + timeout);
+    }
     return false;
 }
 
-bool SDS011::seekRespStart() {
-    while (_serial->available()) {
-        if (_serial->peek() == 0xAA) {
+bool SDS011::parseByte(uint8_t byte) {
+    switch (_rxState) {
+        case SDS011_PARSER_HEAD:
+            resyncParser(byte);
+            return false;
+
+        case SDS011_PARSER_COMMAND:
+            if (byte != SDS011_RESP_ID_DATA && byte != SDS011_RESP_ID_REPLY) {
+                resyncParser(byte);
+                return false;
+            }
+            _rxFrame.raw.bytes[_rxPos++] = byte;
+            _rxState = SDS011_PARSER_PAYLOAD;
+            return false;
+
+        case SDS011_PARSER_PAYLOAD:
+            _rxFrame.raw.bytes[_rxPos++] = byte;
+            if (_rxPos == offsetof(sds011_response_common_t, checksum)) {
+                _rxState = SDS011_PARSER_CHECKSUM;
+            }
+            return false;
+
+        case SDS011_PARSER_CHECKSUM:
+            _rxFrame.raw.bytes[_rxPos++] = byte;
+            if (!checkChecksumResp(&_rxFrame)) {
+                _linkStats.checksumFailures++;
+                resyncParser(byte);
+                return false;
+            }
+            _rxState = SDS011_PARSER_TAIL;
+            return false;
+
+        case SDS011_PARSER_TAIL:
+            if (byte != SDS011_TAIL) {
+                resyncParser(byte);
+                return false;
+            }
+            _rxFrame.raw.bytes[_rxPos] = byte;
+            _rxState = SDS011_PARSER_HEAD;
+            _rxPos = 0;
             return true;
-        }
-        _serial->read();
     }
     return false;
 }
 
+void SDS011::resyncParser(uint8_t byte) {
+    // A rejected byte may itself be the head of the next frame
+    if (byte == SDS011_HEAD) {
+        _rxFrame.raw.bytes[0] = byte;
+        _rxPos = 1;
+        _rxState = SDS011_PARSER_COMMAND;
+    } else {
+        _rxPos = 0;
+        _rxState = SDS011_PARSER_HEAD;
+    }
+}
+
+void SDS011::logError(const __FlashStringHelper *msg) const {
+#if SDS011_LOG_LEVEL >= SDS011_LOG_ERROR
+    if (_logLevel >= SDS011_LOG_ERROR) {
+        HLogger.println(msg);
+    }
+#endif
+}
+
+void SDS011::traceFrame(const char *prefix, const uint8_t *bytes, size_t len) const {
+#if SDS011_LOG_LEVEL >= SDS011_LOG_TRACE
+    if (_logLevel < SDS011_LOG_TRACE) {
+        return;
+    }
+
+    static const char hexDigits[] = "0123456789abcdef";
+    char buf[16 + 3 * sizeof(sds011_command_raw_t)];
+    size_t pos = strlen(prefix);
+    if (pos > 16) {
+        pos = 16;
+    }
+    memcpy(buf, prefix, pos);
+    for (size_t i = 0; i < len && pos + 3 < sizeof(buf); i++) {
+        buf[pos++] = hexDigits[bytes[i] >> 4];
+        buf[pos++] = hexDigits[bytes[i] & 0x0F];
+        buf[pos++] = ' ';
+    }
+    buf[pos] = '\0';
+    HLogger.println(buf);
+#else
+    (void) prefix;
+    (void) bytes;
+    (void) len;
+#endif
+}
+
 bool SDS011::checkChecksumResp(sds011_response_u *response) {
     uint8_t checksum = genChecksum(response->raw.bytes + 2, 6);
     return checksum == response->common.checksum;
@@ -0,0 +1,122 @@
+//
+// Store-and-forward buffer for samples that could not be published
+//
+
+#include "SampleBuffer.h"
+
+SampleBuffer::SampleBuffer(air_sample_t *storage, size_t capacity, SampleSpill *spill, size_t spillMax) :
+        _ring{storage}, _capacity{capacity}, _spill{spill}, _spillMax{spillMax} {}
+
+void SampleBuffer::begin() {
+    if (_spill != nullptr) {
+        _spillCount = _spill->count();
+        _spillRead = 0;
+        _spillBootStart = _spillCount;
+    }
+}
+
+void SampleBuffer::popFront(size_t n) {
+    _head = (_head + n) % _capacity;
+    _len -= n;
+}
+
+bool SampleBuffer::spillFront(size_t n) {
+    // The oldest samples may wrap around the end of the ring
+    size_t first = n < _capacity - _head ? n : _capacity - _head;
+    bool ok = _spill->append(at(0), first);
+    if (ok && first < n) {
+        ok = _spill->append(_ring, n - first);
+    }
+    if (!ok) {
+        // Whatever made it to flash is lost track of; start over with a clean file
+        _spill->clear();
+        _dropped += _spillCount - _spillRead + n;
+        _spillCount = 0;
+        _spillRead = 0;
+        _spillBootStart = 0;
+        popFront(n);
+        return false;
+    }
+    _spillCount += n;
+    popFront(n);
+    return true;
+}
+
+void SampleBuffer::spillOldest() {
+    size_t n = _capacity / 2 > 0 ? _capacity / 2 : 1;
+    if (_spill == nullptr || _spillCount + n > _spillMax) {
+        _dropped++;
+        popFront(1);
+        return;
+    }
+    spillFront(n);
+}
+
+bool SampleBuffer::persist() {
+    if (_len == 0) {
+        return true;
+    }
+    if (_spill == nullptr || _spillCount + _len > _spillMax) {
+        return false;
+    }
+    return spillFront(_len);
+}
+
+void SampleBuffer::push(const air_sample_t *sample) {
+    if (_len == _capacity) {
+        spillOldest();
+    }
+    *at(_len) = *sample;
+    _len++;
+}
+
+size_t SampleBuffer::replay(const sample_replay_callback_t &publish, size_t max) {
+    size_t sent = 0;
+
+    while (sent < max && _spillRead < _spillCount) {
+        air_sample_t sample;
+        if (_spill->read(_spillRead, &sample, 1) != 1) {
+            // Unreadable spill, skip what is left of it
+            _dropped += _spillCount - _spillRead;
+            _spillRead = _spillCount;
+            break;
+        }
+        if (_spillRead >= _spillBootStart) {
+            fixTimestamp(&sample);
+        }
+        if (!publish(&sample)) {
+            return sent;
+        }
+        _spillRead++;
+        sent++;
+    }
+    if (_spillCount > 0 && _spillRead >= _spillCount) {
+        _spill->clear();
+        _spillCount = 0;
+        _spillRead = 0;
+        _spillBootStart = 0;
+    }
+
+    while (sent < max && _len > 0) {
+        if (!publish(at(0))) {
+            return sent;
+        }
+        popFront(1);
+        sent++;
+    }
+    return sent;
+}
+
+void SampleBuffer::fixTimestamp(air_sample_t *sample) const {
+    if (_clockUnix != 0 && sample->timestamp == 0 && sample->uptimeMs <= _clockUptimeMs) {
+        sample->timestamp = _clockUnix - (_clockUptimeMs - sample->uptimeMs) / 1000;
+    }
+}
+
+void SampleBuffer::fixTimestamps(uint32_t nowUnix, uint32_t nowUptimeMs) {
+    _clockUnix = nowUnix;
+    _clockUptimeMs = nowUptimeMs;
+    for (size_t i = 0; i < _len; i++) {
+        fixTimestamp(at(i));
+    }
+}
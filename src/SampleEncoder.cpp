@@ -0,0 +1,250 @@
+//
+// Serialises a whole sample into one JSON or CBOR payload
+//
+
+#include <stddef.h>
+#include "NumberFormat.h"
+#include "SampleEncoder.h"
+
+typedef enum sample_field_type {
+    SAMPLE_FIELD_U32,
+    SAMPLE_FIELD_U8,
+    SAMPLE_FIELD_FLOAT,
+    SAMPLE_FIELD_FLAG,
+} sample_field_type_t;
+
+typedef struct sample_field {
+    const char *key;
+    sample_field_type_t type;
+    // Offset into air_sample_t, or the flag bit for SAMPLE_FIELD_FLAG
+    uint8_t offset;
+    // JSON decimal places for SAMPLE_FIELD_FLOAT
+    uint8_t decimals;
+    // SAMPLE_FLAG_* that must be set for the field to be included, 0 for always
+    uint8_t requires;
+    bool omitZero;
+} sample_field_t;
+
+#define SAMPLE_FIELD(key, type, member, decimals, requires, omitZero) \
+    {key, type, offsetof(air_sample_t, member), decimals, requires, omitZero}
+
+static const sample_field_t sampleFields[] = {
+        SAMPLE_FIELD("seq", SAMPLE_FIELD_U32, seq, 0, 0, false),
+        SAMPLE_FIELD("ts", SAMPLE_FIELD_U32, timestamp, 0, 0, true),
+        SAMPLE_FIELD("up", SAMPLE_FIELD_U32, uptimeMs, 0, 0, false),
+        {"replayed", SAMPLE_FIELD_FLAG, SAMPLE_FLAG_REPLAYED, 0, SAMPLE_FLAG_REPLAYED, false},
+        SAMPLE_FIELD("t_raw", SAMPLE_FIELD_FLOAT, rawTemperature, 2, SAMPLE_FLAG_BME680, false),
+        SAMPLE_FIELD("t", SAMPLE_FIELD_FLOAT, temperature, 2, SAMPLE_FLAG_BME680, false),
+        SAMPLE_FIELD("p", SAMPLE_FIELD_FLOAT, pressure, 0, SAMPLE_FLAG_BME680, false),
+        SAMPLE_FIELD("h_raw", SAMPLE_FIELD_FLOAT, rawHumidity, 2, SAMPLE_FLAG_BME680, false),
+        SAMPLE_FIELD("h", SAMPLE_FIELD_FLOAT, humidity, 2, SAMPLE_FLAG_BME680, false),
+        SAMPLE_FIELD("gas", SAMPLE_FIELD_FLOAT, gasResistance, 2, SAMPLE_FLAG_BME680, false),
+        SAMPLE_FIELD("iaq", SAMPLE_FIELD_FLOAT, iaq, 1, SAMPLE_FLAG_BME680, false),
+        SAMPLE_FIELD("iaq_acc", SAMPLE_FIELD_U8, iaqAccuracy, 0, SAMPLE_FLAG_BME680, false),
+        SAMPLE_FIELD("siaq", SAMPLE_FIELD_FLOAT, staticIaq, 1, SAMPLE_FLAG_BME680, false),
+        SAMPLE_FIELD("siaq_acc", SAMPLE_FIELD_U8, staticIaqAccuracy, 0, SAMPLE_FLAG_BME680, false),
+        SAMPLE_FIELD("co2", SAMPLE_FIELD_FLOAT, co2Equivalent, 0, SAMPLE_FLAG_BME680, false),
+        SAMPLE_FIELD("co2_acc", SAMPLE_FIELD_U8, co2Accuracy, 0, SAMPLE_FLAG_BME680, false),
+        SAMPLE_FIELD("voc", SAMPLE_FIELD_FLOAT, breathVocEquivalent, 2, SAMPLE_FLAG_BME680, false),
+        SAMPLE_FIELD("voc_acc", SAMPLE_FIELD_U8, breathVocAccuracy, 0, SAMPLE_FLAG_BME680, false),
+        {"run_in", SAMPLE_FIELD_FLAG, SAMPLE_FLAG_RUN_IN_DONE, 0, SAMPLE_FLAG_BME680, false},
+        {"stab", SAMPLE_FIELD_FLAG, SAMPLE_FLAG_STABILIZATION_DONE, 0, SAMPLE_FLAG_BME680, false},
+        SAMPLE_FIELD("pm25", SAMPLE_FIELD_FLOAT, pm25, 1, SAMPLE_FLAG_PM, false),
+        SAMPLE_FIELD("pm10", SAMPLE_FIELD_FLOAT, pm10, 1, SAMPLE_FLAG_PM, false),
+};
+
+#define SAMPLE_FIELD_COUNT (sizeof(sampleFields) / sizeof(sampleFields[0]))
+
+// Members of the packed struct may be unaligned
+static uint32_t readU32(const air_sample_t *sample, uint8_t offset) {
+    uint32_t value;
+    memcpy(&value, reinterpret_cast<const uint8_t *>(sample) + offset, sizeof(value));
+    return value;
+}
+
+static float readFloat(const air_sample_t *sample, uint8_t offset) {
+    float value;
+    memcpy(&value, reinterpret_cast<const uint8_t *>(sample) + offset, sizeof(value));
+    return value;
+}
+
+static bool fieldIncluded(const air_sample_t *sample, const sample_field_t *field) {
+    if (field->requires != 0 && (sample->flags & field->requires) == 0) {
+        return false;
+    }
+    if (field->omitZero && field->type == SAMPLE_FIELD_U32 && readU32(sample, field->offset) == 0) {
+        return false;
+    }
+    return true;
+}
+
+
+// JSON
+
+static bool jsonAppend(char *buf, size_t size, size_t *pos, const char *str, size_t len) {
+    if (*pos + len + 1 > size) {
+        return false;
+    }
+    memcpy(buf + *pos, str, len);
+    *pos += len;
+    buf[*pos] = '\0';
+    return true;
+}
+
+size_t encodeSampleJson(const air_sample_t *sample, char *buf, size_t size) {
+    size_t pos = 0;
+    if (!jsonAppend(buf, size, &pos, "{", 1)) {
+        return 0;
+    }
+
+    bool first = true;
+    for (const sample_field_t &field : sampleFields) {
+        if (!fieldIncluded(sample, &field)) {
+            continue;
+        }
+        char value[NUMBER_FORMAT_BUF_SIZE];
+        size_t valueLen;
+        switch (field.type) {
+            case SAMPLE_FIELD_U32:
+                valueLen = formatUint(value, sizeof(value), readU32(sample, field.offset));
+                break;
+            case SAMPLE_FIELD_U8:
+                valueLen = formatInt(value, sizeof(value), reinterpret_cast<const uint8_t *>(sample)[field.offset]);
+                break;
+            case SAMPLE_FIELD_FLOAT: {
+                float f = readFloat(sample, field.offset);
+                // JSON has no NaN or infinity
+                if (isnan(f) || isinf(f)) {
+                    strcpy(value, "null");
+                    valueLen = 4;
+                } else {
+                    valueLen = formatFixed(value, sizeof(value), f, field.decimals);
+                }
+                break;
+            }
+            case SAMPLE_FIELD_FLAG:
+            default:
+                valueLen = (sample->flags & field.offset) ? 4 : 5;
+                memcpy(value, (sample->flags & field.offset) ? "true" : "false", valueLen + 1);
+                break;
+        }
+        if (valueLen == 0) {
+            return 0;
+        }
+
+        if ((!first && !jsonAppend(buf, size, &pos, ",", 1)) ||
+            !jsonAppend(buf, size, &pos, "\"", 1) ||
+            !jsonAppend(buf, size, &pos, field.key, strlen(field.key)) ||
+            !jsonAppend(buf, size, &pos, "\":", 2) ||
+            !jsonAppend(buf, size, &pos, value, valueLen)) {
+            return 0;
+        }
+        first = false;
+    }
+
+    if (!jsonAppend(buf, size, &pos, "}", 1)) {
+        return 0;
+    }
+    return pos;
+}
+
+
+// CBOR
+
+#define CBOR_MAJOR_UINT 0
+#define CBOR_MAJOR_TEXT 3
+#define CBOR_MAJOR_MAP 5
+#define CBOR_FALSE 0xF4
+#define CBOR_TRUE 0xF5
+#define CBOR_FLOAT32 0xFA
+
+static bool cborPut(uint8_t *buf, size_t size, size_t *pos, uint8_t byte) {
+    if (*pos >= size) {
+        return false;
+    }
+    buf[(*pos)++] = byte;
+    return true;
+}
+
+static bool cborHead(uint8_t *buf, size_t size, size_t *pos, uint8_t major, uint32_t value) {
+    major <<= 5;
+    if (value < 24) {
+        return cborPut(buf, size, pos, major | value);
+    }
+    if (value <= 0xFF) {
+        return cborPut(buf, size, pos, major | 24) && cborPut(buf, size, pos, value);
+    }
+    if (value <= 0xFFFF) {
+        return cborPut(buf, size, pos, major | 25) && cborPut(buf, size, pos, value >> 8) &&
+               cborPut(buf, size, pos, value & 0xFF);
+    }
+    return cborPut(buf, size, pos, major | 26) && cborPut(buf, size, pos, value >> 24) &&
+           cborPut(buf, size, pos, (value >> 16) & 0xFF) && cborPut(buf, size, pos, (value >> 8) & 0xFF) &&
+           cborPut(buf, size, pos, value & 0xFF);
+}
+
+static bool cborFloat(uint8_t *buf, size_t size, size_t *pos, float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return cborPut(buf, size, pos, CBOR_FLOAT32) && cborPut(buf, size, pos, bits >> 24) &&
+           cborPut(buf, size, pos, (bits >> 16) & 0xFF) && cborPut(buf, size, pos, (bits >> 8) & 0xFF) &&
+           cborPut(buf, size, pos, bits & 0xFF);
+}
+
+size_t encodeSampleCbor(const air_sample_t *sample, uint8_t *buf, size_t size) {
+    uint32_t count = 0;
+    for (const sample_field_t &field : sampleFields) {
+        if (fieldIncluded(sample, &field)) {
+            count++;
+        }
+    }
+
+    size_t pos = 0;
+    if (!cborHead(buf, size, &pos, CBOR_MAJOR_MAP, count)) {
+        return 0;
+    }
+    for (const sample_field_t &field : sampleFields) {
+        if (!fieldIncluded(sample, &field)) {
+            continue;
+        }
+        size_t keyLen = strlen(field.key);
+        if (!cborHead(buf, size, &pos, CBOR_MAJOR_TEXT, keyLen) || pos + keyLen > size) {
+            return 0;
+        }
+        memcpy(buf + pos, field.key, keyLen);
+        pos += keyLen;
+
+        bool ok;
+        switch (field.type) {
+            case SAMPLE_FIELD_U32:
+                ok = cborHead(buf, size, &pos, CBOR_MAJOR_UINT, readU32(sample, field.offset));
+                break;
+            case SAMPLE_FIELD_U8:
+                ok = cborHead(buf, size, &pos, CBOR_MAJOR_UINT,
+                              reinterpret_cast<const uint8_t *>(sample)[field.offset]);
+                break;
+            case SAMPLE_FIELD_FLOAT:
+                ok = cborFloat(buf, size, &pos, readFloat(sample, field.offset));
+                break;
+            case SAMPLE_FIELD_FLAG:
+            default:
+                ok = cborPut(buf, size, &pos, (sample->flags & field.offset) ? CBOR_TRUE : CBOR_FALSE);
+                break;
+        }
+        if (!ok) {
+            return 0;
+        }
+    }
+    return pos;
+}
+
+size_t encodeSample(uint8_t format, const air_sample_t *sample, uint8_t *buf, size_t size) {
+    switch (format) {
+        case SAMPLE_FORMAT_JSON:
+            return encodeSampleJson(sample, reinterpret_cast<char *>(buf), size);
+        case SAMPLE_FORMAT_CBOR:
+            return encodeSampleCbor(sample, buf, size);
+        default:
+            return 0;
+    }
+}
@@ -0,0 +1,95 @@
+//
+// The combined sample on its way out
+//
+
+#include "SamplePipeline.h"
+#include "HomieLogger.h"
+#include "SampleEncoder.h"
+
+bool SamplePipeline::send(const air_sample_t *sample, bool replayed) {
+    air_sample_t out = *sample;
+    if (replayed) {
+        out.flags |= SAMPLE_FLAG_REPLAYED;
+    }
+
+    uint8_t buf[SAMPLE_ENCODER_BUF_SIZE];
+    size_t len = encodeSample(_config.format, &out, buf, sizeof(buf));
+    if (len == 0) {
+        HLogger.println(F("Failed to encode sample"));
+        _stats.encodeFailures++;
+        // Not going to work any better later, don't keep it around
+        return true;
+    }
+    // Replayed samples are the ones we already failed to deliver once, ask the broker to acknowledge them
+    if (!_publisher->publish(_config.topic, buf, len, replayed ? 1 : 0, false)) {
+        return false;
+    }
+    _stats.bytes += len;
+    return true;
+}
+
+void SamplePipeline::addPm(const sds011_pm_data_t *data) {
+    _sample.pm25 = data->pm25;
+    _sample.pm10 = data->pm10;
+    _sample.flags |= SAMPLE_FLAG_PM;
+}
+
+void SamplePipeline::addGasOutput(const gas_sensor_output_t *output) {
+    _sample.rawTemperature = output->rawTemperature;
+    _sample.temperature = output->temperature;
+    _sample.pressure = output->pressure;
+    _sample.rawHumidity = output->rawHumidity;
+    _sample.humidity = output->humidity;
+    _sample.gasResistance = output->gasResistance;
+    _sample.iaq = output->iaq;
+    _sample.iaqAccuracy = output->iaqAccuracy;
+    _sample.staticIaq = output->staticIaq;
+    _sample.staticIaqAccuracy = output->staticIaqAccuracy;
+    _sample.co2Equivalent = output->co2Equivalent;
+    _sample.co2Accuracy = output->co2Accuracy;
+    _sample.breathVocEquivalent = output->breathVocEquivalent;
+    _sample.breathVocAccuracy = output->breathVocAccuracy;
+
+    _sample.flags |= SAMPLE_FLAG_BME680;
+    _sample.flags &= ~(SAMPLE_FLAG_RUN_IN_DONE | SAMPLE_FLAG_STABILIZATION_DONE);
+    if (output->runInDone) {
+        _sample.flags |= SAMPLE_FLAG_RUN_IN_DONE;
+    }
+    if (output->stabilizationDone) {
+        _sample.flags |= SAMPLE_FLAG_STABILIZATION_DONE;
+    }
+}
+
+const air_sample_t *SamplePipeline::publish(uint32_t nowUnix, uint32_t uptimeMs) {
+    _sample.seq = _seq++;
+    _sample.timestamp = nowUnix;
+    _sample.uptimeMs = uptimeMs;
+    _stats.samples++;
+
+    if (_config.format == SAMPLE_FORMAT_NONE) {
+        return &_sample;
+    }
+    // Live samples go out right away even while a backlog is being replayed; replayed ones are flagged as such
+    if (_publisher->connected() && send(&_sample, false)) {
+        _stats.published++;
+        return &_sample;
+    }
+    if (_buffer != nullptr) {
+        _buffer->push(&_sample);
+        _stats.buffered++;
+    }
+    return &_sample;
+}
+
+size_t SamplePipeline::replay(uint32_t nowUnix, uint32_t uptimeMs) {
+    if (_buffer == nullptr || _buffer->empty() || !_publisher->connected()) {
+        return 0;
+    }
+
+    if (nowUnix != 0) {
+        _buffer->fixTimestamps(nowUnix, uptimeMs);
+    }
+    size_t sent = _buffer->replay([this](const air_sample_t *s) { return send(s, true); }, _config.replayBatch);
+    _stats.replayed += sent;
+    return sent;
+}
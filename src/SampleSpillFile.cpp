@@ -0,0 +1,47 @@
+//
+// SampleBuffer spill stored as raw air_sample_t records in a file
+//
+
+#include "SampleSpillFile.h"
+
+size_t SampleSpillFile::count() {
+    if (!_fs->exists(_path)) {
+        return 0;
+    }
+    File file = _fs->open(_path, "r");
+    if (!file) {
+        return 0;
+    }
+    size_t n = file.size() / sizeof(air_sample_t);
+    file.close();
+    return n;
+}
+
+bool SampleSpillFile::append(const air_sample_t *samples, size_t n) {
+    File file = _fs->open(_path, "a");
+    if (!file) {
+        return false;
+    }
+    size_t len = n * sizeof(air_sample_t);
+    size_t written = file.write(reinterpret_cast<const uint8_t *>(samples), len);
+    file.close();
+    return written == len;
+}
+
+size_t SampleSpillFile::read(size_t index, air_sample_t *samples, size_t n) {
+    File file = _fs->open(_path, "r");
+    if (!file) {
+        return 0;
+    }
+    if (!file.seek(index * sizeof(air_sample_t), SeekSet)) {
+        file.close();
+        return 0;
+    }
+    size_t len = file.read(reinterpret_cast<uint8_t *>(samples), n * sizeof(air_sample_t));
+    file.close();
+    return len / sizeof(air_sample_t);
+}
+
+void SampleSpillFile::clear() {
+    _fs->remove(_path);
+}
@@ -0,0 +1,92 @@
+//
+// Small cooperative scheduler
+//
+
+#include "Scheduler.h"
+
+scheduler_task_id_t Scheduler::add(const char *name, scheduler_priority_t priority, uint32_t budgetUs,
+                                   uint32_t periodMs, bool periodic, scheduler_callback_t callback) {
+    if (_count >= _capacity) {
+        return SCHEDULER_INVALID_TASK;
+    }
+    scheduler_task_t *task = &_tasks[_count];
+    task->name = name;
+    task->callback = callback;
+    task->priority = priority;
+    task->budgetUs = budgetUs;
+    task->periodMs = periodMs;
+    task->periodic = periodic;
+    task->pending = false;
+    task->nextRunMs = millis();
+    task->deferredPasses = 0;
+    task->stats = {};
+    task->latency.reset();
+    return _count++;
+}
+
+void Scheduler::signal(scheduler_task_id_t id) {
+    if (id < _count) {
+        _tasks[id].pending = true;
+    }
+}
+
+bool Scheduler::due(const scheduler_task_t *task, unsigned long now) const {
+    if (!task->periodic) {
+        return task->pending;
+    }
+    // Signed difference, so that it still works when millis() wraps around
+    return task->periodMs == 0 || (long) (now - task->nextRunMs) >= 0;
+}
+
+void Scheduler::runTask(scheduler_task_t *task) {
+    if (task->periodic) {
+        if (task->periodMs > 0) {
+            // Keep the cadence, unless the task fell behind by more than a period
+            task->nextRunMs += task->periodMs;
+            if ((long) (millis() - task->nextRunMs) >= 0) {
+                task->nextRunMs = millis() + task->periodMs;
+            }
+        }
+    } else {
+        // Signals raised while the task runs schedule it again
+        task->pending = false;
+    }
+
+    uint32_t start = LatencyStats::start();
+    task->callback();
+    uint32_t elapsed = task->latency.stop(start);
+
+    task->stats.runs++;
+    if (task->budgetUs > 0 && elapsed > task->budgetUs) {
+        task->stats.overruns++;
+    }
+}
+
+void Scheduler::run() {
+    unsigned long passStart = micros();
+
+    for (int priority = SCHEDULER_PRIORITY_HIGH; priority >= SCHEDULER_PRIORITY_LOW; priority--) {
+        for (uint8_t i = 0; i < _count; i++) {
+            scheduler_task_t *task = &_tasks[i];
+            if (task->priority != priority || !due(task, millis())) {
+                continue;
+            }
+            if (priority != SCHEDULER_PRIORITY_HIGH && micros() - passStart >= _passBudgetUs) {
+                if (task->deferredPasses < _maxDeferrals) {
+                    task->deferredPasses++;
+                    task->stats.deferrals++;
+                    continue;
+                }
+                task->stats.forcedRuns++;
+            }
+            task->deferredPasses = 0;
+            runTask(task);
+        }
+    }
+}
+
+void Scheduler::resetLatency() {
+    for (uint8_t i = 0; i < _count; i++) {
+        _tasks[i].latency.reset();
+    }
+}
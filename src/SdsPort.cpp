@@ -0,0 +1,36 @@
+//
+// Serial port an SDS011 bus runs on
+//
+
+#include "SdsPort.h"
+
+void SoftwareSdsPort::begin() {
+    _serial.begin(SDS_PORT_BAUD);
+}
+
+void SoftwareSdsPort::end() {
+    _serial.end();
+}
+
+void SoftwareSdsPort::poll() {
+    if (_serial.overflow()) {
+        _overflows++;
+    }
+}
+
+void Uart0SdsPort::begin() {
+    // The buffer can only be resized before begin()
+    Serial.setRxBufferSize(SDS_PORT_RX_BUFFER_SIZE);
+    Serial.begin(SDS_PORT_BAUD);
+    Serial.swap();
+}
+
+void Uart0SdsPort::end() {
+    Serial.end();
+}
+
+void Uart0SdsPort::poll() {
+    if (Serial.hasOverrun()) {
+        _overflows++;
+    }
+}
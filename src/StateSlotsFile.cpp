@@ -0,0 +1,35 @@
+//
+// StateStore slots stored as one file each
+//
+
+#include "StateSlotsFile.h"
+
+size_t StateSlotsFile::read(uint8_t slot, size_t offset, uint8_t *buf, size_t size) {
+    if (slot >= STATE_STORE_SLOTS || !_fs->exists(_paths[slot])) {
+        return 0;
+    }
+    File file = _fs->open(_paths[slot], "r");
+    if (!file) {
+        return 0;
+    }
+    size_t len = 0;
+    if (file.seek(offset, SeekSet)) {
+        len = file.read(buf, size);
+    }
+    file.close();
+    return len;
+}
+
+bool StateSlotsFile::write(uint8_t slot, const state_header_t *header, const uint8_t *payload, size_t len) {
+    if (slot >= STATE_STORE_SLOTS) {
+        return false;
+    }
+    File file = _fs->open(_paths[slot], "w");
+    if (!file) {
+        return false;
+    }
+    size_t written = file.write(reinterpret_cast<const uint8_t *>(header), sizeof(*header));
+    written += file.write(payload, len);
+    file.close();
+    return written == sizeof(*header) + len;
+}
@@ -0,0 +1,94 @@
+//
+// Double-buffered, CRC-protected storage for a small state blob
+//
+
+#include "StateStore.h"
+#include <stddef.h>
+
+// Bitwise CRC-32 (IEEE 802.3); the blobs are small enough that a table is not worth 1 KB of RAM
+uint32_t StateStore::crc32(uint32_t crc, const uint8_t *data, size_t len) {
+    crc = ~crc;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (uint8_t bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
+
+uint32_t StateStore::headerCrc(const state_header_t *header, const uint8_t *payload) {
+    uint32_t crc = crc32(0, reinterpret_cast<const uint8_t *>(header), offsetof(state_header_t, crc));
+    return crc32(crc, payload, header->length);
+}
+
+bool StateStore::readSlot(uint8_t slot, state_header_t *header, uint8_t *payload, size_t maxLen) {
+    if (_slots->read(slot, 0, reinterpret_cast<uint8_t *>(header), sizeof(*header)) != sizeof(*header)) {
+        return false;
+    }
+    if (header->magic != STATE_STORE_MAGIC || header->version != _version || header->length > maxLen) {
+        _stats.invalidSlots++;
+        return false;
+    }
+    if (_slots->read(slot, sizeof(*header), payload, header->length) != header->length ||
+        headerCrc(header, payload) != header->crc) {
+        _stats.invalidSlots++;
+        return false;
+    }
+    return true;
+}
+
+bool StateStore::load(uint8_t *payload, size_t maxLen, size_t *len) {
+    state_header_t header;
+    int best = -1;
+    uint32_t bestGeneration = 0;
+    for (uint8_t slot = 0; slot < STATE_STORE_SLOTS; slot++) {
+        if (readSlot(slot, &header, payload, maxLen) && (best < 0 || header.generation > bestGeneration)) {
+            best = slot;
+            bestGeneration = header.generation;
+        }
+    }
+    // The payload buffer holds whichever slot was read last
+    if (best < 0 || !readSlot(best, &header, payload, maxLen)) {
+        return false;
+    }
+
+    _stats.generation = header.generation;
+    _payloadCrc = crc32(0, payload, header.length);
+    _payloadLen = header.length;
+    _havePayload = true;
+    *len = header.length;
+    return true;
+}
+
+state_store_result_t StateStore::save(const uint8_t *payload, size_t len) {
+    if (len > UINT16_MAX) {
+        _stats.failures++;
+        return STATE_STORE_FAILED;
+    }
+    uint32_t payloadCrc = crc32(0, payload, len);
+    if (_havePayload && payloadCrc == _payloadCrc && len == _payloadLen) {
+        _stats.skipped++;
+        return STATE_STORE_UNCHANGED;
+    }
+
+    state_header_t header;
+    header.magic = STATE_STORE_MAGIC;
+    header.version = _version;
+    header.length = len;
+    header.generation = _stats.generation + 1;
+    header.crc = headerCrc(&header, payload);
+
+    // The current state stays untouched in the other slot until this write has completed
+    if (!_slots->write(header.generation % STATE_STORE_SLOTS, &header, payload, len)) {
+        _stats.failures++;
+        return STATE_STORE_FAILED;
+    }
+
+    _stats.generation = header.generation;
+    _stats.writes++;
+    _payloadCrc = payloadCrc;
+    _payloadLen = len;
+    _havePayload = true;
+    return STATE_STORE_WRITTEN;
+}
@@ -0,0 +1,81 @@
+//
+// Statistics of one series over consecutive fixed windows
+//
+
+#include "WindowStats.h"
+#include <stdio.h>
+#include "NumberFormat.h"
+
+void WindowStats::roll(uint32_t nowS) {
+    uint32_t startS = nowS - nowS % _lengthS;
+    if (startS == _startS) {
+        return;
+    }
+    if (_count > 0) {
+        _closed.startS = _startS;
+        _closed.count = _count;
+        _closed.mean = (float) (_sum / _count);
+        _closed.min = _min;
+        _closed.max = _max;
+        _closed.p50 = _p50.value();
+        _closed.p95 = _p95.value();
+        _haveClosed = true;
+    }
+    _startS = startS;
+    _count = 0;
+    _sum = 0;
+    _p50.reset();
+    _p95.reset();
+}
+
+void WindowStats::add(uint32_t nowS, float value) {
+    roll(nowS);
+    if (_count == 0 || value < _min) {
+        _min = value;
+    }
+    if (_count == 0 || value > _max) {
+        _max = value;
+    }
+    _count++;
+    _sum += value;
+    _p50.add(value);
+    _p95.add(value);
+}
+
+const window_summary_t *WindowStats::takeClosed(uint32_t nowS) {
+    roll(nowS);
+    if (!_haveClosed) {
+        return nullptr;
+    }
+    _haveClosed = false;
+    return &_closed;
+}
+
+size_t WindowStats::format(const window_summary_t *summary, uint8_t decimals, char *buf, size_t size) {
+    const float values[] = {summary->mean, summary->min, summary->max, summary->p50, summary->p95};
+    const char *const names[] = {"mean", "min", "max", "p50", "p95"};
+
+    int len = snprintf(buf, size, "{\"start\":%lu,\"n\":%lu", (unsigned long) summary->startS,
+                       (unsigned long) summary->count);
+    if (len < 0 || (size_t) len >= size) {
+        return 0;
+    }
+    for (uint8_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+        char number[NUMBER_FORMAT_BUF_SIZE];
+        if (formatFixed(number, sizeof(number), values[i], decimals) == 0) {
+            return 0;
+        }
+        int n = snprintf(buf + len, size - len, ",\"%s\":%s", names[i], number);
+        if (n < 0 || (size_t) (len + n) >= size) {
+            return 0;
+        }
+        len += n;
+    }
+
+    if ((size_t) len + 1 >= size) {
+        return 0;
+    }
+    buf[len++] = '}';
+    buf[len] = '\0';
+    return len;
+}
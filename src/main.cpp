@@ -1,70 +1,394 @@
 #include <Arduino.h>
 #include <ESP8266WiFi.h>
 #include <LeifHomieLib.h>
-#include <SoftwareSerial.h>
 #include <bsec.h>
 #include <SDS011.h>
+#include <ParticulateSensor.h>
+#include <SdsPort.h>
+#include <Scheduler.h>
+#include <LatencyStats.h>
+#include <AllocTracker.h>
 #include <ArduinoOTA.h>
 #include <ESP8266mDNS.h>
 #include <FS.h>
 #include <HomieLogger.h>
+#include <Deadband.h>
+#include <HomieRegistry.h>
+#include <NumberFormat.h>
+#include <SampleEncoder.h>
+#include <WindowStats.h>
+#include <SampleBuffer.h>
+#include <SampleSpillFile.h>
+#include <StateStore.h>
+#include <StateSlotsFile.h>
+#include <LowPowerCycle.h>
+#include <AdaptivePolling.h>
+#include <BsecRatePolicy.h>
+#include <BsecGasSensor.h>
+#include <HomiePublisher.h>
+#include <SamplePipeline.h>
+#include <RtcState.h>
+#include <time.h>
 
 #include "config.h"
 
-const uint8_t bsec_config_iaq[] = {
+// Duty-cycled operation with deep sleep between measurements, see config.sample.h and LowPowerCycle.h
+#ifndef LOW_POWER_MODE
+#define LOW_POWER_MODE 0
+#endif
+#ifndef LOW_POWER_SDS_WARMUP_S
+#define LOW_POWER_SDS_WARMUP_S 30
+#endif
+#ifndef LOW_POWER_MAX_AWAKE_MS
+#define LOW_POWER_MAX_AWAKE_MS (20 * 1000)
+#endif
+#ifndef LOW_POWER_PUBLISH_GRACE_MS
+#define LOW_POWER_PUBLISH_GRACE_MS 500
+#endif
+#ifndef LOW_POWER_FLASH_STATE_CYCLES
+#define LOW_POWER_FLASH_STATE_CYCLES 24
+#endif
+
+// BSEC samples every 3 s in LP mode; in low power mode the cycle follows its 5 minute ULP rate, the only slower one
+#if LOW_POWER_MODE
+#define LOW_POWER_CYCLE_MS (300UL * 1000)
+#define BSEC_SAMPLE_RATE BSEC_SAMPLE_RATE_ULP
+#else
+#define BSEC_SAMPLE_RATE BSEC_SAMPLE_RATE_LP
+#endif
+
+// Switching between LP and ULP as the air allows, see config.sample.h and BsecRatePolicy.h
+#ifndef BSEC_ADAPTIVE_RATE
+#define BSEC_ADAPTIVE_RATE 0
+#endif
+#ifndef BSEC_RATE_IAQ_BAND
+#define BSEC_RATE_IAQ_BAND 10.0
+#endif
+#ifndef BSEC_RATE_STABLE_S
+#define BSEC_RATE_STABLE_S (30 * 60)
+#endif
+#ifndef BSEC_RATE_MIN_ACCURACY
+#define BSEC_RATE_MIN_ACCURACY 2
+#endif
+#ifndef BSEC_RATE_ULP_FROM_HOUR
+#define BSEC_RATE_ULP_FROM_HOUR 0
+#endif
+#ifndef BSEC_RATE_ULP_TO_HOUR
+#define BSEC_RATE_ULP_TO_HOUR 0
+#endif
+#ifndef BSEC_RATE_RETRY_S
+#define BSEC_RATE_RETRY_S (10 * 60)
+#endif
+#if BSEC_ADAPTIVE_RATE && LOW_POWER_MODE
+#error "BSEC_ADAPTIVE_RATE cannot be combined with LOW_POWER_MODE, which runs BSEC at ULP"
+#endif
+
+#if BSEC_ADAPTIVE_RATE
+// Each rate has its own configuration. Both stay in flash; the one in use is copied to RAM, where BSEC reads it.
+const uint8_t bsecConfigLp[] PROGMEM = {
 #include <config/generic_33v_3s_4d/bsec_iaq.txt>
 };
+const uint8_t bsecConfigUlp[] PROGMEM = {
+#include <config/generic_33v_300s_4d/bsec_iaq.txt>
+};
+static_assert(sizeof(bsecConfigLp) == sizeof(bsecConfigUlp), "BSEC configurations differ in size");
+uint8_t bsec_config_iaq[sizeof(bsecConfigLp)];
 
-#define BSEC_STATE_FILENAME "/bsec_state.bin"
+BsecRatePolicy bsecRatePolicy({BSEC_RATE_IAQ_BAND, BSEC_RATE_STABLE_S * 1000UL, BSEC_RATE_MIN_ACCURACY,
+                               BSEC_RATE_ULP_FROM_HOUR, BSEC_RATE_ULP_TO_HOUR, BSEC_RATE_RETRY_S * 1000UL});
+#else
+const uint8_t bsec_config_iaq[] = {
+#if LOW_POWER_MODE
+#include <config/generic_33v_300s_4d/bsec_iaq.txt>
+#else
+#include <config/generic_33v_3s_4d/bsec_iaq.txt>
+#endif
+};
+#endif
+
+// BSEC state is kept in two CRC-protected slots, see StateStore.h. Earlier firmware wrote it unprotected to
+// BSEC_STATE_LEGACY_FILENAME, which is migrated on boot.
+#define BSEC_STATE_LEGACY_FILENAME "/bsec_state.bin"
+#define BSEC_STATE_SLOT_A_FILENAME "/bsec_state_a.bin"
+#define BSEC_STATE_SLOT_B_FILENAME "/bsec_state_b.bin"
+// Bump when the stored blob is no longer compatible, e.g. after a BSEC upgrade that changes the state format
+#define BSEC_STATE_VERSION 1
 #define BSEC_STATE_WRITE_INTERVAL_MS (2 * 60 * 60 * 1000)
 
 uint8_t bsecState[BSEC_MAX_STATE_BLOB_SIZE] = {0};
+StateSlotsFile bsecStateSlots(&SPIFFS, BSEC_STATE_SLOT_A_FILENAME, BSEC_STATE_SLOT_B_FILENAME);
+StateStore bsecStateStore(&bsecStateSlots, BSEC_STATE_VERSION);
 uint8_t prevBsecAccuracy = 0;
 unsigned long lastWriteBsecState = millis();
 
 bool otaRunning = false;
 
-// SDS011
-SoftwareSerial sdsSerial(SDS_RX, SDS_TX);
-SDS011 sds(&sdsSerial);
+// Startup: sensors start right away, the network comes up in the background, see taskBoot()
+typedef enum boot_state {
+    BOOT_STATE_WIFI_CONNECTING = 0,
+    BOOT_STATE_ONLINE,
+} boot_state_t;
+
+#define BOOT_WIFI_LOG_INTERVAL_MS (10 * 1000)
+
+boot_state_t bootState = BOOT_STATE_WIFI_CONNECTING;
+unsigned long bootWifiLastLog = 0;
+uint8_t bootLed = 0;
+
+// Warm restart state, see RtcState.h
+#define RTC_STATE_SAVE_INTERVAL_MS (5 * 1000)
+
+rtc_state_t rtcState = {};
+bool warmBoot = false;
+
+static_assert(BSEC_MAX_STATE_BLOB_SIZE <= RTC_STATE_BSEC_SIZE, "BSEC state does not fit into the RTC state");
+
+// Cooperative scheduler driving loop(), see setupTasks(). Normal and low priority tasks still due once a pass has run
+// for SCHEDULER_PASS_BUDGET_US are deferred to the next pass, for at most SCHEDULER_MAX_DEFERRALS passes in a row.
+#ifndef SCHEDULER_PASS_BUDGET_US
+#define SCHEDULER_PASS_BUDGET_US 20000
+#endif
+#ifndef SCHEDULER_MAX_DEFERRALS
+#define SCHEDULER_MAX_DEFERRALS 10
+#endif
+#define SCHEDULER_MAX_TASKS 12
+
+scheduler_task_t schedulerTasks[SCHEDULER_MAX_TASKS];
+Scheduler scheduler(schedulerTasks, SCHEDULER_MAX_TASKS, SCHEDULER_PASS_BUDGET_US, SCHEDULER_MAX_DEFERRALS);
+scheduler_task_id_t taskSaveBsecState = SCHEDULER_INVALID_TASK;
+
+// Loop latency diagnostics: every task, plus a few stages within them, see config.sample.h
+#ifndef DIAGNOSTICS_INTERVAL_MS
+#define DIAGNOSTICS_INTERVAL_MS (60 * 1000)
+#endif
+
+LatencyStats latencyLoop;
+LatencyStats latencyBsecRun;
+LatencyStats latencyBme680Publish;
+
+// Lowest free heap seen at the end of a loop() pass since boot
+uint32_t heapLowWater = UINT32_MAX;
+
+// Publish-on-change deadbands for the BME680 properties, see config.sample.h
+#ifndef PUBLISH_HEARTBEAT_MS
+#define PUBLISH_HEARTBEAT_MS (5 * 60 * 1000)
+#endif
+#ifndef DEADBAND_TEMPERATURE
+#define DEADBAND_TEMPERATURE 0.1
+#endif
+#ifndef DEADBAND_PRESSURE
+#define DEADBAND_PRESSURE 10
+#endif
+#ifndef DEADBAND_HUMIDITY
+#define DEADBAND_HUMIDITY 0.5
+#endif
+#ifndef DEADBAND_IAQ
+#define DEADBAND_IAQ 1
+#endif
+#ifndef DEADBAND_CO2_EQUIVALENT
+#define DEADBAND_CO2_EQUIVALENT 10
+#endif
+#ifndef DEADBAND_RELATIVE_GAS
+#define DEADBAND_RELATIVE_GAS 0.02
+#endif
+
+// Decimal places of published values, see config.sample.h
+#ifndef PRECISION_TEMPERATURE
+#define PRECISION_TEMPERATURE 2
+#endif
+#ifndef PRECISION_PRESSURE
+#define PRECISION_PRESSURE 0
+#endif
+#ifndef PRECISION_HUMIDITY
+#define PRECISION_HUMIDITY 2
+#endif
+#ifndef PRECISION_GAS
+#define PRECISION_GAS 2
+#endif
+#ifndef PRECISION_IAQ
+#define PRECISION_IAQ 1
+#endif
+#ifndef PRECISION_CO2_EQUIVALENT
+#define PRECISION_CO2_EQUIVALENT 0
+#endif
+#ifndef PRECISION_PM
+#define PRECISION_PM 1
+#endif
+
+// SDS011 units, see config.sample.h. Units with the same pins share a serial port and an SDS011 instance (a bus).
+#ifndef SDS_SENSORS
+#define SDS_SENSORS {{SDS_RX, SDS_TX, SDS011_ANY, "particulate", "Particulate sensor", 1}}
+#endif
+// Runs the unit on GPIO13/GPIO15 on UART0 instead of SoftwareSerial, see config.sample.h
+#ifndef SDS_HARDWARE_UART
+#define SDS_HARDWARE_UART 0
+#endif
+// Query-mode sampling at an interval that follows how fast PM changes, see config.sample.h and AdaptivePolling.h
+#ifndef PM_ADAPTIVE_POLLING
+#define PM_ADAPTIVE_POLLING 0
+#endif
+#ifndef PM_ADAPTIVE_MIN_INTERVAL_S
+#define PM_ADAPTIVE_MIN_INTERVAL_S 60
+#endif
+#ifndef PM_ADAPTIVE_MAX_INTERVAL_S
+#define PM_ADAPTIVE_MAX_INTERVAL_S (15 * 60)
+#endif
+#ifndef PM_ADAPTIVE_WARMUP_S
+#define PM_ADAPTIVE_WARMUP_S 30
+#endif
+#ifndef PM_ADAPTIVE_CHANGE_ABS
+#define PM_ADAPTIVE_CHANGE_ABS 2.0
+#endif
+#ifndef PM_ADAPTIVE_CHANGE_REL
+#define PM_ADAPTIVE_CHANGE_REL 0.1
+#endif
+#if PM_ADAPTIVE_POLLING && LOW_POWER_MODE
+#error "PM_ADAPTIVE_POLLING and LOW_POWER_MODE both drive the SDS011 units; enable only one"
+#endif
+#ifndef PARTICULATE_HEALTH_INTERVAL_MS
+#define PARTICULATE_HEALTH_INTERVAL_MS (60 * 1000)
+#endif
+
+const particulate_sensor_config_t sdsSensorConfig[] = SDS_SENSORS;
+#define SDS_SENSOR_COUNT (sizeof(sdsSensorConfig) / sizeof(sdsSensorConfig[0]))
+
+// Windowed PM statistics, in seconds, see config.sample.h
+#ifndef PM_WINDOWS
+#define PM_WINDOWS {60, 15 * 60, 60 * 60, 24 * 60 * 60}
+#endif
+#ifndef PM_WINDOW_CHECK_INTERVAL_MS
+#define PM_WINDOW_CHECK_INTERVAL_MS 1000
+#endif
+
+const uint32_t pmWindowLengths[] = PM_WINDOWS;
+#define PM_WINDOW_COUNT (sizeof(pmWindowLengths) / sizeof(pmWindowLengths[0]))
+
+SdsPort *sdsPorts[SDS_SENSOR_COUNT] = {nullptr};
+SDS011 *sdsBuses[SDS_SENSOR_COUNT] = {nullptr};
+uint8_t sdsBusCount = 0;
 
 HomieDevice homie;
 
-// Generic
 HomieNode *homieNodeGeneral = nullptr;
-HomieProperty *homiePropLog = nullptr;
-
-// BME680
 HomieNode *homieNodeBme680 = nullptr;
+HomieNode *homieNodeDiagnostics = nullptr;
+HomieProperty *homiePropLatencyTasks[SCHEDULER_MAX_TASKS] = {nullptr};
+
+// SDS011 properties, the same for every unit; the values come with the readings, so there are no accessors
+enum {
+    PARTICULATE_PROP_PM10,
+    PARTICULATE_PROP_PM25,
+    PARTICULATE_PROP_ONLINE,
+    PARTICULATE_PROP_FRAMES,
+    PARTICULATE_PROP_COMMAND_FAILURES,
+    PARTICULATE_PROP_ZERO_FRAMES,
+    PARTICULATE_PROP_SERIAL_OVERFLOWS,
+    PARTICULATE_PROP_CHECKSUM_FAILURES,
+    PARTICULATE_PROP_RESYNC_BYTES,
+    PARTICULATE_PROP_TIMEOUTS,
+    PARTICULATE_PROP_RETRIES,
+    PARTICULATE_PROP_SAMPLE_INTERVAL,
+    PARTICULATE_PROP_ON_TIME,
+    PARTICULATE_PROP_COUNT
+};
 
-HomieProperty *homiePropRawTemperature = nullptr;
-HomieProperty *homiePropPressure = nullptr;
-HomieProperty *homiePropRawHumidity = nullptr;
-HomieProperty *homiePropGasResistance = nullptr;
-HomieProperty *homiePropIaq = nullptr;
-HomieProperty *homiePropIaqAccuracy = nullptr;
-HomieProperty *homiePropTemperature = nullptr;
-HomieProperty *homiePropHumidity = nullptr;
-HomieProperty *homiePropStaticIaq = nullptr;
-HomieProperty *homiePropStaticIaqAccuracy = nullptr;
-HomieProperty *homiePropCo2Equivalent = nullptr;
-HomieProperty *homiePropCo2EquivalentAccuracy = nullptr;
-HomieProperty *homiePropBreathVocEquivalent = nullptr;
-HomieProperty *homiePropBreathVocEquivalentAccuracy = nullptr;
-HomieProperty *homiePropPowerOnStabStatus = nullptr;
-HomieProperty *homiePropStabStatus = nullptr;
-
-HomieProperty *homiePropBsecStatus = nullptr;
-HomieProperty *homiePropBme680Status = nullptr;
-
-// SDS011
-HomieNode *homieNodeSds011 = nullptr;
-
-HomieProperty *homiePropPm10 = nullptr;
-HomieProperty *homiePropPm25 = nullptr;
+const homie_property_desc_t particulatePropTable[] PROGMEM = {
+        {"pm10", "PM10", "μg/m³", "", homieFloat, nullptr, nullptr, PRECISION_PM, 0, 0},
+        {"pm25", "PM2.5", "μg/m³", "", homieFloat, nullptr, nullptr, PRECISION_PM, 0, 0},
+        {"online", "Online", "", "", homieBool, nullptr, nullptr, 0, 0, 0},
+        {"frames", "Frames received", "", "", homieInteger, nullptr, nullptr, 0, 0, 0},
+        {"command-failures", "Failed commands", "", "", homieInteger, nullptr, nullptr, 0, 0, 0},
+        {"zero-frames", "Frames reading 0/0", "", "", homieInteger, nullptr, nullptr, 0, 0, 0},
+        // Of the port and bus, which are shared by the units on the same pins, see sds011_link_stats_t
+        {"serial-overflows", "Serial receive buffer overflows", "", "", homieInteger, nullptr, nullptr, 0, 0, 0},
+        {"checksum-failures", "Frames failing the checksum", "", "", homieInteger, nullptr, nullptr, 0, 0, 0},
+        {"resync-bytes", "Bytes skipped to resynchronize", "B", "", homieInteger, nullptr, nullptr, 0, 0, 0},
+        {"timeouts", "Commands without response", "", "", homieInteger, nullptr, nullptr, 0, 0, 0},
+        {"retries", "Commands sent again", "", "", homieInteger, nullptr, nullptr, 0, 0, 0},
+        // Only published with PM_ADAPTIVE_POLLING
+        {"sample-interval", "Sampling interval", "s", "", homieInteger, nullptr, nullptr, 0, 0, 0},
+        {"on-time", "Fan and laser on time since boot", "s", "", homieInteger, nullptr, nullptr, 0, 0, 0},
+};
+static_assert(sizeof(particulatePropTable) / sizeof(particulatePropTable[0]) == PARTICULATE_PROP_COUNT,
+              "particulatePropTable does not match its index");
+
+// SDS011, one node per unit
+typedef struct particulate_unit {
+    ParticulateSensor *sensor;
+    // Null unless PM_ADAPTIVE_POLLING
+    AdaptivePolling *adaptive;
+    SdsPort *port;
+    HomieNode *node;
+    // Rows of particulatePropTable
+    HomieProperty *props[PARTICULATE_PROP_COUNT];
+    HomieRegistry *registry;
+    // PM2.5 and PM10 for each of pmWindowLengths, in that order
+    WindowStats *windows[2 * PM_WINDOW_COUNT];
+    HomieProperty *propWindows[2 * PM_WINDOW_COUNT];
+} particulate_unit_t;
+
+particulate_unit_t particulateUnits[SDS_SENSOR_COUNT] = {};
+
+#if LOW_POWER_MODE
+ParticulateSensor *lowPowerSensors[SDS_SENSOR_COUNT] = {nullptr};
+LowPowerCycle lowPowerCycle({LOW_POWER_CYCLE_MS, LOW_POWER_SDS_WARMUP_S * 1000UL, LOW_POWER_MAX_AWAKE_MS},
+                            lowPowerSensors, SDS_SENSOR_COUNT);
+// Warm-up wakes only run the SDS011 units, see setupLowPowerWarmup()
+bool lowPowerWarmupWake = false;
+bool lowPowerBme680Done = false;
+unsigned long lowPowerSettledMs = 0;
+#endif
+
+// Combined samples, see config.sample.h
+#ifndef SAMPLE_FORMAT
+#define SAMPLE_FORMAT SAMPLE_FORMAT_NONE
+#endif
+#ifndef SAMPLE_TOPIC
+#define SAMPLE_TOPIC "air-sensor/sample"
+#endif
+#ifndef SAMPLE_PER_PROPERTY
+#define SAMPLE_PER_PROPERTY 1
+#endif
+#ifndef NTP_SERVER
+#define NTP_SERVER "pool.ntp.org"
+#endif
+
+// Anything earlier means SNTP has not set the clock yet
+#define SAMPLE_MIN_VALID_TIME 1600000000
+
+// Store-and-forward of combined samples while offline, see config.sample.h
+#ifndef SAMPLE_BUFFER_CAPACITY
+#define SAMPLE_BUFFER_CAPACITY 64
+#endif
+#ifndef SAMPLE_SPILL_MAX_RECORDS
+#define SAMPLE_SPILL_MAX_RECORDS 2048
+#endif
+#ifndef SAMPLE_REPLAY_BATCH
+#define SAMPLE_REPLAY_BATCH 5
+#endif
+#ifndef SAMPLE_REPLAY_INTERVAL_MS
+#define SAMPLE_REPLAY_INTERVAL_MS 1000
+#endif
+
+#define SAMPLE_SPILL_FILENAME "/samples.bin"
+
+#if SAMPLE_FORMAT != SAMPLE_FORMAT_NONE
+air_sample_t sampleBufferStorage[SAMPLE_BUFFER_CAPACITY];
+SampleSpillFile sampleSpill(&SPIFFS, SAMPLE_SPILL_FILENAME);
+SampleBuffer sampleBuffer(sampleBufferStorage, SAMPLE_BUFFER_CAPACITY,
+                          SAMPLE_SPILL_MAX_RECORDS > 0 ? &sampleSpill : nullptr, SAMPLE_SPILL_MAX_RECORDS);
+#endif
+
+HomiePublisher samplePublisher(&homie);
+#if SAMPLE_FORMAT != SAMPLE_FORMAT_NONE
+SamplePipeline samplePipeline({SAMPLE_FORMAT, SAMPLE_TOPIC, SAMPLE_REPLAY_BATCH}, &samplePublisher, &sampleBuffer);
+#else
+SamplePipeline samplePipeline({SAMPLE_FORMAT, SAMPLE_TOPIC, SAMPLE_REPLAY_BATCH}, &samplePublisher, nullptr);
+#endif
 
 // BSEC crap
 Bsec bsec;
+BsecGasSensor gasSensor(&bsec);
 int16_t lastBmeStatus = 0x7FFF;
 int16_t lastBsecStatus = 0x7FFF;
 
@@ -83,8 +407,39 @@ bsec_virtual_sensor_t bsecSensorList[] = {
         BSEC_OUTPUT_STABILIZATION_STATUS
 };
 
+// Called periodically and before any intentional restart
+void saveRtcState() {
+    rtcState.sampleSeq = samplePipeline.seq();
+    rtcState.bsecGeneration = bsecStateStore.stats().generation;
+    for (size_t i = 0; i < SDS_SENSOR_COUNT && i < RTC_STATE_MAX_UNITS; i++) {
+        const ParticulateSensor *sensor = particulateUnits[i].sensor;
+        rtc_unit_state_t *rtcUnit = &rtcState.units[i];
+        // Not set up yet if called from an early panic
+        if (sensor == nullptr) {
+            continue;
+        }
+        if (rtcUnit->deviceId != sensor->deviceId()) {
+            rtcUnit->pm25 = rtcUnit->pm10 = 0;
+        }
+        rtcUnit->deviceId = sensor->deviceId();
+        rtcUnit->workingPeriod = sensor->workingPeriod();
+        rtcUnit->configured = sensor->state() == PARTICULATE_STATE_READY;
+        // Restored readings are kept until the unit reports again
+        if (sensor->lastReading() != nullptr) {
+            rtcUnit->pm25 = sensor->lastReading()->pm25;
+            rtcUnit->pm10 = sensor->lastReading()->pm10;
+        }
+    }
+#if LOW_POWER_MODE
+    rtcState.lowPower = lowPowerCycle.state();
+#endif
+    rtcStateSave(&rtcState);
+}
+
 // Panic but ensure OTA still works for 3 seconds
 void otaPanic() {
+    saveRtcState();
+    HLogger.flush();
     unsigned long start = millis();
     while (millis() - start < 3000) {
         ArduinoOTA.handle();
@@ -93,217 +448,672 @@ void otaPanic() {
     panic();
 }
 
+// Homie properties, one table row each, see HomieRegistry.h. Per-task latencies and PM windows are named at runtime
+// and built in setupHomieTree().
+enum {
+    GENERAL_PROP_LOG,
+    GENERAL_PROP_COUNT
+};
+
+const homie_property_desc_t generalPropTable[] PROGMEM = {
+        {"log", "Log", "", "", homieString, nullptr, nullptr, 0, 0, 0},
+};
+static_assert(sizeof(generalPropTable) / sizeof(generalPropTable[0]) == GENERAL_PROP_COUNT,
+              "generalPropTable does not match its index");
+
+HomieProperty *generalProps[GENERAL_PROP_COUNT];
+HomieRegistry generalRegistry(generalPropTable, GENERAL_PROP_COUNT, generalProps, nullptr);
+
+// Rows with an accessor are published after every BSEC sample, each through its own deadband
+enum {
+    BME680_PROP_RAW_TEMPERATURE,
+    BME680_PROP_TEMPERATURE,
+    BME680_PROP_PRESSURE,
+    BME680_PROP_RAW_HUMIDITY,
+    BME680_PROP_HUMIDITY,
+    BME680_PROP_GAS_RESISTANCE,
+    BME680_PROP_IAQ,
+    BME680_PROP_IAQ_ACCURACY,
+    BME680_PROP_STATIC_IAQ,
+    BME680_PROP_STATIC_IAQ_ACCURACY,
+    BME680_PROP_CO2_EQUIVALENT,
+    BME680_PROP_CO2_EQUIVALENT_ACCURACY,
+    BME680_PROP_BREATH_VOC_EQUIVALENT,
+    BME680_PROP_BREATH_VOC_EQUIVALENT_ACCURACY,
+    BME680_PROP_BSEC_STATUS,
+    BME680_PROP_BME680_STATUS,
+    BME680_PROP_POWER_ON_STAB_STATUS,
+    BME680_PROP_STAB_STATUS,
+    BME680_PROP_SAMPLE_RATE,
+    BME680_PROP_SAMPLE_RATE_MODE,
+    BME680_PROP_COUNT
+};
+
+const homie_property_desc_t bme680PropTable[] PROGMEM = {
+        {"raw-temperature", "Raw temperature", "°C", "", homieFloat,
+         []() -> float { return bsec.rawTemperature; }, nullptr, PRECISION_TEMPERATURE, DEADBAND_TEMPERATURE, 0},
+        {"temperature", "Temperature", "°C", "", homieFloat,
+         []() -> float { return bsec.temperature; }, nullptr, PRECISION_TEMPERATURE, DEADBAND_TEMPERATURE, 0},
+        {"pressure", "Pressure", "Pa", "", homieFloat,
+         []() -> float { return bsec.pressure; }, nullptr, PRECISION_PRESSURE, DEADBAND_PRESSURE, 0},
+        {"raw-humidity", "Raw humidity", "%", "0:100", homieFloat,
+         []() -> float { return bsec.rawHumidity; }, nullptr, PRECISION_HUMIDITY, DEADBAND_HUMIDITY, 0},
+        {"humidity", "Humidity", "%", "0:100", homieFloat,
+         []() -> float { return bsec.humidity; }, nullptr, PRECISION_HUMIDITY, DEADBAND_HUMIDITY, 0},
+        {"gas-resistance", "Gas resistance", "Ω", "", homieFloat,
+         []() -> float { return bsec.gasPercentageAcccuracy; }, nullptr, PRECISION_GAS, 0, DEADBAND_RELATIVE_GAS},
+        {"iaq", "IAQ", "", "0:500", homieFloat,
+         []() -> float { return bsec.iaq; }, nullptr, PRECISION_IAQ, DEADBAND_IAQ, 0},
+        {"iaq-accuracy", "IAQ accuracy", "", "", homieInteger,
+         nullptr, []() -> uint32_t { return bsec.iaqAccuracy; }, 0, 0, 0},
+        {"static-iaq", "Static IAQ", "", "", homieFloat,
+         []() -> float { return bsec.staticIaq; }, nullptr, PRECISION_IAQ, DEADBAND_IAQ, 0},
+        {"static-iaq-accuracy", "Static IAQ accuracy", "", "", homieInteger,
+         nullptr, []() -> uint32_t { return bsec.staticIaqAccuracy; }, 0, 0, 0},
+        {"co2-equivalent", "CO₂ equivalent", "ppm", "", homieFloat,
+         []() -> float { return bsec.co2Equivalent; }, nullptr, PRECISION_CO2_EQUIVALENT, DEADBAND_CO2_EQUIVALENT, 0},
+        {"co2-equivalent-accuracy", "CO₂ equivalent accuracy", "", "", homieInteger,
+         nullptr, []() -> uint32_t { return bsec.co2Accuracy; }, 0, 0, 0},
+        {"breath-voc-equivalent", "Breath VOC equivalent", "ppm", "", homieFloat,
+         []() -> float { return bsec.breathVocEquivalent; }, nullptr, PRECISION_GAS, 0, DEADBAND_RELATIVE_GAS},
+        {"breath-voc-equivalent-accuracy", "Breath VOC equivalent accuracy", "", "", homieInteger,
+         nullptr, []() -> uint32_t { return bsec.breathVocAccuracy; }, 0, 0, 0},
+        // Published on change by taskStatus()
+        {"bsec-status", "BSEC status", "", "", homieInteger, nullptr, nullptr, 0, 0, 0},
+        {"bme680-status", "BME680 status", "", "", homieInteger, nullptr, nullptr, 0, 0, 0},
+        {"power-on-stabilization-done", "Power-on stabilization status", "", "", homieBool,
+         nullptr, []() -> uint32_t { return bsec.runInStatus ? 1 : 0; }, 0, 0, 0},
+        {"stabilization-done", "Stabilization status", "", "", homieBool,
+         nullptr, []() -> uint32_t { return bsec.stabStatus ? 1 : 0; }, 0, 0, 0},
+        // Published on boot and on every switch. The mode is only settable with BSEC_ADAPTIVE_RATE.
+        {"sample-rate", "BSEC sample rate", "", "lp,ulp", homieEnum, nullptr, nullptr, 0, 0, 0},
+        {"sample-rate-mode", "BSEC sample rate mode", "", "auto,lp,ulp", homieEnum, nullptr, nullptr, 0, 0, 0},
+};
+static_assert(sizeof(bme680PropTable) / sizeof(bme680PropTable[0]) == BME680_PROP_COUNT,
+              "bme680PropTable does not match its index");
+
+HomieProperty *bme680Props[BME680_PROP_COUNT];
+Deadband bme680Deadbands[BME680_PROP_COUNT];
+HomieRegistry bme680Registry(bme680PropTable, BME680_PROP_COUNT, bme680Props, bme680Deadbands);
+
+// Rows with an accessor are published by taskDiagnostics(), every time; the latencies are formatted there
+enum {
+    DIAGNOSTICS_PROP_LATENCY_LOOP,
+    DIAGNOSTICS_PROP_LATENCY_BSEC_RUN,
+    DIAGNOSTICS_PROP_LATENCY_BME680_PUBLISH,
+    DIAGNOSTICS_PROP_FREE_HEAP,
+    DIAGNOSTICS_PROP_MAX_FREE_BLOCK,
+    DIAGNOSTICS_PROP_HEAP_FRAGMENTATION,
+    DIAGNOSTICS_PROP_HEAP_LOW_WATER,
+    DIAGNOSTICS_PROP_BSEC_STATE_WRITES,
+    DIAGNOSTICS_PROP_BSEC_STATE_SKIPPED,
+    DIAGNOSTICS_PROP_COUNT
+};
+
+const homie_property_desc_t diagnosticsPropTable[] PROGMEM = {
+        {"latency-loop", "Loop latency", "", "", homieString, nullptr, nullptr, 0, 0, 0},
+        {"latency-bsec-run", "BSEC run latency", "", "", homieString, nullptr, nullptr, 0, 0, 0},
+        {"latency-bme680-publish", "BME680 publish latency", "", "", homieString, nullptr, nullptr, 0, 0, 0},
+        {"free-heap", "Free heap", "B", "", homieInteger,
+         nullptr, []() -> uint32_t { return ESP.getFreeHeap(); }, 0, 0, 0},
+        {"max-free-block", "Largest free heap block", "B", "", homieInteger,
+         nullptr, []() -> uint32_t { return ESP.getMaxFreeBlockSize(); }, 0, 0, 0},
+        {"heap-fragmentation", "Heap fragmentation", "%", "", homieInteger,
+         nullptr, []() -> uint32_t { return ESP.getHeapFragmentation(); }, 0, 0, 0},
+        {"heap-low-water", "Lowest free heap since boot", "B", "", homieInteger,
+         nullptr, []() -> uint32_t { return heapLowWater; }, 0, 0, 0},
+        {"bsec-state-writes", "BSEC state writes (lifetime, both slots)", "", "", homieInteger,
+         nullptr, []() -> uint32_t { return bsecStateStore.stats().generation; }, 0, 0, 0},
+        {"bsec-state-skipped", "Unchanged BSEC state writes skipped since boot", "", "", homieInteger,
+         nullptr, []() -> uint32_t { return bsecStateStore.stats().skipped; }, 0, 0, 0},
+};
+static_assert(sizeof(diagnosticsPropTable) / sizeof(diagnosticsPropTable[0]) == DIAGNOSTICS_PROP_COUNT,
+              "diagnosticsPropTable does not match its index");
+
+HomieProperty *diagnosticsProps[DIAGNOSTICS_PROP_COUNT];
+HomieRegistry diagnosticsRegistry(diagnosticsPropTable, DIAGNOSTICS_PROP_COUNT, diagnosticsProps, nullptr);
+
+#if BSEC_ADAPTIVE_RATE
+
+// Loads the configuration for `rate`, restores `state` into it and subscribes at that rate
+bool applyBsecRate(bsec_rate_t rate, uint8_t *state) {
+    memcpy_P(bsec_config_iaq, rate == BSEC_RATE_ULP ? bsecConfigUlp : bsecConfigLp, sizeof(bsec_config_iaq));
+    bsec.setConfig(bsec_config_iaq);
+    if (bsec.status < BSEC_OK) {
+        return false;
+    }
+    bsec.setState(state);
+    if (bsec.status < BSEC_OK) {
+        return false;
+    }
+    bsec.updateSubscription(bsecSensorList, sizeof(bsecSensorList),
+                            rate == BSEC_RATE_ULP ? BSEC_SAMPLE_RATE_ULP : BSEC_SAMPLE_RATE_LP);
+    return bsec.status >= BSEC_OK;
+}
+
+// Switches BSEC to the rate the policy asks for. Setting a configuration starts BSEC over, so its state (the IAQ
+// baseline and calibration) is taken before and restored after; if BSEC rejects the switch it goes back to the
+// previous rate with the same state.
+void updateBsecRate() {
+    time_t now = time(nullptr);
+    int hour = now > SAMPLE_MIN_VALID_TIME ? gmtime(&now)->tm_hour : -1;
+    bsec_rate_t previous = bsecRatePolicy.rate();
+    bsec_rate_t rate = bsecRatePolicy.decide(millis(), hour);
+    if (rate == previous) {
+        return;
+    }
+
+    bsec.getState(bsecState);
+    if (applyBsecRate(rate, bsecState)) {
+        bsecRatePolicy.applied(rate);
+        if (rate == BSEC_RATE_LP) {
+            // Otherwise the first LP sample waits for the ULP one that was due
+            bsec.nextCall = 0;
+        }
+        HLogger.print(F("BSEC sample rate "));
+        HLogger.print(BsecRatePolicy::rateName(rate));
+        HLogger.print(F(", reason "));
+        HLogger.println(BsecRatePolicy::reasonName(bsecRatePolicy.reason()));
+        bme680Registry.property(BME680_PROP_SAMPLE_RATE)->SetValue(BsecRatePolicy::rateName(rate));
+        return;
+    }
+
+    HLogger.print(F("BSEC rejected sample rate "));
+    HLogger.print(BsecRatePolicy::rateName(rate));
+    HLogger.print(F(", status "));
+    HLogger.println(bsec.status);
+    bsecRatePolicy.failed(millis());
+    if (!applyBsecRate(previous, bsecState)) {
+        HLogger.println(F("BSEC failed to return to the previous sample rate"));
+    }
+}
+
+#endif
+
+// As used in property IDs: "15m", "1h", "24h"
+void formatWindowLength(char *buf, size_t size, uint32_t seconds) {
+    if (seconds % 3600 == 0) {
+        snprintf(buf, size, "%luh", (unsigned long) (seconds / 3600));
+    } else if (seconds % 60 == 0) {
+        snprintf(buf, size, "%lum", (unsigned long) (seconds / 60));
+    } else {
+        snprintf(buf, size, "%lus", (unsigned long) seconds);
+    }
+}
+
 void setupHomieTree() {
     homieNodeGeneral = homie.NewNode();
     homieNodeGeneral->strID = "general";
     homieNodeGeneral->strFriendlyName = "General";
-
-    homiePropLog = homieNodeGeneral->NewProperty();
-    homiePropLog->SetRetained(true);
-    homiePropLog->SetSettable(false);
-    homiePropLog->strID = "log";
-    homiePropLog->strFriendlyName = "Log";
-    homiePropLog->datatype = homieString;
+    generalRegistry.build(homieNodeGeneral, PUBLISH_HEARTBEAT_MS);
 
     homieNodeBme680 = homie.NewNode();
     homieNodeBme680->strID = "air-quality";
     homieNodeBme680->strFriendlyName = "Air quality sensor";
     homieNodeBme680->strType = "BME680";
+    bme680Registry.build(homieNodeBme680, PUBLISH_HEARTBEAT_MS);
+#if BSEC_ADAPTIVE_RATE
+    HomieProperty *propRateMode = bme680Registry.property(BME680_PROP_SAMPLE_RATE_MODE);
+    propRateMode->SetSettable(true);
+    propRateMode->AddCallback([](HomieProperty *prop) {
+        bsec_rate_mode_t mode;
+        if (!BsecRatePolicy::parseMode(prop->GetValue().c_str(), &mode)) {
+            HLogger.print(F("Ignoring BSEC sample rate mode "));
+            HLogger.println(prop->GetValue());
+            prop->SetValue(BsecRatePolicy::modeName(bsecRatePolicy.mode()));
+            return;
+        }
+        bsecRatePolicy.setMode(mode);
+        prop->SetValue(BsecRatePolicy::modeName(mode));
+        // Takes effect right away rather than with the next sample, which may be 5 minutes off at ULP
+        updateBsecRate();
+    });
+    propRateMode->SetValue(BsecRatePolicy::modeName(bsecRatePolicy.mode()));
+    bme680Registry.property(BME680_PROP_SAMPLE_RATE)->SetValue(BsecRatePolicy::rateName(bsecRatePolicy.rate()));
+#else
+    bme680Registry.property(BME680_PROP_SAMPLE_RATE)->SetValue(LOW_POWER_MODE ? "ulp" : "lp");
+#endif
+
+    for (size_t i = 0; i < SDS_SENSOR_COUNT; i++) {
+        particulate_unit_t *unit = &particulateUnits[i];
+
+        unit->node = homie.NewNode();
+        unit->node->strID = sdsSensorConfig[i].nodeId;
+        unit->node->strFriendlyName = sdsSensorConfig[i].name;
+        unit->node->strType = "SDS011";
+        unit->registry = new HomieRegistry(particulatePropTable, PARTICULATE_PROP_COUNT, unit->props, nullptr);
+        unit->registry->build(unit->node, PUBLISH_HEARTBEAT_MS);
+
+        for (size_t w = 0; w < 2 * PM_WINDOW_COUNT; w++) {
+            char length[12];
+            formatWindowLength(length, sizeof(length), pmWindowLengths[w / 2]);
+            bool pm25 = w % 2 == 0;
+            unit->propWindows[w] = unit->node->NewProperty();
+            unit->propWindows[w]->SetRetained(true);
+            unit->propWindows[w]->SetSettable(false);
+            unit->propWindows[w]->strID = String(pm25 ? "pm25-" : "pm10-") + length;
+            unit->propWindows[w]->strFriendlyName = String(pm25 ? "PM2.5, " : "PM10, ") + length + " window";
+            unit->propWindows[w]->datatype = homieString;
+        }
+    }
 
-    homiePropRawTemperature = homieNodeBme680->NewProperty();
-    homiePropRawTemperature->SetRetained(true);
-    homiePropRawTemperature->SetSettable(false);
-    homiePropRawTemperature->strID = "raw-temperature";
-    homiePropRawTemperature->strFriendlyName = "Raw temperature";
-    homiePropRawTemperature->datatype = homieFloat;
-    homiePropRawTemperature->SetUnit("°C");
-
-    homiePropTemperature = homieNodeBme680->NewProperty();
-    homiePropTemperature->SetRetained(true);
-    homiePropTemperature->SetSettable(false);
-    homiePropTemperature->strID = "temperature";
-    homiePropTemperature->strFriendlyName = "Temperature";
-    homiePropTemperature->datatype = homieFloat;
-    homiePropTemperature->SetUnit("°C");
-
-    homiePropPressure = homieNodeBme680->NewProperty();
-    homiePropPressure->SetRetained(true);
-    homiePropPressure->SetSettable(false);
-    homiePropPressure->strID = "pressure";
-    homiePropPressure->strFriendlyName = "Pressure";
-    homiePropPressure->datatype = homieFloat;
-    homiePropPressure->SetUnit("Pa");
-
-    homiePropRawHumidity = homieNodeBme680->NewProperty();
-    homiePropRawHumidity->SetRetained(true);
-    homiePropRawHumidity->SetSettable(false);
-    homiePropRawHumidity->strID = "raw-humidity";
-    homiePropRawHumidity->strFriendlyName = "Raw humidity";
-    homiePropRawHumidity->datatype = homieFloat;
-    homiePropRawHumidity->SetUnit("%");
-    homiePropRawHumidity->strFormat = "0:100";
-
-    homiePropHumidity = homieNodeBme680->NewProperty();
-    homiePropHumidity->SetRetained(true);
-    homiePropHumidity->SetSettable(false);
-    homiePropHumidity->strID = "humidity";
-    homiePropHumidity->strFriendlyName = "Humidity";
-    homiePropHumidity->datatype = homieFloat;
-    homiePropHumidity->SetUnit("%");
-    homiePropHumidity->strFormat = "0:100";
-
-    homiePropGasResistance = homieNodeBme680->NewProperty();
-    homiePropGasResistance->SetRetained(true);
-    homiePropGasResistance->SetSettable(false);
-    homiePropGasResistance->strID = "gas-resistance";
-    homiePropGasResistance->strFriendlyName = "Gas resistance";
-    homiePropGasResistance->datatype = homieFloat;
-    homiePropGasResistance->SetUnit("Ω");
-
-    homiePropIaq = homieNodeBme680->NewProperty();
-    homiePropIaq->SetRetained(true);
-    homiePropIaq->SetSettable(false);
-    homiePropIaq->strID = "iaq";
-    homiePropIaq->strFriendlyName = "IAQ";
-    homiePropIaq->strFormat = "0:500";
-    homiePropIaq->datatype = homieFloat;
-
-    homiePropIaqAccuracy = homieNodeBme680->NewProperty();
-    homiePropIaqAccuracy->SetRetained(true);
-    homiePropIaqAccuracy->SetSettable(false);
-    homiePropIaqAccuracy->strID = "iaq-accuracy";
-    homiePropIaqAccuracy->strFriendlyName = "IAQ accuracy";
-    homiePropIaqAccuracy->datatype = homieInteger;
-
-    homiePropStaticIaq = homieNodeBme680->NewProperty();
-    homiePropStaticIaq->SetRetained(true);
-    homiePropStaticIaq->SetSettable(false);
-    homiePropStaticIaq->strID = "static-iaq";
-    homiePropStaticIaq->strFriendlyName = "Static IAQ";
-    homiePropStaticIaq->datatype = homieFloat;
-
-    homiePropStaticIaqAccuracy = homieNodeBme680->NewProperty();
-    homiePropStaticIaqAccuracy->SetRetained(true);
-    homiePropStaticIaqAccuracy->SetSettable(false);
-    homiePropStaticIaqAccuracy->strID = "static-iaq-accuracy";
-    homiePropStaticIaqAccuracy->strFriendlyName = "Static IAQ accuracy";
-    homiePropStaticIaqAccuracy->datatype = homieInteger;
-
-    homiePropCo2Equivalent = homieNodeBme680->NewProperty();
-    homiePropCo2Equivalent->SetRetained(true);
-    homiePropCo2Equivalent->SetSettable(false);
-    homiePropCo2Equivalent->strID = "co2-equivalent";
-    homiePropCo2Equivalent->strFriendlyName = "CO₂ equivalent";
-    homiePropCo2Equivalent->datatype = homieFloat;
-    homiePropCo2Equivalent->SetUnit("ppm");
-
-    homiePropCo2EquivalentAccuracy = homieNodeBme680->NewProperty();
-    homiePropCo2EquivalentAccuracy->SetRetained(true);
-    homiePropCo2EquivalentAccuracy->SetSettable(false);
-    homiePropCo2EquivalentAccuracy->strID = "co2-equivalent-accuracy";
-    homiePropCo2EquivalentAccuracy->strFriendlyName = "CO₂ equivalent accuracy";
-    homiePropCo2EquivalentAccuracy->datatype = homieInteger;
-
-    homiePropBreathVocEquivalent = homieNodeBme680->NewProperty();
-    homiePropBreathVocEquivalent->SetRetained(true);
-    homiePropBreathVocEquivalent->SetSettable(false);
-    homiePropBreathVocEquivalent->strID = "breath-voc-equivalent";
-    homiePropBreathVocEquivalent->strFriendlyName = "Breath VOC equivalent";
-    homiePropBreathVocEquivalent->datatype = homieFloat;
-    homiePropBreathVocEquivalent->SetUnit("ppm");
-
-    homiePropBreathVocEquivalentAccuracy = homieNodeBme680->NewProperty();
-    homiePropBreathVocEquivalentAccuracy->SetRetained(true);
-    homiePropBreathVocEquivalentAccuracy->SetSettable(false);
-    homiePropBreathVocEquivalentAccuracy->strID = "breath-voc-equivalent-accuracy";
-    homiePropBreathVocEquivalentAccuracy->strFriendlyName = "Breath VOC equivalent accuracy";
-    homiePropBreathVocEquivalentAccuracy->datatype = homieInteger;
-
-    homiePropBsecStatus = homieNodeBme680->NewProperty();
-    homiePropBsecStatus->SetRetained(true);
-    homiePropBsecStatus->SetSettable(false);
-    homiePropBsecStatus->strID = "bsec-status";
-    homiePropBsecStatus->strFriendlyName = "BSEC status";
-    homiePropBsecStatus->datatype = homieInteger;
-
-    homiePropBme680Status = homieNodeBme680->NewProperty();
-    homiePropBme680Status->SetRetained(true);
-    homiePropBme680Status->SetSettable(false);
-    homiePropBme680Status->strID = "bme680-status";
-    homiePropBme680Status->strFriendlyName = "BME680 status";
-    homiePropBme680Status->datatype = homieInteger;
-
-    homiePropPowerOnStabStatus = homieNodeBme680->NewProperty();
-    homiePropPowerOnStabStatus->SetRetained(true);
-    homiePropPowerOnStabStatus->SetSettable(false);
-    homiePropPowerOnStabStatus->strID = "power-on-stabilization-done";
-    homiePropPowerOnStabStatus->strFriendlyName = "Power-on stabilization status";
-    homiePropPowerOnStabStatus->datatype = homieBool;
-
-    homiePropStabStatus = homieNodeBme680->NewProperty();
-    homiePropStabStatus->SetRetained(true);
-    homiePropStabStatus->SetSettable(false);
-    homiePropStabStatus->strID = "stabilization-done";
-    homiePropStabStatus->strFriendlyName = "Stabilization status";
-    homiePropStabStatus->datatype = homieBool;
-
-    homieNodeSds011 = homie.NewNode();
-    homieNodeSds011->strID = "particulate";
-    homieNodeSds011->strFriendlyName = "Particulate sensor";
-    homieNodeSds011->strType = "SDS011";
-
-    homiePropPm10 = homieNodeSds011->NewProperty();
-    homiePropPm10->SetRetained(true);
-    homiePropPm10->SetSettable(false);
-    homiePropPm10->strID = "pm10";
-    homiePropPm10->strFriendlyName = "PM10";
-    homiePropPm10->datatype = homieFloat;
-    homiePropPm10->SetUnit("μg/m³");
-
-    homiePropPm25 = homieNodeSds011->NewProperty();
-    homiePropPm25->SetRetained(true);
-    homiePropPm25->SetSettable(false);
-    homiePropPm25->strID = "pm25";
-    homiePropPm25->strFriendlyName = "PM2.5";
-    homiePropPm25->datatype = homieFloat;
-    homiePropPm25->SetUnit("μg/m³");
+    homieNodeDiagnostics = homie.NewNode();
+    homieNodeDiagnostics->strID = "diagnostics";
+    homieNodeDiagnostics->strFriendlyName = "Diagnostics";
+    diagnosticsRegistry.build(homieNodeDiagnostics, PUBLISH_HEARTBEAT_MS);
+
+    // One per scheduler task, so setupTasks() must run first
+    for (uint8_t i = 0; i < scheduler.count(); i++) {
+        const char *name = scheduler.task(i)->name;
+        homiePropLatencyTasks[i] = homieNodeDiagnostics->NewProperty();
+        homiePropLatencyTasks[i]->SetRetained(true);
+        homiePropLatencyTasks[i]->SetSettable(false);
+        homiePropLatencyTasks[i]->strID = String("latency-task-") + name;
+        homiePropLatencyTasks[i]->strFriendlyName = String("Task latency: ") + name;
+        homiePropLatencyTasks[i]->datatype = homieString;
+    }
 }
 
 void saveBsecState() {
     bsec.getState(bsecState);
-    File file = SPIFFS.open(BSEC_STATE_FILENAME, "w");
-    file.write(bsecState, sizeof(bsecState));
-    file.close();
     lastWriteBsecState = millis();
-    HLogger.println("BSEC state persisted");
+
+    switch (bsecStateStore.save(bsecState, sizeof(bsecState))) {
+        case STATE_STORE_WRITTEN:
+            HLogger.print(F("BSEC state persisted, generation "));
+            HLogger.println(bsecStateStore.stats().generation);
+            break;
+        case STATE_STORE_UNCHANGED:
+            HLogger.println(F("BSEC state unchanged, not persisted"));
+            break;
+        case STATE_STORE_FAILED:
+            HLogger.println(F("Failed to persist BSEC state"));
+            break;
+    }
 }
 
-void setup() {
-    Serial.begin(74880);
-    sdsSerial.begin(9600);
-    Wire.begin(BME_SDA, BME_SCL);
+void loadBsecState() {
+    size_t len = 0;
+    if (bsecStateStore.load(bsecState, sizeof(bsecState), &len)) {
+        bsec.setState(bsecState);
+        HLogger.print(F("Loaded BSEC state, generation "));
+        HLogger.println(bsecStateStore.stats().generation);
+        return;
+    }
+    if (bsecStateStore.stats().invalidSlots > 0) {
+        HLogger.println(F("BSEC state slots corrupted, starting from scratch"));
+    }
+    if (!SPIFFS.exists(BSEC_STATE_LEGACY_FILENAME)) {
+        return;
+    }
 
-    HLogger.print(F("\r\n\r\nConnecting to "));
-    HLogger.print(WIFI_SSID);
+    // Migrate the single unprotected file. It is only trusted if it has the size it was written with, and removed
+    // once it is safely in the slots, or if it is unusable anyway.
+    File file = SPIFFS.open(BSEC_STATE_LEGACY_FILENAME, "r");
+    bool complete = file.size() == sizeof(bsecState) && file.read(bsecState, sizeof(bsecState)) == sizeof(bsecState);
+    file.close();
+    if (!complete) {
+        HLogger.println(F("Discarding truncated legacy BSEC state"));
+        SPIFFS.remove(BSEC_STATE_LEGACY_FILENAME);
+        return;
+    }
 
-    WiFi.mode(WIFI_STA);
-    WiFi.begin(WIFI_SSID, WIFI_PASS);
+    bsec.setState(bsecState);
+    if (bsec.status != BSEC_OK) {
+        HLogger.println(F("Discarding legacy BSEC state rejected by BSEC"));
+        SPIFFS.remove(BSEC_STATE_LEGACY_FILENAME);
+    } else if (bsecStateStore.save(bsecState, sizeof(bsecState)) == STATE_STORE_WRITTEN) {
+        HLogger.println(F("Migrated legacy BSEC state to checksummed slots"));
+        SPIFFS.remove(BSEC_STATE_LEGACY_FILENAME);
+    }
+}
 
-    pinMode(LED_BUILTIN, OUTPUT);
-    uint8_t led = 0;
-    while (WiFi.status() != WL_CONNECTED) {
-        HLogger.print(F("."));
-        digitalWrite(LED_BUILTIN, led);
-        led = !led;
-        delay(500);
+// 0/0 readings are filtered out by ParticulateSensor
+void publishPmData(particulate_unit_t *unit, const sds011_pm_data_t *pmData) {
+    // The latest reading of the first unit goes into the next combined sample
+    if (unit == &particulateUnits[0]) {
+        samplePipeline.addPm(pmData);
     }
-    digitalWrite(LED_BUILTIN, LOW);
 
-    HLogger.println();
-    HLogger.print(F("Connected: "));
-    HLogger.println(WiFi.localIP());
+#if SAMPLE_PER_PROPERTY
+    unit->registry->publishValue(PARTICULATE_PROP_PM25, pmData->pm25);
+    unit->registry->publishValue(PARTICULATE_PROP_PM10, pmData->pm10);
+#endif
+}
 
-    MDNS.begin(WIFI_HOSTNAME);
+// Windows follow the wall clock, so readings from before it is set are left out
+void aggregatePmData(particulate_unit_t *unit, const sds011_pm_data_t *pmData) {
+    time_t now = time(nullptr);
+    if (now <= SAMPLE_MIN_VALID_TIME) {
+        return;
+    }
+    for (size_t w = 0; w < PM_WINDOW_COUNT; w++) {
+        unit->windows[2 * w]->add((uint32_t) now, pmData->pm25);
+        unit->windows[2 * w + 1]->add((uint32_t) now, pmData->pm10);
+    }
+}
+
+// Publishes the windows that ended since the last run
+void taskPmWindows() {
+    time_t now = time(nullptr);
+    if (now <= SAMPLE_MIN_VALID_TIME) {
+        return;
+    }
+    char buf[WINDOW_STATS_FORMAT_BUF_SIZE];
+    for (size_t i = 0; i < SDS_SENSOR_COUNT; i++) {
+        particulate_unit_t *unit = &particulateUnits[i];
+        for (size_t w = 0; w < 2 * PM_WINDOW_COUNT; w++) {
+            const window_summary_t *summary = unit->windows[w]->takeClosed((uint32_t) now);
+            if (summary != nullptr && WindowStats::format(summary, PRECISION_PM, buf, sizeof(buf)) > 0) {
+                unit->propWindows[w]->SetValue(buf);
+            }
+        }
+    }
+}
+
+void publishParticulateHealth() {
+    unsigned long now = millis();
+    for (size_t i = 0; i < SDS_SENSOR_COUNT; i++) {
+        particulate_unit_t *unit = &particulateUnits[i];
+        const particulate_health_t &health = unit->sensor->health();
+        unit->registry->publishUint(PARTICULATE_PROP_ONLINE, unit->sensor->online(now) ? 1 : 0);
+        unit->registry->publishUint(PARTICULATE_PROP_FRAMES, health.frames);
+        unit->registry->publishUint(PARTICULATE_PROP_COMMAND_FAILURES, health.commandFailures);
+        unit->registry->publishUint(PARTICULATE_PROP_ZERO_FRAMES, health.zeroFrames);
+
+        const sds011_link_stats_t &link = unit->sensor->bus()->linkStats();
+        unit->registry->publishUint(PARTICULATE_PROP_SERIAL_OVERFLOWS, unit->port->overflows());
+        unit->registry->publishUint(PARTICULATE_PROP_CHECKSUM_FAILURES, link.checksumFailures);
+        unit->registry->publishUint(PARTICULATE_PROP_RESYNC_BYTES, link.resyncBytes);
+        unit->registry->publishUint(PARTICULATE_PROP_TIMEOUTS, link.timeouts);
+        unit->registry->publishUint(PARTICULATE_PROP_RETRIES, link.retries);
+
+        if (unit->adaptive != nullptr) {
+            AdaptivePolling *adaptive = unit->adaptive;
+            unit->registry->publishUint(PARTICULATE_PROP_SAMPLE_INTERVAL, adaptive->intervalMs() / 1000);
+            unit->registry->publishUint(PARTICULATE_PROP_ON_TIME, (uint32_t) (adaptive->onTimeMs() / 1000));
+        }
+    }
+}
+
+// Routes active mode reports from a bus to the unit they come from
+void dispatchPmData(SDS011 *bus, const sds011_pm_data_t *pmData) {
+    for (size_t i = 0; i < SDS_SENSOR_COUNT; i++) {
+        ParticulateSensor *sensor = particulateUnits[i].sensor;
+        if (sensor->bus() == bus && sensor->accepts(pmData)) {
+            sensor->handlePmData(pmData);
+            return;
+        }
+    }
+    HLogger.print(F("SDS011: data from unknown sensor "));
+    HLogger.println(pmData->deviceId, HEX);
+}
+
+// Picks up the state saved before a reset, if any. Must run before the sensors are set up.
+void restoreRtcState() {
+    warmBoot = rtcStateLoad(&rtcState);
+    HLogger.print(F("Reset reason: "));
+    HLogger.println(ESP.getResetReason());
+    if (!warmBoot) {
+        rtcState = {};
+        HLogger.println(F("Cold boot"));
+        return;
+    }
+
+    rtcState.warmBoots++;
+    samplePipeline.setSeq(rtcState.sampleSeq);
+    HLogger.print(F("Warm restart #"));
+    HLogger.println(rtcState.warmBoots);
+}
+
+// Publishes the readings from before the restart, so that there is no gap until the units report again
+void publishRestoredPmData() {
+    if (!warmBoot) {
+        return;
+    }
+    for (size_t i = 0; i < SDS_SENSOR_COUNT && i < RTC_STATE_MAX_UNITS; i++) {
+        const rtc_unit_state_t *rtcUnit = &rtcState.units[i];
+        if (rtcUnit->deviceId != sdsSensorConfig[i].deviceId || (rtcUnit->pm25 == 0.0 && rtcUnit->pm10 == 0.0)) {
+            continue;
+        }
+        sds011_pm_data_t pmData = {rtcUnit->pm25, rtcUnit->pm10, rtcUnit->deviceId};
+        publishPmData(&particulateUnits[i], &pmData);
+    }
+}
+
+// Creates one bus per distinct pin pair and one ParticulateSensor per configured unit. Only runs once, from setup().
+void setupParticulateSensors() {
+    for (size_t i = 0; i < SDS_SENSOR_COUNT; i++) {
+        const particulate_sensor_config_t *config = &sdsSensorConfig[i];
+
+        particulate_unit_t *unit = &particulateUnits[i];
+        SDS011 *bus = nullptr;
+        for (size_t j = 0; j < i; j++) {
+            if (sdsSensorConfig[j].rxPin == config->rxPin && sdsSensorConfig[j].txPin == config->txPin) {
+                bus = particulateUnits[j].sensor->bus();
+                unit->port = particulateUnits[j].port;
+                break;
+            }
+        }
+        if (bus == nullptr) {
+            bool uart = SDS_HARDWARE_UART && config->rxPin == SDS_PORT_UART0_RX && config->txPin == SDS_PORT_UART0_TX;
+            if (uart) {
+                unit->port = new Uart0SdsPort();
+            } else {
+                unit->port = new SoftwareSdsPort(config->rxPin, config->txPin);
+            }
+            unit->port->begin();
+            bus = new SDS011(unit->port->stream());
+            bus->onPmData([bus](const sds011_pm_data_t *pmData) { dispatchPmData(bus, pmData); });
+            sdsPorts[sdsBusCount] = unit->port;
+            sdsBuses[sdsBusCount++] = bus;
+        }
+
+#if PM_ADAPTIVE_POLLING
+        // The working period is only used to tell whether the unit is online, which it is if it reported within two
+        // of them
+        uint8_t workingPeriod = (PM_ADAPTIVE_MAX_INTERVAL_S + 59) / 60;
+        unit->sensor = new ParticulateSensor(bus, config->deviceId, workingPeriod);
+        unit->adaptive = new AdaptivePolling(
+                {PM_ADAPTIVE_MIN_INTERVAL_S * 1000UL, PM_ADAPTIVE_MAX_INTERVAL_S * 1000UL,
+                 PM_ADAPTIVE_WARMUP_S * 1000UL, PM_ADAPTIVE_CHANGE_ABS, PM_ADAPTIVE_CHANGE_REL}, unit->sensor);
+#else
+        unit->sensor = new ParticulateSensor(bus, config->deviceId, config->workingPeriod);
+#endif
+        // After a warm restart the unit still runs with the settings applied before it, unless they were changed
+        const rtc_unit_state_t *rtcUnit = i < RTC_STATE_MAX_UNITS ? &rtcState.units[i] : nullptr;
+        if (warmBoot && rtcUnit != nullptr && rtcUnit->configured && rtcUnit->deviceId == config->deviceId &&
+            rtcUnit->workingPeriod == unit->sensor->workingPeriod()) {
+            unit->sensor->assumeConfigured();
+        }
+        for (size_t w = 0; w < 2 * PM_WINDOW_COUNT; w++) {
+            unit->windows[w] = new WindowStats(pmWindowLengths[w / 2]);
+        }
+        unit->sensor->onPmData([unit](const sds011_pm_data_t *pmData) {
+            publishPmData(unit, pmData);
+            aggregatePmData(unit, pmData);
+        });
+        unit->sensor->onReady([unit, config](const sds011_dev_info_t *sdsInfo) {
+            HLogger.print(config->nodeId);
+            HLogger.print(F(": SDS011 version "));
+            HLogger.print(sdsInfo->year);
+            HLogger.print('-');
+            HLogger.print(sdsInfo->month);
+            HLogger.print('-');
+            HLogger.print(sdsInfo->day);
+            HLogger.print(F(", sensor ID: "));
+            HLogger.println(sdsInfo->deviceId, HEX);
+            // Query once to avoid waiting a whole working period for the first reading
+            unit->sensor->query();
+        });
+        unit->sensor->onFailed([config]() {
+            HLogger.print(config->nodeId);
+            HLogger.println(F(": failed to configure SDS011, will retry"));
+        });
+    }
+}
+
+void publishBme680Properties() {
+    bme680Registry.publish(millis(), false);
+}
+
+// Unix time, or 0 while SNTP has not set the clock
+uint32_t sampleTime() {
+    time_t now = time(nullptr);
+    return now > SAMPLE_MIN_VALID_TIME ? (uint32_t) now : 0;
+}
+
+#if SAMPLE_FORMAT != SAMPLE_FORMAT_NONE
+
+// Replays samples buffered while offline, a few at a time so that live publishing is not starved
+void replayBufferedSamples() {
+    samplePipeline.replay(sampleTime(), millis());
+}
+
+#endif
+
+void checkBsecStatus() {
+    if (bsec.status != BSEC_OK) {
+        if (bsec.status < BSEC_OK) {
+            HLogger.print(F("BSEC error code : "));
+            HLogger.println(bsec.status);
+            otaPanic();
+        } else {
+            HLogger.print(F("BSEC warning code : "));
+            HLogger.println(bsec.status);
+        }
+    }
+
+    if (bsec.bme680Status != BME680_OK) {
+        if (bsec.bme680Status < BME680_OK) {
+            HLogger.print(F("BME680 error code : "));
+            HLogger.println(bsec.bme680Status);
+            otaPanic();
+        } else {
+            HLogger.print(F("BME680 warning code : "));
+            HLogger.println(bsec.bme680Status);
+        }
+    }
+}
+
+// Tasks, see setupTasks()
+
+void taskNetwork() {
+    // Homie and OTA are only started once WiFi is up; until then the log is only buffered
+    if (bootState != BOOT_STATE_ONLINE) {
+        return;
+    }
+    ArduinoOTA.handle();
+    homie.Loop();
+    HLogger.loop();
+}
+
+void taskStatus() {
+    if (lastBmeStatus != bsec.bme680Status) {
+        bme680Registry.publishInt(BME680_PROP_BME680_STATUS, bsec.bme680Status);
+        lastBmeStatus = bsec.bme680Status;
+    }
+    if (lastBsecStatus != bsec.status) {
+        bme680Registry.publishInt(BME680_PROP_BSEC_STATUS, bsec.status);
+        lastBsecStatus = bsec.status;
+    }
+}
+
+// BSEC keeps its own sample cadence; run() returns false until the next sample is due
+void taskBsec() {
+#if LOW_POWER_MODE
+    // One sample per measurement wake, once the PM readings that go with it are in. BSEC gets the clock that runs
+    // through deep sleep, since millis() starts over on every wake.
+    if (!lowPowerCycle.measured() || lowPowerBme680Done) {
+        return;
+    }
+    uint32_t start = LatencyStats::start();
+    bool ran = gasSensor.run(lowPowerCycle.clockMs());
+#else
+    uint32_t start = LatencyStats::start();
+    bool ran = gasSensor.run(-1);
+#endif
+    latencyBsecRun.stop(start);
+
+    if (ran) {
+        samplePipeline.addGasOutput(&gasSensor.output());
+#if SAMPLE_PER_PROPERTY
+        start = LatencyStats::start();
+        publishBme680Properties();
+        latencyBme680Publish.stop(start);
+#endif
+        samplePipeline.publish(sampleTime(), millis());
+
+#if LOW_POWER_MODE
+        // The state is saved before going to sleep, see lowPowerSleep()
+        lowPowerBme680Done = true;
+#else
+        // The flash write is left to a low priority task, so it cannot delay anything more urgent
+        if (bsec.iaqAccuracy > prevBsecAccuracy || (millis() - lastWriteBsecState) > BSEC_STATE_WRITE_INTERVAL_MS) {
+            scheduler.signal(taskSaveBsecState);
+        }
+        prevBsecAccuracy = bsec.iaqAccuracy;
+#endif
+
+#if BSEC_ADAPTIVE_RATE
+        bsecRatePolicy.add(millis(), bsec.iaq, bsec.iaqAccuracy);
+        updateBsecRate();
+#endif
+
+    } else {
+        checkBsecStatus();
+    }
+}
+
+void publishLatency(HomieProperty *prop, const LatencyStats *stats) {
+    char buf[LATENCY_FORMAT_BUF_SIZE];
+    if (stats->format(buf, sizeof(buf)) > 0) {
+        prop->SetValue(buf);
+    }
+}
+
+// Publishes the latency statistics gathered since the last run and starts a new window, then the heap statistics
+void taskDiagnostics() {
+    publishLatency(diagnosticsRegistry.property(DIAGNOSTICS_PROP_LATENCY_LOOP), &latencyLoop);
+    publishLatency(diagnosticsRegistry.property(DIAGNOSTICS_PROP_LATENCY_BSEC_RUN), &latencyBsecRun);
+    publishLatency(diagnosticsRegistry.property(DIAGNOSTICS_PROP_LATENCY_BME680_PUBLISH), &latencyBme680Publish);
+    for (uint8_t i = 0; i < scheduler.count(); i++) {
+        publishLatency(homiePropLatencyTasks[i], &scheduler.task(i)->latency);
+    }
+
+    latencyLoop.reset();
+    latencyBsecRun.reset();
+    latencyBme680Publish.reset();
+    scheduler.resetLatency();
+
+    diagnosticsRegistry.publish(millis(), true);
+
+#ifdef ALLOC_TRACKING
+    allocTrackerLog(&HLogger, 5);
+    allocTrackerReset();
+#endif
+}
+
+void taskParticulate() {
+    for (uint8_t i = 0; i < sdsBusCount; i++) {
+        sdsPorts[i]->poll();
+        sdsBuses[i]->poll();
+    }
+#if LOW_POWER_MODE
+    lowPowerCycle.loop();
+#elif PM_ADAPTIVE_POLLING
+    for (size_t i = 0; i < SDS_SENSOR_COUNT; i++) {
+        particulateUnits[i].adaptive->loop();
+    }
+#else
+    for (size_t i = 0; i < SDS_SENSOR_COUNT; i++) {
+        particulateUnits[i].sensor->loop();
+    }
+#endif
+}
+
+// OTA is only enabled with a password
+void setupOta() {
     if (OTA_PASSWORD[0] != '\0') {
         ArduinoOTA.setPassword(OTA_PASSWORD);
         ArduinoOTA.setRebootOnSuccess(true);
@@ -312,8 +1122,11 @@ void setup() {
 
         ArduinoOTA.onStart([]() {
             HLogger.println(F("OTA upgrade started"));
-            sdsSerial.end();
+            for (uint8_t i = 0; i < sdsBusCount; i++) {
+                sdsPorts[i]->end();
+            }
             saveBsecState();
+            saveRtcState();
             otaRunning = true;
         });
         ArduinoOTA.onEnd([]() {
@@ -339,152 +1152,251 @@ void setup() {
                     HLogger.println("END");
                     break;
             }
-            Serial.flush();
+            HLogger.flush();
             delay(1000);
             ESP.reset();
         });
         ArduinoOTA.begin();
         HLogger.println("OTA server up");
     }
+}
 
-    HomieLibRegisterDebugPrintCallback([](const char *szText) {
-        HLogger.print(szText);
-    });
+// Brings up everything that needs the network once WiFi is connected
+void startNetworkServices() {
+    HLogger.print(F("Connected: "));
+    HLogger.println(WiFi.localIP());
+
+    // UTC; only used to timestamp combined samples
+    configTime(0, 0, NTP_SERVER);
+
+    MDNS.begin(WIFI_HOSTNAME);
+    setupOta();
 
     HLogger.println(F("Bringing up Homie"));
-    setupHomieTree();
     homie.strID = "air-sensor";
     homie.strFriendlyName = "Air quality sensor";
     homie.strMqttServerIP = MQTT_IP;
     homie.Init();
-    HLogger.setHomieProp(homiePropLog);
-
+    HLogger.setHomieProp(generalRegistry.property(GENERAL_PROP_LOG));
     HLogger.println(F("Homie is running"));
+}
 
-    SPIFFSConfig fsConfig;
-    fsConfig.setAutoFormat(true);
-    SPIFFS.setConfig(fsConfig);
-    SPIFFS.begin();
-
-    bsec.begin(BME680_I2C_ADDR_SECONDARY, Wire);
-    bsec.setConfig(bsec_config_iaq);
-
-    if (SPIFFS.exists(BSEC_STATE_FILENAME)) {
-        File file = SPIFFS.open(BSEC_STATE_FILENAME, "r");
-        file.read(bsecState, sizeof(bsecState));
-        file.close();
-        bsec.setState(bsecState);
-        HLogger.println("Loaded BSEC state");
+// Waits for WiFi without blocking, blinking the LED meanwhile, unless the log is on its pin (SDS_HARDWARE_UART).
+// WiFi keeps retrying by itself, so a missing access point only delays publishing; samples are buffered until then.
+void taskBoot() {
+    if (bootState == BOOT_STATE_ONLINE) {
+        return;
+    }
+    if (WiFi.status() != WL_CONNECTED) {
+#if !SDS_HARDWARE_UART
+        digitalWrite(LED_BUILTIN, bootLed);
+        bootLed = !bootLed;
+#endif
+        if (millis() - bootWifiLastLog >= BOOT_WIFI_LOG_INTERVAL_MS) {
+            HLogger.print(F("Still connecting to "));
+            HLogger.println(WIFI_SSID);
+            bootWifiLastLog = millis();
+        }
+        return;
     }
 
-    bsec.updateSubscription(bsecSensorList, sizeof(bsecSensorList), BSEC_SAMPLE_RATE_LP);
+#if !SDS_HARDWARE_UART
+    digitalWrite(LED_BUILTIN, LOW);
+#endif
+    startNetworkServices();
+    bootState = BOOT_STATE_ONLINE;
+}
 
-    String output = "BSEC version " + String(bsec.version.major) + "." + String(bsec.version.minor) + "." +
-                    String(bsec.version.major_bugfix) + "." + String(bsec.version.minor_bugfix);
-    HLogger.println(output);
+// Budgets are the longest a task is expected to take; overruns are only counted
+void setupTasks() {
+    scheduler.addPeriodic("boot", SCHEDULER_PRIORITY_NORMAL, 5000, 500, taskBoot);
+    scheduler.addPeriodic("network", SCHEDULER_PRIORITY_HIGH, 10000, 0, taskNetwork);
+    scheduler.addPeriodic("bsec", SCHEDULER_PRIORITY_HIGH, 20000, 0, taskBsec);
+    scheduler.addPeriodic("particulate", SCHEDULER_PRIORITY_NORMAL, 2000, 0, taskParticulate);
+    scheduler.addPeriodic("status", SCHEDULER_PRIORITY_NORMAL, 2000, 1000, taskStatus);
+    scheduler.addPeriodic("particulate-health", SCHEDULER_PRIORITY_LOW, 5000, PARTICULATE_HEALTH_INTERVAL_MS,
+                          publishParticulateHealth);
+    scheduler.addPeriodic("pm-windows", SCHEDULER_PRIORITY_LOW, 5000, PM_WINDOW_CHECK_INTERVAL_MS, taskPmWindows);
+#if SAMPLE_FORMAT != SAMPLE_FORMAT_NONE
+    scheduler.addPeriodic("sample-replay", SCHEDULER_PRIORITY_LOW, 20000, SAMPLE_REPLAY_INTERVAL_MS,
+                          replayBufferedSamples);
+#endif
+    taskSaveBsecState = scheduler.addEvent("save-bsec-state", SCHEDULER_PRIORITY_LOW, 50000, saveBsecState);
+    scheduler.addPeriodic("rtc-state", SCHEDULER_PRIORITY_LOW, 1000, RTC_STATE_SAVE_INTERVAL_MS, saveRtcState);
+    scheduler.addPeriodic("diagnostics", SCHEDULER_PRIORITY_LOW, 20000, DIAGNOSTICS_INTERVAL_MS, taskDiagnostics);
+}
 
-    sds011_dev_info_t sdsInfo;
-    if (!sds.getInfo(&sdsInfo)) {
-        HLogger.println("Fatal: failed to retrieve SDS011 device info");
-        otaPanic();
+#if LOW_POWER_MODE
+
+// Measurement wake: done once the BME680 sample is taken and everything has been handed to the broker
+bool lowPowerReady() {
+    bool done = lowPowerBme680Done && bootState == BOOT_STATE_ONLINE && homie.IsConnected();
+#if SAMPLE_FORMAT != SAMPLE_FORMAT_NONE
+    done = done && sampleBuffer.empty();
+#endif
+    if (!done) {
+        lowPowerSettledMs = 0;
+        return false;
     }
-    if (!sds.setWorkingPeriod(1)) { // once per minute
-        HLogger.println("Fatal: failed to set SDS011 working period");
-        otaPanic();
-    }
-    if (!sds.setDataReporting(SDS011_REPORT_MODE_ACTIVE)) {
-        HLogger.println("Fatal: failed to set SDS011 data reporting mode");
-        otaPanic();
-    }
-    if (!sds.setSleepMode(SDS011_SLEEP_MODE_WORK)) {
-        HLogger.println("Fatal: failed to set SDS011 sleep mode");
-        otaPanic();
-    }
-
-    output = "SDS011 version " + String(sdsInfo.year) + "-" + String(sdsInfo.month) + "-" + String(sdsInfo.day) +
-             ", sensor ID: " + String(sdsInfo.deviceId, HEX);
-    HLogger.println(output);
-
-    // Query the sensor once on start to avoid publishing 0.0
-    sds011_pm_data_t pmData;
-    if (sds.query(&pmData)) {
-        homiePropPm25->SetValue(String(pmData.pm25));
-        homiePropPm10->SetValue(String(pmData.pm10));
+    // Publishing is asynchronous; give the MQTT client a moment to get the messages out
+    if (lowPowerSettledMs == 0) {
+        lowPowerSettledMs = millis();
     }
+    return millis() - lowPowerSettledMs >= LOW_POWER_PUBLISH_GRACE_MS;
 }
 
-void checkBsecStatus() {
-    String output;
-    if (bsec.status != BSEC_OK) {
-        if (bsec.status < BSEC_OK) {
-            output = "BSEC error code : " + String(bsec.status);
-            HLogger.println(output);
-            otaPanic();
-        } else {
-            output = "BSEC warning code : " + String(bsec.status);
-            HLogger.println(output);
+// Saves whatever has to survive deep sleep and goes to sleep. Needs GPIO16 wired to RST to wake up again.
+void lowPowerSleep(uint32_t sleepMs, bool radio) {
+    if (!lowPowerWarmupWake) {
+        // RTC memory keeps the BSEC state from one wake to the next; flash only gets it every few cycles, for after a
+        // power loss
+        bsec.getState(rtcState.bsecState);
+        rtcState.bsecStateValid = 1;
+        if (lowPowerCycle.state().cycles % LOW_POWER_FLASH_STATE_CYCLES == 0) {
+            saveBsecState();
         }
+#if SAMPLE_FORMAT != SAMPLE_FORMAT_NONE
+        // The RAM ring is lost in deep sleep
+        if (!sampleBuffer.persist()) {
+            HLogger.println(F("Failed to keep buffered samples through deep sleep"));
+        }
+#endif
     }
+    HLogger.print(F("Sleeping for "));
+    HLogger.print(sleepMs);
+    HLogger.println(F(" ms"));
+    saveRtcState();
+    HLogger.flush();
+    ESP.deepSleep((uint64_t) sleepMs * 1000, radio ? WAKE_RF_DEFAULT : WAKE_RF_DISABLED);
+}
 
-    if (bsec.bme680Status != BME680_OK) {
-        if (bsec.bme680Status < BME680_OK) {
-            output = "BME680 error code : " + String(bsec.bme680Status);
-            HLogger.println(output);
-            otaPanic();
-        } else {
-            output = "BME680 warning code : " + String(bsec.bme680Status);
-            HLogger.println(output);
-        }
+// The units are driven by the low power cycle instead of ParticulateSensor::loop(), see taskParticulate()
+void startLowPowerCycle() {
+    for (size_t i = 0; i < SDS_SENSOR_COUNT; i++) {
+        lowPowerSensors[i] = particulateUnits[i].sensor;
     }
+    lowPowerCycle.onReady(lowPowerReady);
+    lowPowerCycle.onSleep(lowPowerSleep);
+    lowPowerCycle.begin(&rtcState.lowPower);
+
+    HLogger.print(F("Low power cycle "));
+    HLogger.print(rtcState.lowPower.cycles);
+    HLogger.println(lowPowerWarmupWake ? F(", warm-up wake") : F(", measurement wake"));
 }
 
-void loop() {
-    ArduinoOTA.handle();
-    if (otaRunning) {
+// Warm-up wake: only starts the SDS011 fans, with the radio off, and goes back to sleep
+void setupLowPowerWarmup() {
+    lowPowerWarmupWake = true;
+    WiFi.mode(WIFI_OFF);
+    setupParticulateSensors();
+    startLowPowerCycle();
+}
+
+#endif
+
+void setup() {
+#if SDS_HARDWARE_UART
+    // UART0 goes to the SDS011, see setupParticulateSensors(). The log takes GPIO2, which is also the LED, so the LED
+    // is left alone.
+    Serial1.begin(74880);
+    HLogger.setSerial(&Serial1);
+#else
+    Serial.begin(74880);
+    pinMode(LED_BUILTIN, OUTPUT);
+#endif
+    Wire.begin(BME_SDA, BME_SCL);
+
+    restoreRtcState();
+#if LOW_POWER_MODE
+    if (rtcState.lowPower.phase == LOW_POWER_PHASE_WARMUP) {
+        setupLowPowerWarmup();
         return;
     }
+#endif
 
-    homie.Loop();
+    // WiFi connects in the background, see taskBoot(); sensors start meanwhile and samples are buffered until the
+    // broker is reachable
+    HLogger.print(F("\r\n\r\nConnecting to "));
+    HLogger.println(WIFI_SSID);
+    WiFi.mode(WIFI_STA);
+    WiFi.begin(WIFI_SSID, WIFI_PASS);
 
-    if (lastBmeStatus != bsec.bme680Status) {
-        homiePropBme680Status->SetValue(String(bsec.bme680Status));
-        lastBmeStatus = (unsigned char) bsec.bme680Status;
-    }
-    if (lastBsecStatus != bsec.status) {
-        homiePropBsecStatus->SetValue(String(bsec.status));
-        lastBsecStatus = bsec.status;
-    }
+    HomieLibRegisterDebugPrintCallback([](const char *szText) {
+        HLogger.print(szText);
+    });
 
-    if (bsec.run()) {
-        homiePropRawTemperature->SetValue(String(bsec.rawTemperature));
-        homiePropTemperature->SetValue(String(bsec.temperature));
-        homiePropPressure->SetValue(String(bsec.pressure));
-        homiePropRawHumidity->SetValue(String(bsec.rawHumidity));
-        homiePropHumidity->SetValue(String(bsec.humidity));
-        homiePropGasResistance->SetValue(String(bsec.gasPercentageAcccuracy));
-        homiePropIaq->SetValue(String(bsec.iaq));
-        homiePropIaqAccuracy->SetValue(String(bsec.iaqAccuracy));
-        homiePropStaticIaq->SetValue(String(bsec.staticIaq));
-        homiePropStaticIaqAccuracy->SetValue(String(bsec.staticIaqAccuracy));
-        homiePropCo2Equivalent->SetValue(String(bsec.co2Equivalent));
-        homiePropCo2EquivalentAccuracy->SetValue(String(bsec.co2Accuracy));
-        homiePropBreathVocEquivalent->SetValue(String(bsec.breathVocEquivalent));
-        homiePropBreathVocEquivalentAccuracy->SetValue(String(bsec.breathVocAccuracy));
-        homiePropPowerOnStabStatus->SetBool((bool) bsec.runInStatus);
-        homiePropStabStatus->SetBool((bool) bsec.stabStatus);
+    SPIFFSConfig fsConfig;
+    fsConfig.setAutoFormat(true);
+    SPIFFS.setConfig(fsConfig);
+    SPIFFS.begin();
+#if SAMPLE_FORMAT != SAMPLE_FORMAT_NONE
+    sampleBuffer.begin();
+#endif
 
-        if (bsec.iaqAccuracy > prevBsecAccuracy || (millis() - lastWriteBsecState) > BSEC_STATE_WRITE_INTERVAL_MS) {
-            saveBsecState();
-        }
-        prevBsecAccuracy = bsec.iaqAccuracy;
+    bsec.begin(BME680_I2C_ADDR_SECONDARY, Wire);
+#if BSEC_ADAPTIVE_RATE
+    // Starts at LP, see updateBsecRate()
+    memcpy_P(bsec_config_iaq, bsecConfigLp, sizeof(bsec_config_iaq));
+#endif
+    bsec.setConfig(bsec_config_iaq);
 
-    } else {
-        checkBsecStatus();
+    loadBsecState();
+    if (warmBoot && rtcState.bsecGeneration > bsecStateStore.stats().generation) {
+        HLogger.println(F("BSEC state in flash is older than before the restart"));
+    }
+#if LOW_POWER_MODE
+    // Newer than the copy in flash, which is only written every LOW_POWER_FLASH_STATE_CYCLES. The flash copy is still
+    // loaded above, for the slot generation.
+    if (warmBoot && rtcState.bsecStateValid) {
+        bsec.setState(rtcState.bsecState);
+    }
+#endif
+
+    bsec.updateSubscription(bsecSensorList, sizeof(bsecSensorList), BSEC_SAMPLE_RATE);
+
+    HLogger.print(F("BSEC version "));
+    HLogger.print(bsec.version.major);
+    HLogger.print('.');
+    HLogger.print(bsec.version.minor);
+    HLogger.print('.');
+    HLogger.print(bsec.version.major_bugfix);
+    HLogger.print('.');
+    HLogger.println(bsec.version.minor_bugfix);
+
+    // SDS011 units are configured asynchronously from loop(), so BSEC and Homie keep running meanwhile and a missing
+    // unit is retried without affecting the others.
+    setupParticulateSensors();
+#if LOW_POWER_MODE
+    startLowPowerCycle();
+#endif
+
+    // The Homie tree can be built offline; taskBoot() starts Homie once WiFi is up
+    setupTasks();
+    setupHomieTree();
+    publishRestoredPmData();
+}
+
+void loop() {
+#if LOW_POWER_MODE
+    if (lowPowerWarmupWake) {
+        taskParticulate();
+        return;
+    }
+#endif
+    // An upload blocks in ArduinoOTA.handle(); nothing else may run while the flash is being rewritten
+    if (otaRunning) {
+        ArduinoOTA.handle();
+        return;
     }
+    uint32_t start = LatencyStats::start();
+    scheduler.run();
+    latencyLoop.stop(start);
 
-    sds011_pm_data_t pmData;
-    if (sds.read(&pmData) && (pmData.pm10 != 0.0 || pmData.pm25 != 0.0)) {
-        homiePropPm25->SetValue(String(pmData.pm25));
-        homiePropPm10->SetValue(String(pmData.pm10));
+    uint32_t freeHeap = ESP.getFreeHeap();
+    if (freeHeap < heapLowWater) {
+        heapLowWater = freeHeap;
     }
+#ifdef ALLOC_TRACKING
+    allocTrackerEndPass();
+#endif
 }